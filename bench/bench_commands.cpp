@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string>
+#include "microbox_bench.h"
+#include "bench_console.h"
+
+// dispatch and tab completion as the command table grows; the argument is the number of
+// commands registered besides the built-in ones
+
+static char commandNames[MAX_COMMAND_NUMBER][8];
+
+static void addCommands(BenchConsole& console, int64_t count)
+{
+    for (int64_t i = 0; i < count; i++) {
+        snprintf(commandNames[i], sizeof(commandNames[i]), "cmd%03d", (int)i);
+        console.microbox.addCommand(commandNames[i], [](char**, uint8_t) {}, "Does nothing.\n\r");
+    }
+}
+
+// executing the command registered last, it is found at the end of the list
+static void dispatchLatency(BenchState& state)
+{
+    BenchConsole console(false);
+    char line[16];
+
+    addCommands(console, state.argument());
+    snprintf(line, sizeof(line), "%s 1 2\r", commandNames[state.argument() - 1]);
+    while (state.keepRunning())
+        console.feed(line);
+    state.setItemsProcessed(state.iterations());
+}
+MICROBOX_BENCHMARK(dispatchLatency, 4, 16, 64, 124);
+
+// "c" + Tab completes the prefix all commands share, the backspaces take it back
+static void tabCompletion(BenchState& state)
+{
+    BenchConsole console;
+
+    addCommands(console, state.argument());
+    while (state.keepRunning())
+        console.feed("c\t\x7F\x7F\x7F");
+    state.setItemsProcessed(state.iterations());
+}
+MICROBOX_BENCHMARK(tabCompletion, 4, 16, 64, 124);
+
+// lines going into a full history, each one pushes out the oldest
+static void historyAppend(BenchState& state)
+{
+    BenchConsole console(false);
+    std::string script;
+
+    console.microbox.addCommand("nop", [](char**, uint8_t) {}, "Does nothing.\n\r");
+    for (int i = 0; i < 64; i++)
+        script += "nop " + std::to_string(i * 7919) + "\r";
+    console.feed(script.data(), script.size());
+    while (state.keepRunning())
+        console.feed(script.data(), script.size());
+    state.setItemsProcessed(state.iterations() * 64);
+}
+MICROBOX_BENCHMARK(historyAppend);
+
+// the arrow keys walk through the argument's number of history entries and back
+static void historyNavigation(BenchState& state)
+{
+    BenchConsole console;
+    std::string script;
+    std::string keys;
+
+    console.microbox.addCommand("nop", [](char**, uint8_t) {}, "Does nothing.\n\r");
+    for (int64_t i = 0; i < state.argument(); i++)
+        script += "nop " + std::to_string(i) + "\r";
+    console.feed(script.data(), script.size());
+    for (int64_t i = 0; i < state.argument(); i++)
+        keys += "\x1B[A";
+    for (int64_t i = 0; i < state.argument(); i++)
+        keys += "\x1B[B";
+    while (state.keepRunning())
+        console.feed(keys.data(), keys.size());
+    state.setItemsProcessed(state.iterations() * 2 * state.argument());
+}
+MICROBOX_BENCHMARK(historyNavigation, 8, 64);
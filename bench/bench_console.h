@@ -0,0 +1,37 @@
+#ifndef MICROBOX_BENCH_CONSOLE_H
+#define MICROBOX_BENCH_CONSOLE_H
+
+#include <string.h>
+#include <vector>
+#include "microBox.h"
+#include "port_handlers/microBox_buffer_port_handler.h"
+
+// A MicroBox on an in-memory port for the benchmarks; what it prints is collected and thrown
+// away after every feed()
+class BenchConsole {
+public:
+    explicit BenchConsole(bool localEcho = true) : output(1 << 16), port(output.data(), output.size())
+    {
+        microbox.begin("bench", &port, false, localEcho);
+    }
+
+    // hands the input to the console and runs the parser until all of it is processed
+    void feed(const char* input, size_t len)
+    {
+        port.setInput(input, len);
+        while (microbox.commandParser() || microbox.pendingInput() > 0) {
+        }
+        port.clearOutput();
+    }
+
+    void feed(const char* input)
+    {
+        feed(input, strlen(input));
+    }
+
+    std::vector<uint8_t> output;
+    BufferPortHandler port;
+    MicroBox microbox;
+};
+
+#endif // MICROBOX_BENCH_CONSOLE_H
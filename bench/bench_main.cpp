@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "microbox_bench.h"
+
+// runs the registered benchmarks:  microbox_bench [--quick] [--min-time=<seconds>] [filter]
+// --quick runs every benchmark for a moment only, to check that they still work
+
+typedef struct {
+    const char* name;
+    bench_function_t function;
+    std::vector<int64_t> arguments;
+} BENCHMARK;
+
+static std::vector<BENCHMARK>& benchmarks()
+{
+    static std::vector<BENCHMARK> registered;
+    return registered;
+}
+
+int microBoxAddBenchmark(const char* name, bench_function_t function, std::vector<int64_t> arguments)
+{
+    benchmarks().push_back({ name, function, arguments });
+    return (int)benchmarks().size();
+}
+
+// printf_() of printf/printf.c writes through this; the benchmarks only use the buffer functions
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static void printRate(char* text, size_t size, double perSecond, const char* unit)
+{
+    static const char* const prefixes[] = { "", "k", "M", "G" };
+    uint8_t prefix = 0;
+
+    while (perSecond >= 1000 && prefix < 3) {
+        perSecond /= 1000;
+        prefix++;
+    }
+    snprintf(text, size, "%.1f %s%s/s", perSecond, prefixes[prefix], unit);
+}
+
+static void run(const BENCHMARK& benchmark, int64_t argument, bool hasArgument, double minTime)
+{
+    std::string name = benchmark.name;
+    uint64_t iterations = 1;
+
+    if (hasArgument)
+        name += "/" + std::to_string(argument);
+    for (;;) {
+        BenchState state(iterations, argument);
+        benchmark.function(state);
+        if (state.seconds() >= minTime || iterations >= 1000000000ULL) {
+            char bytes[32] = "", items[32] = "";
+            if (state.bytesProcessed() > 0)
+                printRate(bytes, sizeof(bytes), state.bytesProcessed() / state.seconds(), "B");
+            if (state.itemsProcessed() > 0)
+                printRate(items, sizeof(items), state.itemsProcessed() / state.seconds(), "items");
+            printf("%-40s %12.1f ns %12llu %16s %18s\n", name.c_str(), state.seconds() * 1e9 / iterations,
+                (unsigned long long)iterations, bytes, items);
+            fflush(stdout);
+            return;
+        }
+        // aim a bit past the minimum time with the next round
+        double perIteration = state.seconds() / iterations;
+        uint64_t next = perIteration > 0 ? (uint64_t)(minTime * 1.4 / perIteration) : iterations * 10;
+        if (next > iterations * 10)
+            next = iterations * 10;
+        iterations = next > iterations ? next : iterations + 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    double minTime = 0.5;
+    const char* filter = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--quick"))
+            minTime = 0.001;
+        else if (!strncmp(argv[i], "--min-time=", 11))
+            minTime = atof(argv[i] + 11);
+        else
+            filter = argv[i];
+    }
+
+    printf("%-40s %15s %12s %16s %18s\n", "Benchmark", "Time", "Iterations", "Bytes", "Items");
+    for (const BENCHMARK& benchmark : benchmarks()) {
+        if (filter != nullptr && strstr(benchmark.name, filter) == nullptr)
+            continue;
+        if (benchmark.arguments.empty())
+            run(benchmark, 0, false, minTime);
+        for (int64_t argument : benchmark.arguments)
+            run(benchmark, argument, true, minTime);
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <string>
+#include "microbox_bench.h"
+#include "bench_console.h"
+
+// commandParser() throughput on a scripted session: short commands with parameters, a few
+// unknown ones and line editing, as a host tool or a person would send them
+
+static std::string sessionScript()
+{
+    std::string script;
+
+    for (int i = 0; i < 64; i++) {
+        script += "set " + std::to_string(i) + " " + std::to_string(i * 37 % 1000) + "\r";
+        script += "get " + std::to_string(i) + "\r";
+        if (i % 8 == 0)
+            script += "gte\x7F\x7F" "et 3\r";
+        if (i % 16 == 0)
+            script += "nosuchcommand\r";
+    }
+    return script;
+}
+
+// the argument switches the local echo off (0) or on (1)
+static void commandParserThroughput(BenchState& state)
+{
+    static uint32_t registers[64];
+    BenchConsole console(state.argument() != 0);
+    std::string script = sessionScript();
+
+    console.microbox.addCommand("set", [](char** param, uint8_t parCnt) {
+        if (parCnt == 2)
+            registers[atoi(param[0]) % 64] = atoi(param[1]);
+    }, "set <register> <value>\n\r");
+    console.microbox.addCommand("get", [&console](char** param, uint8_t parCnt) {
+        if (parCnt == 1)
+            console.microbox.printf("%lu\n", (unsigned long)registers[atoi(param[0]) % 64]);
+    }, "get <register>\n\r");
+
+    while (state.keepRunning())
+        console.feed(script.data(), script.size());
+    state.setBytesProcessed(state.iterations() * script.size());
+}
+MICROBOX_BENCHMARK(commandParserThroughput, 0, 1);
+
+// long lines of plain text: the bulk path that copies runs into the line and the echo
+static void plainTextThroughput(BenchState& state)
+{
+    BenchConsole console;
+    std::string line(MAX_COMMAND_BUFFER_SIZE - 2, 'x');
+    std::string script;
+
+    for (int i = 0; i < 32; i++)
+        script += line + "\r";
+    while (state.keepRunning())
+        console.feed(script.data(), script.size());
+    state.setBytesProcessed(state.iterations() * script.size());
+}
+MICROBOX_BENCHMARK(plainTextThroughput);
@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "microbox_bench.h"
+#include "port_policy.h"
+
+// Bytes/s in and out of the console through a PortHandler chosen at runtime and through a
+// MicroBoxOn<> port policy. Both ports sit on the same memory; the argument picks a port that
+// only moves single bytes, like a UART data register (0), or one that copies blocks (1).
+
+#define PORT_BYTES                  0
+#define PORT_BLOCKS                 1
+
+// memory both kinds of port work on
+class BenchWire {
+public:
+    BenchWire() : output(1 << 16)
+    {
+
+    }
+
+    void setInput(const std::string& text)
+    {
+        input = text.data();
+        inputSize = text.size();
+        inputPosition = 0;
+    }
+
+    // bytes written since the last call
+    size_t takeOutput()
+    {
+        size_t written = outputPosition;
+        outputPosition = 0;
+        return written;
+    }
+
+    size_t write(uint8_t c)
+    {
+        if (outputPosition >= output.size())
+            return 0;
+        output[outputPosition++] = c;
+        return 1;
+    }
+
+    size_t writeBytes(const uint8_t* buffer, size_t size)
+    {
+        if (size > output.size() - outputPosition)
+            size = output.size() - outputPosition;
+        memcpy(output.data() + outputPosition, buffer, size);
+        outputPosition += size;
+        return size;
+    }
+
+    int read()
+    {
+        return inputPosition < inputSize ? (uint8_t)input[inputPosition++] : -1;
+    }
+
+    size_t readBytes(uint8_t* buffer, size_t size)
+    {
+        if (size > inputSize - inputPosition)
+            size = inputSize - inputPosition;
+        memcpy(buffer, input + inputPosition, size);
+        inputPosition += size;
+        return size;
+    }
+
+    int available()
+    {
+        return (int)(inputSize - inputPosition);
+    }
+
+private:
+    const char* input = nullptr;
+    size_t inputSize = 0;
+    size_t inputPosition = 0;
+    std::vector<uint8_t> output;
+    size_t outputPosition = 0;
+};
+
+class BytePortHandler : public PortHandler {
+public:
+    explicit BytePortHandler(BenchWire& wire) : wire(wire)
+    {
+
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        return wire.write(c);
+    }
+
+    virtual int read() override
+    {
+        return wire.read();
+    }
+
+    virtual int available() override
+    {
+        return wire.available();
+    }
+
+protected:
+    BenchWire& wire;
+};
+
+class BlockPortHandler : public BytePortHandler {
+public:
+    explicit BlockPortHandler(BenchWire& wire) : BytePortHandler(wire)
+    {
+
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        return wire.writeBytes(buffer, size);
+    }
+
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        return wire.readBytes(buffer, size);
+    }
+};
+
+class BytePort : public PortPolicy<BytePort> {
+public:
+    explicit BytePort(BenchWire& wire) : wire(wire)
+    {
+
+    }
+
+    size_t write(uint8_t c)
+    {
+        return wire.write(c);
+    }
+
+    int read()
+    {
+        return wire.read();
+    }
+
+    int available()
+    {
+        return wire.available();
+    }
+
+private:
+    BenchWire& wire;
+};
+
+class BlockPort : public PortPolicy<BlockPort> {
+public:
+    explicit BlockPort(BenchWire& wire) : wire(wire)
+    {
+
+    }
+
+    size_t write(uint8_t c)
+    {
+        return wire.write(c);
+    }
+
+    size_t writeBytes(const uint8_t* buffer, size_t size)
+    {
+        return wire.writeBytes(buffer, size);
+    }
+
+    int read()
+    {
+        return wire.read();
+    }
+
+    size_t readBytes(uint8_t* buffer, size_t size)
+    {
+        return wire.readBytes(buffer, size);
+    }
+
+    int available()
+    {
+        return wire.available();
+    }
+
+private:
+    BenchWire& wire;
+};
+
+// typed commands with their echo, a printf() answer for every other one and 1 KB of text
+// after every eighth
+static std::string portScript()
+{
+    std::string script;
+
+    for (int i = 0; i < 64; i++) {
+        script += "set " + std::to_string(i) + " " + std::to_string(i * 37 % 1000) + "\r";
+        script += "get " + std::to_string(i) + "\r";
+        if (i % 4 == 0)
+            script += "dump\r";
+    }
+    return script;
+}
+
+// runs the script through the console until the benchmark is over, counts the bytes both ways
+static void runPortSession(BenchState& state, MicroBoxCore& microbox, BenchWire& wire)
+{
+    static uint32_t registers[64];
+    std::string script = portScript();
+    uint64_t bytes = 0;
+
+    microbox.addCommand("set", [](char** param, uint8_t parCnt) {
+        if (parCnt == 2)
+            registers[atoi(param[0]) % 64] = atoi(param[1]);
+    }, "set <register> <value>\n\r");
+    microbox.addCommand("get", [&microbox](char** param, uint8_t parCnt) {
+        if (parCnt == 1)
+            microbox.printf("%lu\n", (unsigned long)registers[atoi(param[0]) % 64]);
+    }, "get <register>\n\r");
+    microbox.addCommand("dump", [&microbox](char**, uint8_t) {
+        static const std::string text(1024, 'x');
+        microbox.print(text.c_str(), text.size());
+    }, "1 KB of text\n\r");
+
+    while (state.keepRunning()) {
+        wire.setInput(script);
+        while (microbox.commandParser() || microbox.pendingInput() > 0) {
+        }
+        bytes += script.size() + wire.takeOutput();
+    }
+    state.setBytesProcessed(bytes);
+}
+
+static void portVirtual(BenchState& state)
+{
+    BenchWire wire;
+    BytePortHandler bytePort(wire);
+    BlockPortHandler blockPort(wire);
+    MicroBox microbox;
+
+    if (state.argument() == PORT_BLOCKS)
+        microbox.begin("bench", &blockPort, false, true);
+    else
+        microbox.begin("bench", &bytePort, false, true);
+    runPortSession(state, microbox, wire);
+}
+MICROBOX_BENCHMARK(portVirtual, PORT_BYTES, PORT_BLOCKS);
+
+static void portPolicy(BenchState& state)
+{
+    BenchWire wire;
+
+    if (state.argument() == PORT_BLOCKS) {
+        MicroBoxOn<BlockPort> microbox(wire);
+        microbox.begin("bench", false, true);
+        runPortSession(state, microbox, wire);
+    } else {
+        MicroBoxOn<BytePort> microbox(wire);
+        microbox.begin("bench", false, true);
+        runPortSession(state, microbox, wire);
+    }
+}
+MICROBOX_BENCHMARK(portPolicy, PORT_BYTES, PORT_BLOCKS);
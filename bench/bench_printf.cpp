@@ -0,0 +1,102 @@
+#include "microbox_bench.h"
+#include "bench_console.h"
+#include "printf/printf.h"
+#undef printf
+
+// formatting throughput of the bundled printf, straight into a buffer with vsnprintf_(), through
+// MicroBox::printf() and through MICROBOX_PRINTF() with the format parsed while compiling, the
+// last two to the port; the argument picks the kind of numbers
+
+enum {
+    FORMAT_DECIMAL,
+    FORMAT_HEX,
+    FORMAT_FLOAT,
+    FORMAT_MIXED
+};
+
+static int formatRow(char* buffer, size_t size, int64_t kind, uint32_t i)
+{
+    switch (kind) {
+    case FORMAT_DECIMAL:
+        return snprintf_(buffer, size, "%d %u %ld %d\n", (int)(i * 2654435761U), i, -(long)i * 1009, (int)(i & 0xFF));
+    case FORMAT_HEX:
+        return snprintf_(buffer, size, "%08x %x %#lx\n", i * 2654435761U, i, (unsigned long)i << 12);
+    case FORMAT_FLOAT:
+        return snprintf_(buffer, size, "%.3f %f %e\n", i * 0.001 + 1.5, i * -123.25, i * 1e5 + 0.5);
+    default:
+        return snprintf_(buffer, size, "%s %5d 0x%04x %.2f %c\n", "row", (int)i, i & 0xFFFF, i / 7.0, 'a' + (char)(i % 26));
+    }
+}
+
+static void vsnprintfFormatting(BenchState& state)
+{
+    char buffer[128];
+    uint64_t bytes = 0;
+    uint32_t i = 0;
+
+    while (state.keepRunning()) {
+        bytes += formatRow(buffer, sizeof(buffer), state.argument(), i++);
+        microBoxKeep(buffer);
+    }
+    state.setBytesProcessed(bytes);
+    state.setItemsProcessed(state.iterations());
+}
+MICROBOX_BENCHMARK(vsnprintfFormatting, FORMAT_DECIMAL, FORMAT_HEX, FORMAT_FLOAT, FORMAT_MIXED);
+
+static void microboxPrintf(BenchState& state)
+{
+    BenchConsole console;
+    MicroBox& microbox = console.microbox;
+    uint32_t i = 0;
+
+    while (state.keepRunning()) {
+        switch (state.argument()) {
+        case FORMAT_DECIMAL:
+            microbox.printf("%d %u %ld %d\n", (int)(i * 2654435761U), i, -(long)i * 1009, (int)(i & 0xFF));
+            break;
+        case FORMAT_HEX:
+            microbox.printf("%08x %x %#lx\n", i * 2654435761U, i, (unsigned long)i << 12);
+            break;
+        case FORMAT_FLOAT:
+            microbox.printf("%.3f %f %e\n", i * 0.001 + 1.5, i * -123.25, i * 1e5 + 0.5);
+            break;
+        default:
+            microbox.printf("%s %5d 0x%04x %.2f %c\n", "row", (int)i, i & 0xFFFF, i / 7.0, 'a' + (char)(i % 26));
+            break;
+        }
+        i++;
+        if (console.port.outputSize() > console.output.size() / 2)
+            console.port.clearOutput();
+    }
+    state.setItemsProcessed(state.iterations());
+}
+MICROBOX_BENCHMARK(microboxPrintf, FORMAT_DECIMAL, FORMAT_HEX, FORMAT_FLOAT, FORMAT_MIXED);
+
+static void microboxPrintfCompiled(BenchState& state)
+{
+    BenchConsole console;
+    MicroBox& microbox = console.microbox;
+    uint32_t i = 0;
+
+    while (state.keepRunning()) {
+        switch (state.argument()) {
+        case FORMAT_DECIMAL:
+            MICROBOX_PRINTF(microbox, "%d %u %ld %d\n", (int)(i * 2654435761U), i, -(long)i * 1009, (int)(i & 0xFF));
+            break;
+        case FORMAT_HEX:
+            MICROBOX_PRINTF(microbox, "%08x %x %#lx\n", i * 2654435761U, i, (unsigned long)i << 12);
+            break;
+        case FORMAT_FLOAT:
+            MICROBOX_PRINTF(microbox, "%.3f %f %e\n", i * 0.001 + 1.5, i * -123.25, i * 1e5 + 0.5);
+            break;
+        default:
+            MICROBOX_PRINTF(microbox, "%s %5d 0x%04x %.2f %c\n", "row", (int)i, i & 0xFFFF, i / 7.0, 'a' + (char)(i % 26));
+            break;
+        }
+        i++;
+        if (console.port.outputSize() > console.output.size() / 2)
+            console.port.clearOutput();
+    }
+    state.setItemsProcessed(state.iterations());
+}
+MICROBOX_BENCHMARK(microboxPrintfCompiled, FORMAT_DECIMAL, FORMAT_HEX, FORMAT_FLOAT, FORMAT_MIXED);
@@ -0,0 +1,105 @@
+#ifndef MICROBOX_BENCH_H
+#define MICROBOX_BENCH_H
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+// A small stand-in for Google Benchmark, so the host build needs nothing but a compiler. A
+// benchmark is a function with a timed loop:
+//
+//     static void parseLines(BenchState& state)
+//     {
+//         ... setup, not timed ...
+//         while (state.keepRunning()) {
+//             ... one iteration ...
+//         }
+//         state.setBytesProcessed(state.iterations() * len);
+//     }
+//     MICROBOX_BENCHMARK(parseLines, 16, 64);
+//
+// The runner calls it with more and more iterations until the loop took long enough, once for
+// every argument given, and reports the time per iteration and bytes or items per second.
+class BenchState {
+public:
+    BenchState(uint64_t iterations, int64_t argument) : iterationCount(iterations), left(iterations), arg(argument)
+    {
+
+    }
+
+    // true while iterations are left, the clock runs from the first call to the last
+    bool keepRunning()
+    {
+        if (!started) {
+            started = true;
+            start = std::chrono::steady_clock::now();
+        }
+        if (left > 0) {
+            left--;
+            return true;
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        return false;
+    }
+
+    uint64_t iterations() const
+    {
+        return iterationCount;
+    }
+
+    int64_t argument() const
+    {
+        return arg;
+    }
+
+    void setBytesProcessed(uint64_t count)
+    {
+        bytes = count;
+    }
+
+    void setItemsProcessed(uint64_t count)
+    {
+        items = count;
+    }
+
+    double seconds() const
+    {
+        return elapsed.count();
+    }
+
+    uint64_t bytesProcessed() const
+    {
+        return bytes;
+    }
+
+    uint64_t itemsProcessed() const
+    {
+        return items;
+    }
+
+private:
+    uint64_t iterationCount;
+    uint64_t left;
+    int64_t arg;
+    bool started = false;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::duration<double> elapsed = std::chrono::duration<double>::zero();
+    uint64_t bytes = 0;
+    uint64_t items = 0;
+};
+
+typedef void (*bench_function_t)(BenchState& state);
+
+int microBoxAddBenchmark(const char* name, bench_function_t function, std::vector<int64_t> arguments);
+
+// keeps the compiler from optimizing a result away
+template<typename T>
+inline void microBoxKeep(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#define MICROBOX_BENCHMARK(function, ...) \
+    static int function##Registered __attribute__((unused)) = microBoxAddBenchmark(#function, function, { __VA_ARGS__ })
+
+#endif // MICROBOX_BENCH_H
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "port_handlers/microBox_epoll_server.h"
+
+// Load generator for MicroBoxServer:
+//   microbox_loadgen [--clients=<n>] [--depth=<n>] [--seconds=<s>] [--unix] [--quick]
+//
+// The server runs its poll() loop on a thread of its own, the clients are driven from one more
+// thread with an epoll loop, so hundreds of them need no thread each. Every client keeps <depth>
+// commands in flight, a "set" or "get" on a register of its session, and sends the next one as
+// soon as the prompt after an answer arrives. The time from sending a command to its prompt is
+// its latency; commands/s and the latency percentiles are reported over the whole run.
+
+typedef std::chrono::steady_clock Clock;
+
+static const char hostName[] = "bench";
+static const char promptText[] = "bench> ";
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+struct Client {
+    int fd = -1;
+    bool ready = false;             // the first prompt arrived
+    uint8_t matched = 0;            // characters of the prompt seen so far
+    uint32_t sent = 0;
+    std::vector<Clock::time_point> inFlight;
+    size_t oldest = 0;
+};
+
+static void setupSession(MicroBox& microbox)
+{
+    static uint32_t registers[MICROBOX_SERVER_MAX_SESSIONS][16];
+    static int nextSession = 0;
+    uint32_t* values = registers[nextSession++ % MICROBOX_SERVER_MAX_SESSIONS];
+
+    microbox.addCommand("set", [values](char** param, uint8_t parCnt) {
+        if (parCnt == 2)
+            values[atoi(param[0]) % 16] = (uint32_t)strtoul(param[1], nullptr, 10);
+    }, "set <register> <value>\n\r");
+    microbox.addCommand("get", [values, &microbox](char** param, uint8_t parCnt) {
+        if (parCnt == 1)
+            microbox.printf("%lu\n", (unsigned long)values[atoi(param[0]) % 16]);
+    }, "get <register>\n\r");
+}
+
+static int connectClient(bool unixSocket, uint16_t port, const char* path)
+{
+    int fd;
+    int result;
+
+    if (unixSocket) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        result = connect(fd, (struct sockaddr*)&address, sizeof(address));
+    } else {
+        struct sockaddr_in address;
+        int enable = 1;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        result = connect(fd, (struct sockaddr*)&address, sizeof(address));
+    }
+    if (result < 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void sendCommand(Client& client, int index)
+{
+    char line[32];
+    uint32_t n = client.sent++;
+    int len = (n & 1) ? snprintf(line, sizeof(line), "get %u\r", (unsigned)(index + n / 2) % 16)
+                      : snprintf(line, sizeof(line), "set %u %u\r", (unsigned)(index + n / 2) % 16, (unsigned)n);
+
+    client.inFlight.push_back(Clock::now());
+    // the commands are short and the socket buffer is empty enough to take them at once
+    if (send(client.fd, line, len, MSG_NOSIGNAL) != len) {
+        fprintf(stderr, "send failed: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+static double percentile(const std::vector<uint32_t>& sorted, double fraction)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    int clientCount = 64;
+    int depth = 1;
+    double seconds = 2;
+    bool unixSocket = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--clients=", 10) == 0) {
+            clientCount = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+            depth = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--seconds=", 10) == 0) {
+            seconds = atof(argv[i] + 10);
+        } else if (strcmp(argv[i], "--unix") == 0) {
+            unixSocket = true;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            clientCount = 8;
+            seconds = 0.2;
+        } else {
+            fprintf(stderr, "usage: %s [--clients=<n>] [--depth=<n>] [--seconds=<s>] [--unix] [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (clientCount < 1 || clientCount > MICROBOX_SERVER_MAX_SESSIONS || depth < 1) {
+        fprintf(stderr, "between 1 and %d clients and a depth of at least 1\n", MICROBOX_SERVER_MAX_SESSIONS);
+        return 2;
+    }
+
+    // the server, on the first free port of a range or on a socket file in /tmp
+    static MicroBoxServer server;
+    std::string path = "/tmp/microbox_loadgen." + std::to_string(getpid());
+    uint16_t port = 0;
+    bool listening = false;
+    if (unixSocket) {
+        listening = server.beginUnix(path.c_str(), hostName, setupSession);
+    } else {
+        for (port = 47100; port < 47200 && !listening; port++)
+            listening = server.beginTcp(port, hostName, setupSession);
+        port--;
+    }
+    if (!listening) {
+        fprintf(stderr, "the server can't listen\n");
+        return 1;
+    }
+    std::atomic<bool> stop(false);
+    std::thread serverThread([&stop] {
+        while (!stop)
+            server.poll(10);
+    });
+
+    std::vector<Client> clients(clientCount);
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    for (int i = 0; i < clientCount; i++) {
+        clients[i].fd = connectClient(unixSocket, port, path.c_str());
+        if (clients[i].fd < 0) {
+            fprintf(stderr, "client %d can't connect: %s\n", i, strerror(errno));
+            return 1;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = (uint32_t)i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i].fd, &event);
+    }
+
+    std::vector<uint32_t> latencies;
+    latencies.reserve(1 << 20);
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    int waiting = clientCount;
+    uint64_t completed = 0;
+
+    // the clock for the rate starts when all clients have their first prompt
+    while (waiting > 0 || Clock::now() < end) {
+        struct epoll_event events[64];
+        int count = epoll_wait(epollFd, events, 64, 100);
+        for (int e = 0; e < count; e++) {
+            int index = (int)events[e].data.u32;
+            Client& client = clients[index];
+            char buffer[4096];
+            ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                if (received < 0 && (errno == EAGAIN || errno == EINTR))
+                    continue;
+                fprintf(stderr, "client %d lost its connection\n", index);
+                return 1;
+            }
+            for (ssize_t i = 0; i < received; i++) {
+                client.matched = buffer[i] == promptText[client.matched] ? client.matched + 1 : buffer[i] == promptText[0];
+                if (client.matched < sizeof(promptText) - 1)
+                    continue;
+                client.matched = 0;
+                Clock::time_point now = Clock::now();
+                if (!client.ready) {
+                    client.ready = true;
+                    if (--waiting == 0) {
+                        start = now;
+                        end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+                        for (int c = 0; c < clientCount; c++) {
+                            for (int d = 0; d < depth; d++)
+                                sendCommand(clients[c], c);
+                        }
+                    }
+                    continue;
+                }
+                latencies.push_back((uint32_t)std::min<int64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - client.inFlight[client.oldest++]).count(), UINT32_MAX));
+                completed++;
+                if (now < end)
+                    sendCommand(client, index);
+            }
+        }
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (Client& client : clients)
+        close(client.fd);
+    stop = true;
+    serverThread.join();
+    close(epollFd);
+    if (unixSocket)
+        unlink(path.c_str());
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-10s %8s %6s %14s %10s %10s %10s\n", "transport", "clients", "depth", "commands/s", "p50 us", "p99 us", "max us");
+    printf("%-10s %8d %6d %14.0f %10.1f %10.1f %10.1f\n", unixSocket ? "unix" : "tcp", clientCount, depth,
+           completed / elapsed, percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 1.0));
+    return completed > 0 ? 0 : 1;
+}
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "port_handlers/microBox_shm_port_handler.h"
+#include "port_handlers/microBox_epoll_server.h"
+
+// Round trips of one local tool through the three ways a Linux daemon can offer its console:
+//   microbox_roundtrip [--seconds=<s>] [--quick]
+//
+// The console runs on a thread of its own and the tool sends "ping" and waits for the prompt
+// after the answer, one command at a time, over ShmPortHandler, a PTY and TCP on localhost
+// through MicroBoxServer. The table shows round trips/s and the median, 99th percentile and
+// maximum time of one.
+
+typedef std::chrono::steady_clock Clock;
+
+static const char hostName[] = "bench";
+static const char promptText[] = "bench> ";
+static const char command[] = "ping\r";
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static void addPing(MicroBox& microbox)
+{
+    microbox.addCommand("ping", [&microbox](char** param, uint8_t parCnt) {
+        (void)param;
+        (void)parCnt;
+        microbox.printf("pong\n");
+    }, "answers pong\n\r");
+}
+
+// the master side of a PTY, as a daemon would hold it; every read and write is a system call
+class PtyPortHandler : public PortHandler {
+public:
+    explicit PtyPortHandler(int fd) : fd(fd)
+    {
+
+    }
+
+    bool waitForInput(int timeoutMs)
+    {
+        struct pollfd descriptor = {fd, POLLIN, 0};
+        return ::poll(&descriptor, 1, timeoutMs) > 0;
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        return writeBytes(&c, 1);
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        ssize_t written = ::write(fd, buffer, size);
+        return written > 0 ? written : 0;
+    }
+
+    virtual int read() override
+    {
+        uint8_t c;
+        return ::read(fd, &c, 1) == 1 ? c : -1;
+    }
+
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        ssize_t received = ::read(fd, buffer, size);
+        return received > 0 ? received : 0;
+    }
+
+    virtual int available() override
+    {
+        int count = 0;
+        return ioctl(fd, FIONREAD, &count) == 0 ? count : 0;
+    }
+
+private:
+    int fd;
+};
+
+// the tool side of each transport: send() a command, receive() waits for some output
+struct ShmTool {
+    ShmConsoleClient client;
+
+    bool send(const char* data, size_t size)
+    {
+        return client.send(data, size) == size;
+    }
+
+    ssize_t receive(char* buffer, size_t size)
+    {
+        return client.receive(buffer, size, 1000);
+    }
+};
+
+struct FdTool {
+    int fd = -1;
+
+    ~FdTool()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool send(const char* data, size_t size)
+    {
+        return ::write(fd, data, size) == (ssize_t)size;
+    }
+
+    ssize_t receive(char* buffer, size_t size)
+    {
+        return ::read(fd, buffer, size);
+    }
+};
+
+// reads until the next prompt, false if the console went quiet
+template <typename Tool>
+static bool waitForPrompt(Tool& tool)
+{
+    char buffer[256];
+    size_t matched = 0;
+
+    for (;;) {
+        ssize_t received = tool.receive(buffer, sizeof(buffer));
+        if (received <= 0)
+            return false;
+        for (ssize_t i = 0; i < received; i++) {
+            matched = buffer[i] == promptText[matched] ? matched + 1 : buffer[i] == promptText[0];
+            if (matched == sizeof(promptText) - 1)
+                return true;
+        }
+    }
+}
+
+static double percentile(const std::vector<uint32_t>& sorted, double fraction)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+template <typename Tool>
+static bool measure(const char* transport, Tool& tool, double seconds)
+{
+    std::vector<uint32_t> latencies;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    Clock::time_point now = start;
+
+    if (!waitForPrompt(tool)) {
+        fprintf(stderr, "%s: no prompt from the console\n", transport);
+        return false;
+    }
+    latencies.reserve(1 << 20);
+    start = Clock::now();
+    while (now < end) {
+        Clock::time_point sent = Clock::now();
+        if (!tool.send(command, sizeof(command) - 1) || !waitForPrompt(tool)) {
+            fprintf(stderr, "%s: round trip %u failed\n", transport, (unsigned)latencies.size());
+            return false;
+        }
+        now = Clock::now();
+        latencies.push_back((uint32_t)std::min<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent).count(), UINT32_MAX));
+    }
+    double elapsed = std::chrono::duration<double>(now - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-10s %14.0f %10.1f %10.1f %10.1f\n", transport, latencies.size() / elapsed,
+           percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 1.0));
+    return true;
+}
+
+static bool shmRoundTrips(double seconds)
+{
+    std::string name = "/microbox_roundtrip." + std::to_string(getpid());
+    ShmPortHandler port;
+    MicroBox microbox;
+    ShmTool tool;
+    std::atomic<bool> stop(false);
+
+    if (!port.begin(name.c_str()) || !tool.client.open(name.c_str())) {
+        fprintf(stderr, "shm: can't map %s\n", name.c_str());
+        return false;
+    }
+    microbox.begin(hostName, &port);
+    addPing(microbox);
+    std::thread console([&] {
+        while (!stop) {
+            port.waitForInput(10);
+            microbox.commandParser();
+        }
+    });
+    bool ok = measure("shm", tool, seconds);
+    stop = true;
+    console.join();
+    return ok;
+}
+
+static bool ptyRoundTrips(double seconds)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    FdTool tool;
+    struct termios settings;
+
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0
+        || (tool.fd = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "pty: %s\n", strerror(errno));
+        if (master >= 0)
+            close(master);
+        return false;
+    }
+    // the tool sees the console's bytes as they are, without line discipline or echo
+    tcgetattr(tool.fd, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(tool.fd, TCSANOW, &settings);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    PtyPortHandler port(master);
+    MicroBox microbox;
+    std::atomic<bool> stop(false);
+    microbox.begin(hostName, &port);
+    addPing(microbox);
+    std::thread console([&] {
+        while (!stop) {
+            port.waitForInput(10);
+            microbox.commandParser();
+        }
+    });
+    bool ok = measure("pty", tool, seconds);
+    stop = true;
+    console.join();
+    close(master);
+    return ok;
+}
+
+static bool tcpRoundTrips(double seconds)
+{
+    static MicroBoxServer server;
+    FdTool tool;
+    std::atomic<bool> stop(false);
+    struct sockaddr_in address;
+    uint16_t port;
+    bool listening = false;
+    int enable = 1;
+
+    for (port = 47200; port < 47300 && !listening; port++)
+        listening = server.beginTcp(port, hostName, addPing);
+    port--;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    tool.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    setsockopt(tool.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if (!listening || connect(tool.fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        fprintf(stderr, "tcp: can't connect to the server\n");
+        return false;
+    }
+    std::thread console([&stop] {
+        while (!stop)
+            server.poll(10);
+    });
+    bool ok = measure("tcp", tool, seconds);
+    stop = true;
+    console.join();
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--seconds=", 10) == 0) {
+            seconds = atof(argv[i] + 10);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            seconds = 0.1;
+        } else {
+            fprintf(stderr, "usage: %s [--seconds=<s>] [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%-10s %14s %10s %10s %10s\n", "transport", "round trips/s", "p50 us", "p99 us", "max us");
+    bool ok = shmRoundTrips(seconds);
+    ok = ptyRoundTrips(seconds) && ok;
+    ok = tcpRoundTrips(seconds) && ok;
+    return ok ? 0 : 1;
+}
@@ -1,389 +1,2660 @@
 #include "microBox.h"
 
 #include "port_handler.h"
+#include <stdlib.h>
 #include <printf/printf.h>
 #undef printf
 
-void MicroBox::begin(const char* hostName, PortHandler* portHandler, bool showPrompt, bool localEcho)
+#ifdef MICROBOX_ENABLE_TRACE
+#define MICROBOX_TRACE(event, phase, arg)   trace(event, phase, arg)
+#else
+#define MICROBOX_TRACE(event, phase, arg)
+#endif
+
+MicroBoxCore::MicroBoxCore(const MICROBOX_STORAGE& storage)
+    : commandBuffer(storage.commandBuffer), commandBufferSize(storage.commandBufferSize),
+      parameterPointer(storage.parameterPointer), parameterNumber(storage.parameterNumber),
+      historyBufferSize(storage.historyBufferSize), commands(storage.commands),
+      commandNumber(storage.commandNumber), historyBuffer(storage.historyBuffer)
+#ifdef MICROBOX_ENABLE_WATCH
+      , watchLine(storage.watchLine)
+#endif
+{
+
+}
+
+void MicroBoxCore::begin(const char* hostName, PortHandler* portHandler, bool showPrompt, bool localEcho)
 {
     this->portHandler = portHandler;
     this->localEcho = localEcho;
     this->hostName = hostName;
 
-    commands[0].commandName = "help";
-    commands[0].commandDescription = "Prints help.\n\r";
-    commands[0].commandFunction = std::bind(&MicroBox::showHelp, this, std::placeholders::_1, std::placeholders::_2);
+    addGenerator("help", std::bind(&MicroBoxCore::showHelp, this, std::placeholders::_1, std::placeholders::_2,
+        std::placeholders::_3), "Prints help.\n\r");
+#ifdef MICROBOX_ENABLE_STATS
+    addCommand("stats", std::bind(&MicroBoxCore::showStats, this, std::placeholders::_1, std::placeholders::_2),
+        "Prints performance counters, \"stats reset\" clears them.\n\r");
+#endif
+#ifdef MICROBOX_ENABLE_LOG
+    addCommand("log", std::bind(&MicroBoxCore::showLog, this, std::placeholders::_1, std::placeholders::_2),
+        "Prints and clears the pending log entries, \"log raw\" dumps them undecoded.\n\r");
+#endif
+#ifdef MICROBOX_ENABLE_WRITER
+    addCommand("format", std::bind(&MicroBoxCore::showFormat, this, std::placeholders::_1, std::placeholders::_2),
+        "Selects the output of structured commands, \"format text|json|cbor\".\n\r");
+#endif
+#ifdef MICROBOX_ENABLE_WATCH
+    addCommand("watch", std::bind(&MicroBoxCore::startWatch, this, std::placeholders::_1, std::placeholders::_2),
+        "\"watch -n <ms> <cmd>\" runs the command every ms milliseconds and shows what changed, any key stops it.\n\r");
+#endif
+#ifdef MICROBOX_ENABLE_TRACE
+    addCommand("trace", std::bind(&MicroBoxCore::showTrace, this, std::placeholders::_1, std::placeholders::_2),
+        "\"trace dump\" prints the execution trace as Chrome trace JSON, \"trace clear\" clears it.\n\r");
+#endif
 
     if (showPrompt) {
         this->showPrompt();
     }
 }
 
-bool MicroBox::addCommand(const char* commandName, callback_t commandFunction, const char* commandDescription)
+bool MicroBoxCore::addCommand(const char* commandName, callback_t commandFunction, const char* commandDescription, int8_t group)
+{
+    return commandFunction != nullptr && addEntry(commandName, commandFunction, commandDescription, group) >= 0;
+}
+
+// the generator is called for one row at a time, as the output has room, so the result can be
+// of any size and the main loop keeps running in between
+bool MicroBoxCore::addGenerator(const char* commandName, generator_t generator, const char* commandDescription, int8_t group)
+{
+    int8_t index = addEntry(commandName, [this, generator](char** param, uint8_t parCnt) {
+            generatorMore = generator(param, parCnt, generatorRow);
+        }, commandDescription, group);
+
+    if (index < 0)
+        return false;
+    commands[index].isGenerator = true;
+    return true;
+}
+
+// the parameters of a streaming command are handed over as they arrive, whenever the line
+// buffer is full and at the end of the line, so the line can be much longer than the buffer
+bool MicroBoxCore::addStreamCommand(const char* commandName, stream_t stream, const char* commandDescription, int8_t group)
+{
+    int8_t index = addEntry(commandName, [this, stream](char**, uint8_t) {
+            stream(streamChunk, streamLength, streamLast);
+        }, commandDescription, group);
+
+    if (index < 0)
+        return false;
+    commands[index].isStreaming = true;
+    return true;
+}
+
+// commands of a group are typed after its name ("net ip set 10.0.0.1"), returns the group for
+// addCommand() and nested addGroup() calls or -1 if there is no room
+int8_t MicroBoxCore::addGroup(const char* groupName, const char* groupDescription, int8_t parent)
+{
+    return addEntry(groupName, nullptr, groupDescription, parent);
+}
+
+#ifdef __AVR__
+// descriptions given with MICROBOX_FLASH() or F() stay in flash, help reads them from there
+bool MicroBoxCore::addCommand(const char* commandName, callback_t commandFunction, const __FlashStringHelper* commandDescription, int8_t group)
+{
+    if (!addCommand(commandName, commandFunction, reinterpret_cast<const char*>(commandDescription), group))
+        return false;
+    setDescriptionInFlash(group);
+    return true;
+}
+
+bool MicroBoxCore::addGenerator(const char* commandName, generator_t generator, const __FlashStringHelper* commandDescription, int8_t group)
+{
+    if (!addGenerator(commandName, generator, reinterpret_cast<const char*>(commandDescription), group))
+        return false;
+    setDescriptionInFlash(group);
+    return true;
+}
+
+bool MicroBoxCore::addStreamCommand(const char* commandName, stream_t stream, const __FlashStringHelper* commandDescription, int8_t group)
+{
+    if (!addStreamCommand(commandName, stream, reinterpret_cast<const char*>(commandDescription), group))
+        return false;
+    setDescriptionInFlash(group);
+    return true;
+}
+
+int8_t MicroBoxCore::addGroup(const char* groupName, const __FlashStringHelper* groupDescription, int8_t parent)
+{
+    int8_t index = addGroup(groupName, reinterpret_cast<const char*>(groupDescription), parent);
+
+    if (index >= 0)
+        commands[index].descriptionInFlash = true;
+    return index;
+}
+
+// the entry added last is at the end of its group's list
+void MicroBoxCore::setDescriptionInFlash(int8_t group)
+{
+    int8_t index = group >= 0 ? commands[group].firstChild : firstCommand;
+
+    while (commands[index].nextSibling >= 0)
+        index = commands[index].nextSibling;
+    commands[index].descriptionInFlash = true;
+}
+#endif
+
+// registers a whole tree of commands, e.g. all commands of a module in one group
+bool MicroBoxCore::addCommands(const COMMAND_TABLE_ENTRY* table, uint8_t count, int8_t group)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (table[i].children != nullptr) {
+            int8_t subgroup = addGroup(table[i].commandName, table[i].commandDescription, group);
+            if (subgroup < 0 || !addCommands(table[i].children, table[i].childCount, subgroup))
+                return false;
+        } else if (!addCommand(table[i].commandName, table[i].commandFunction, table[i].commandDescription, group)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// commands stay in one array, each level of the tree is a list linked through nextSibling
+int8_t MicroBoxCore::addEntry(const char* commandName, callback_t commandFunction, const char* commandDescription, int8_t group)
 {
     uint8_t index = 0;
+    int8_t* link = &firstCommand;
 
-    while ((commands[index].commandFunction != nullptr) && (index < (MAX_COMMAND_NUMBER - 1))) {
+    if (group >= 0) {
+        if (group >= commandNumber || commands[group].commandName == nullptr || commands[group].commandFunction != nullptr)
+            return -1;
+        link = &commands[group].firstChild;
+    }
+    while ((commands[index].commandName != nullptr) && (index < (commandNumber - 1))) {
         index++;
     }
-    if (index < (MAX_COMMAND_NUMBER - 1)) {
+    if (index < (commandNumber - 1)) {
         commands[index].commandName = commandName;
         commands[index].commandDescription = commandDescription;
         commands[index].commandFunction = commandFunction;
-        index++;
-        commands[index].commandName = nullptr;
-        commands[index].commandDescription = nullptr;
-        commands[index].commandFunction = nullptr;
-        return true;
+        commands[index].isGenerator = false;
+        commands[index].isStreaming = false;
+        commands[index].descriptionInFlash = false;
+        commands[index].firstChild = -1;
+        commands[index].nextSibling = -1;
+#ifdef MICROBOX_ENABLE_CACHE
+        commands[index].isCacheable = false;
+#endif
+        while (*link >= 0)
+            link = &commands[*link].nextSibling;
+        *link = index;
+        commands[index + 1].commandName = nullptr;
+        commands[index + 1].commandDescription = nullptr;
+        commands[index + 1].commandFunction = nullptr;
+        return index;
     }
-    return false;
+    return -1;
+}
+
+// generator output stops for a key after this many rows, "q" or Ctrl-C ends it; 0 disables it
+void MicroBoxCore::setPageLength(uint8_t rows)
+{
+    pageLength = rows;
 }
 
-// from https://playground.arduino.cc/Main/Printf/
-void MicroBox::printf(const char* format, ...)
+// the formatter hands its output over in spans, no intermediate buffer is needed
+void MicroBoxCore::printf(const char* format, ...)
 {
-    char buf[PRINTF_BUFFER_SIZE];
     va_list ap;
+    MICROBOX_TRACE(TRACE_EVENT_PRINTF, 'B', 0);
     va_start(ap, format);
-    vsnprintf(buf, sizeof(buf), format, ap);
-    for (char* p = &buf[0]; *p; p++) // emulate cooked mode for newlines
-    {
-        if (*p == '\n')
-            portHandler->write('\r');
-        portHandler->write(*p);
-    }
+    vspanprintf(&MicroBoxCore::spanOutput, this, format, ap);
     va_end(ap);
+    MICROBOX_TRACE(TRACE_EVENT_PRINTF, 'E', 0);
 }
 
-void MicroBox::showPrompt()
+#if MICROBOX_ASYNC_SLOTS > 0
+// queues a message for output between command line edits, usable outside of command handlers;
+// with MICROBOX_THREAD_SAFE it may be called from any thread, it never blocks
+bool MicroBoxCore::asyncPrintf(const char* format, ...)
 {
-    printf("%s> ", hostName);
+    uint32_t ticket;
+    char* slot = reserveAsyncSlot(ticket);
+    if (slot == nullptr)
+        return false;
+
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(slot, MICROBOX_ASYNC_SLOT_SIZE, format, ap);
+    va_end(ap);
+    commitAsyncSlot(ticket);
+    return true;
 }
 
-uint8_t MicroBox::parseCommandParameters(char* pParam)
+// writes all queued messages with a single redraw of the prompt and the partially typed line
+void MicroBoxCore::flushAsync()
 {
-    uint8_t index = 0;
+    const char* message = peekAsyncSlot();
+    if (message == nullptr)
+        return;
 
-    parameterPointer[index] = pParam;
-    if (pParam != nullptr) {
-        index++;
-        while ((pParam = strchr(pParam, ' ')) != nullptr) {
-            pParam[0] = 0;
-            pParam++;
-            parameterPointer[index++] = pParam;
-        }
+    print("\r\x1B[K");
+    while (message != nullptr) {
+        size_t len = strlen(message);
+        print(message, len);
+        if (len == 0 || message[len - 1] != '\n')
+            print("\n");
+        releaseAsyncSlot();
+        message = peekAsyncSlot();
     }
-    return index;
+    showPrompt();
+    print(commandBuffer, bufferPosition);
 }
 
-void MicroBox::executeCommand()
+#ifdef MICROBOX_THREAD_SAFE
+// bounded multi-producer/single-consumer queue (D. Vyukov): producers claim a ticket with a CAS,
+// fill the slot and publish it through the slot sequence, the consumer never writes the ticket
+char* MicroBoxCore::reserveAsyncSlot(uint32_t& ticket)
 {
-    bool found = false;
-    printf("\n\r");
-    if (bufferPosition > 0) {
-        uint8_t i = 0;
-        uint8_t dstlen;
-        uint8_t srclen;
-        char* pParam;
+    ticket = asyncWriteTicket.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t index = ticket % MICROBOX_ASYNC_SLOTS;
+        uint32_t sequence = asyncSlots[index].sequence.load(std::memory_order_acquire) + index;
+        int32_t diff = (int32_t)(sequence - ticket);
+        if (diff == 0) {
+            if (asyncWriteTicket.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed))
+                return asyncSlots[index].text;
+        } else if (diff < 0) {
+            return nullptr; // full
+        } else {
+            ticket = asyncWriteTicket.load(std::memory_order_relaxed);
+        }
+    }
+}
 
-        commandBuffer[bufferPosition] = 0;
-        pParam = strchr(commandBuffer, ' ');
-        if (pParam != nullptr) {
-            pParam++;
-            srclen = pParam - commandBuffer - 1;
-        } else
-            srclen = bufferPosition;
+void MicroBoxCore::commitAsyncSlot(uint32_t ticket)
+{
+    uint32_t index = ticket % MICROBOX_ASYNC_SLOTS;
+    asyncSlots[index].sequence.store(ticket + 1 - index, std::memory_order_release);
+}
 
-        addToHistory(commandBuffer);
-        historyCursorPosition = -1;
+const char* MicroBoxCore::peekAsyncSlot()
+{
+    uint32_t index = asyncReadTicket % MICROBOX_ASYNC_SLOTS;
+    uint32_t sequence = asyncSlots[index].sequence.load(std::memory_order_acquire) + index;
+    if (sequence != asyncReadTicket + 1)
+        return nullptr;
+    return asyncSlots[index].text;
+}
 
-        while (commands[i].commandName != nullptr && found == false) {
-            dstlen = strlen(commands[i].commandName);
-            if (dstlen == srclen) {
-                if (strncmp(commandBuffer, commands[i].commandName, dstlen) == 0) {
-                    (commands[i].commandFunction)(parameterPointer, parseCommandParameters(pParam));
-                    found = true;
-                    bufferPosition = 0;
-                    showPrompt();
-                }
-            }
-            i++;
-        }
-        if (!found) {
-            bufferPosition = 0;
-            errorCommand();
-            showPrompt();
-        }
-    } else
-        showPrompt();
+void MicroBoxCore::releaseAsyncSlot()
+{
+    uint32_t index = asyncReadTicket % MICROBOX_ASYNC_SLOTS;
+    asyncSlots[index].sequence.store(asyncReadTicket + MICROBOX_ASYNC_SLOTS - index, std::memory_order_release);
+    asyncReadTicket++;
+}
+#else
+char* MicroBoxCore::reserveAsyncSlot(uint32_t& ticket)
+{
+    if (asyncWriteTicket - asyncReadTicket == MICROBOX_ASYNC_SLOTS)
+        return nullptr;
+    ticket = asyncWriteTicket;
+    return asyncSlots[ticket % MICROBOX_ASYNC_SLOTS].text;
 }
 
-void MicroBox::commandParser()
+void MicroBoxCore::commitAsyncSlot(uint32_t ticket)
 {
-    while (portHandler->available()) {
-        uint8_t ch;
-        ch = portHandler->read();
+    asyncWriteTicket = ticket + 1;
+}
 
-        if (handleEscapeSequence(ch))
-            continue;
+const char* MicroBoxCore::peekAsyncSlot()
+{
+    if (asyncReadTicket == asyncWriteTicket)
+        return nullptr;
+    return asyncSlots[asyncReadTicket % MICROBOX_ASYNC_SLOTS].text;
+}
 
-        if (ch == 0x7F || ch == 0x08) {
-            if (bufferPosition > 0) {
-                bufferPosition--;
-                commandBuffer[bufferPosition] = 0;
-                portHandler->write(ch);
-                printf(" \x1B[1D");
-            } else {
-                printf("\a");
-            }
-        } else if (ch == '\t') {
-            handleTab();
-        } else if (ch != '\r' && bufferPosition < (MAX_COMMAND_BUFFER_SIZE - 1)) {
-            if (ch != '\n') {
-                if (localEcho)
-                    portHandler->write(ch);
-                commandBuffer[bufferPosition++] = ch;
-                commandBuffer[bufferPosition] = 0;
-            }
-        } else {
-            executeCommand();
-        }
-    }
+void MicroBoxCore::releaseAsyncSlot()
+{
+    asyncReadTicket++;
 }
+#endif
+#endif
 
-bool MicroBox::handleEscapeSequence(unsigned char ch)
+void MicroBoxCore::spanOutput(const char* span, size_t len, void* arg)
 {
-    bool ret = false;
+    static_cast<MicroBoxCore*>(arg)->print(span, len);
+}
 
-    if (ch == 27) {
-        escapeSequence = ESCAPE_STATE_START;
-        ret = true;
-    } else if (escapeSequence == ESCAPE_STATE_START) {
-        if (ch == 0x5B) {
-            escapeSequence = ESCAPE_STATE_CODE;
-            ret = true;
-        } else
-            escapeSequence = ESCAPE_STATE_NONE;
-    } else if (escapeSequence == ESCAPE_STATE_CODE) {
-        if (ch == 0x41) // Cursor Up
-        {
-            historyUp();
-        } else if (ch == 0x42) // Cursor Down
-        {
-            historyDown();
-        } else if (ch == 0x43) // Cursor Right
-        {
-        } else if (ch == 0x44) // Cursor Left
-        {
-        }
-        escapeSequence = ESCAPE_STATE_NONE;
-        ret = true;
-    }
-    return ret;
+// writes the string as is, without parsing it as a format string
+void MicroBoxCore::print(const char* str)
+{
+    print(str, strlen(str));
 }
 
-uint8_t MicroBox::compareParameter(uint8_t idx1, uint8_t idx2)
+void MicroBoxCore::print(const char* str, size_t len)
 {
-    uint8_t i = 0;
+    const char* end = str + len;
+    size_t outLen = len;
 
-    const char* pName1 = commands[idx1].commandName;
-    const char* pName2 = commands[idx2].commandName;
+#ifdef MICROBOX_ENABLE_WATCH
+    if (watchCapturing) {
+        captureWatch(str, len);
+        return;
+    }
+#endif
+    for (const char* p = str; p < end; p++)
+        outLen += (*p == '\n') ? 1 : 0;
 
-    while (pName1[i] != 0 && pName2[i] != 0) {
-        if (pName1[i] != pName2[i])
-            return i;
-        i++;
+    // the span is either sent completely or dropped, never cut in the middle
+    if (!reserveOutput(outLen)) {
+        droppedBytes += outLen;
+        return;
     }
-    return i;
+
+    // emulate cooked mode for newlines, everything in between goes out in one piece
+    while (str < end) {
+        const char* newline = (const char*)memchr(str, '\n', end - str);
+        if (newline == nullptr) {
+            putChars((const uint8_t*)str, end - str);
+            break;
+        }
+        putChars((const uint8_t*)str, newline - str);
+        putChars((const uint8_t*)"\r\n", 2);
+        str = newline + 1;
+    }
+#if MICROBOX_TX_BUFFER_SIZE > 0
+    blockingOutput = false;
+#endif
 }
 
-int8_t MicroBox::getCommandIndex(char* pCmd, int8_t startIdx)
+// adds text to the output of MICROBOX_PRINTF(), the buffer goes out whenever it is full
+void MicroBoxCore::formatText(FORMAT_OUTPUT& out, const char* text, size_t len)
 {
-    while (commands[startIdx].commandName != nullptr) {
-        if (strncmp(commands[startIdx].commandName, pCmd, strlen(pCmd)) == 0) {
-            return startIdx;
+    while (len > 0) {
+        size_t room = sizeof(out.text) - out.length;
+        if (room == 0) {
+            print(out.text, out.length);
+            out.length = 0;
+            room = sizeof(out.text);
         }
-        startIdx++;
+        size_t chunk = (len < room) ? len : room;
+        memcpy(out.text + out.length, text, chunk);
+        out.length += chunk;
+        text += chunk;
+        len -= chunk;
     }
-    return -1;
 }
 
-void MicroBox::handleTab()
+void MicroBoxCore::formatFill(FORMAT_OUTPUT& out, char c, size_t count)
 {
-    int8_t idx, idx2;
-    char* pParam = nullptr;
-    uint8_t i, len = 0;
-    uint8_t parlen, matchlen, inlen;
-
-    for (i = 0; i < bufferPosition; i++) {
-        if (commandBuffer[i] == ' ')
-            pParam = commandBuffer + i;
-    }
-
-    if (bufferPosition && pParam == nullptr) {
-        pParam = commandBuffer;
-
-        idx = getCommandIndex(pParam);
-        if (idx >= 0) {
-            parlen = strlen(commands[idx].commandName);
-            matchlen = parlen;
-            idx2 = idx;
-            while ((idx2 = getCommandIndex(pParam, idx2 + 1)) != -1) {
-                matchlen = compareParameter(idx, idx2);
-                if (matchlen < parlen)
-                    parlen = matchlen;
-            }
-            inlen = strlen(pParam);
-            if (matchlen > inlen) {
-                len = matchlen - inlen;
-                if ((bufferPosition + len) < MAX_COMMAND_BUFFER_SIZE) {
-                    strncat(commandBuffer, commands[idx].commandName + inlen, len);
-                    bufferPosition += len;
-                } else
-                    len = 0;
-            }
+    while (count > 0) {
+        size_t room = sizeof(out.text) - out.length;
+        if (room == 0) {
+            print(out.text, out.length);
+            out.length = 0;
+            room = sizeof(out.text);
         }
+        size_t chunk = (count < room) ? count : room;
+        memset(out.text + out.length, c, chunk);
+        out.length += chunk;
+        count -= chunk;
     }
-    if (len > 0) {
-        printf("%s", pParam + inlen);
+}
+
+// digits of an integer for MICROBOX_PRINTF(), written backwards from end; zero has none. Every
+// base has a loop of its own, the compiler turns the constant divisions into shifts and
+// multiplications.
+template<typename T>
+static size_t formatDigits(char* end, T magnitude, char conversion)
+{
+    const char* digits = (conversion == 'X') ? "0123456789ABCDEF" : "0123456789abcdef";
+    char* p = end;
+
+    switch (conversion) {
+    case 'x':
+    case 'X':
+        for (; magnitude != 0; magnitude >>= 4)
+            *--p = digits[magnitude & 15];
+        break;
+    case 'o':
+        for (; magnitude != 0; magnitude >>= 3)
+            *--p = (char)('0' + (magnitude & 7));
+        break;
+    case 'b':
+        for (; magnitude != 0; magnitude >>= 1)
+            *--p = (char)('0' + (magnitude & 1));
+        break;
+    default:
+        for (; magnitude != 0; magnitude /= 10)
+            *--p = (char)('0' + magnitude % 10);
+        break;
     }
+    return end - p;
 }
 
-void MicroBox::historyUp()
+void MicroBoxCore::formatInteger(FORMAT_OUTPUT& out, unsigned long magnitude, bool negative, FORMAT_SPEC spec)
 {
-    if (historyBufferSize == 0 || historyWritePosition == 0)
-        return;
+    char digits[sizeof(magnitude) * 8];
+    size_t len = formatDigits(digits + sizeof(digits), magnitude, spec.conversion);
+    formatNumber(out, digits + sizeof(digits) - len, len, magnitude == 0, negative, spec);
+}
 
-    if (historyCursorPosition == -1)
-        historyCursorPosition = historyWritePosition - 2;
+void MicroBoxCore::formatInteger(FORMAT_OUTPUT& out, unsigned long long magnitude, bool negative, FORMAT_SPEC spec)
+{
+    char digits[sizeof(magnitude) * 8];
+    size_t len = formatDigits(digits + sizeof(digits), magnitude, spec.conversion);
+    formatNumber(out, digits + sizeof(digits) - len, len, magnitude == 0, negative, spec);
+}
 
-    while (historyBuffer[historyCursorPosition] != 0 && historyCursorPosition > 0) {
-        historyCursorPosition--;
+// lays the digits out as printf() does: sign or prefix, zeros up to the precision, padding
+void MicroBoxCore::formatNumber(FORMAT_OUTPUT& out, const char* digits, size_t len, bool zero, bool negative, FORMAT_SPEC spec)
+{
+    char prefix[2];
+    size_t prefixLength = 0;
+    size_t zeros = 0;
+    size_t padding = 0;
+
+    if (zero && spec.precision != 0) {
+        digits = "0";
+        len = 1;
     }
-    if (historyCursorPosition > 0)
-        historyCursorPosition++;
+    if (spec.conversion == 'd' || spec.conversion == 'i') {
+        if (negative)
+            prefix[prefixLength++] = '-';
+        else if (spec.flags & FORMAT_FLAG_PLUS)
+            prefix[prefixLength++] = '+';
+        else if (spec.flags & FORMAT_FLAG_SPACE)
+            prefix[prefixLength++] = ' ';
+    } else if ((spec.flags & FORMAT_FLAG_HASH) && !zero && spec.conversion != 'o' && spec.conversion != 'u') {
+        prefix[prefixLength++] = '0';
+        prefix[prefixLength++] = spec.conversion;
+    }
+    if (spec.precision > (int)len)
+        zeros = spec.precision - len;
+    // the alternative octal form only makes sure that the number starts with a zero
+    if ((spec.flags & FORMAT_FLAG_HASH) && spec.conversion == 'o' && zeros == 0 && (len == 0 || digits[0] != '0'))
+        zeros = 1;
 
-    strcpy(commandBuffer, historyBuffer + historyCursorPosition);
-    historyPrintHelper();
-    if (historyCursorPosition > 1)
-        historyCursorPosition -= 2;
+    size_t total = prefixLength + zeros + len;
+    if (spec.width > 0 && (size_t)spec.width > total)
+        padding = spec.width - total;
+    if (!(spec.flags & FORMAT_FLAG_LEFT) && (spec.flags & FORMAT_FLAG_ZERO) && spec.precision < 0) {
+        zeros += padding;
+        padding = 0;
+    }
+    if (!(spec.flags & FORMAT_FLAG_LEFT))
+        formatFill(out, ' ', padding);
+    formatText(out, prefix, prefixLength);
+    formatFill(out, '0', zeros);
+    formatText(out, digits, len);
+    if (spec.flags & FORMAT_FLAG_LEFT)
+        formatFill(out, ' ', padding);
 }
 
-void MicroBox::historyDown()
+void MicroBoxCore::formatString(FORMAT_OUTPUT& out, const char* str, FORMAT_SPEC spec)
 {
-    int pos;
-    if (historyCursorPosition != -1 && historyCursorPosition != historyWritePosition - 2) {
-        pos = historyCursorPosition + 2;
-        pos += strlen(historyBuffer + pos) + 1;
+    size_t len = 0;
+    while ((spec.precision < 0 || len < (size_t)spec.precision) && str[len] != '\0')
+        len++;
+    formatPadded(out, str, len, spec);
+}
 
-        strcpy(commandBuffer, historyBuffer + pos);
-        historyPrintHelper();
-        historyCursorPosition = pos - 2;
-    }
+void MicroBoxCore::formatPadded(FORMAT_OUTPUT& out, const char* text, size_t len, FORMAT_SPEC spec)
+{
+    size_t padding = (spec.width > 0 && (size_t)spec.width > len) ? spec.width - len : 0;
+
+    if (!(spec.flags & FORMAT_FLAG_LEFT))
+        formatFill(out, ' ', padding);
+    formatText(out, text, len);
+    if (spec.flags & FORMAT_FLAG_LEFT)
+        formatFill(out, ' ', padding);
 }
 
-void MicroBox::historyPrintHelper()
+// runs a single conversion of a MICROBOX_PRINTF() format through printf(), straight into the
+// buffer if it fits there
+void MicroBoxCore::formatConversion(FORMAT_OUTPUT& out, const char* conversion, size_t len, ...)
 {
-    uint8_t i;
-    uint8_t len;
+    char text[FORMAT_CONVERSION_SIZE];
+    va_list ap;
 
-    len = strlen(commandBuffer);
-    for (i = 0; i < bufferPosition; i++)
-        printf("\b");
-    printf("%s", commandBuffer);
-    if (len < bufferPosition) {
-        printf("\x1B[K");
+    memcpy(text, conversion, len);
+    text[len] = '\0';
+    va_start(ap, len);
+    size_t room = sizeof(out.text) - out.length;
+    size_t written = (size_t)vsnprintf(out.text + out.length, room, text, ap);
+    va_end(ap);
+    if (written < room) {
+        out.length += written;
+        return;
     }
-    bufferPosition = len;
+    print(out.text, out.length);
+    out.length = 0;
+    va_start(ap, len);
+    vspanprintf(&MicroBoxCore::spanOutput, this, text, ap);
+    va_end(ap);
 }
 
-void MicroBox::addToHistory(char* buf)
+// writes binary data as is, without the newline conversion of print()
+void MicroBoxCore::write(const void* data, size_t len)
 {
-    uint8_t len;
-    int blockStart = 0;
-
-    len = strlen(buf);
-    if (historyBufferSize > 0) {
-        if (historyWritePosition + len + 1 >= historyBufferSize) {
-            while (historyWritePosition + len - blockStart >= historyBufferSize) {
-                blockStart += strlen(historyBuffer + blockStart) + 1;
-            }
-            memmove(historyBuffer, historyBuffer + blockStart, historyWritePosition - blockStart);
-            historyWritePosition -= blockStart;
-        }
-        strcpy(historyBuffer + historyWritePosition, buf);
-        historyWritePosition += len + 1;
-        historyBuffer[historyWritePosition] = 0;
+#ifdef MICROBOX_ENABLE_WATCH
+    if (watchCapturing) {
+        captureWatch(static_cast<const char*>(data), len);
+        return;
+    }
+#endif
+    if (!reserveOutput(len)) {
+        droppedBytes += len;
+        return;
     }
+    putChars(static_cast<const uint8_t*>(data), len);
+#if MICROBOX_TX_BUFFER_SIZE > 0
+    blockingOutput = false;
+#endif
 }
 
-void MicroBox::errorCommand()
+void MicroBoxCore::setTickSource(tick_source_t tickSource)
 {
-    printf("Command not found. Use \"help\" or \"help <cmd>\" for details.\n\r");
+    this->tickSource = tickSource;
 }
 
-// Taken from Stream.cpp
-double MicroBox::parseFloat(char* pBuf)
+void MicroBoxCore::setFlowControl(bool xonXoff)
 {
-    bool isNegative = false;
-    bool isFraction = false;
-    long value = 0;
-    unsigned char c;
-    double fraction = 1.0;
-    uint8_t idx = 0;
+    flowControl = xonXoff;
+    outputPaused = false;
+}
 
-    c = pBuf[idx++];
-    // ignore non numeric leading characters
-    if (c > 127)
-        return 0; // zero returned if timeout
+uint32_t MicroBoxCore::getDroppedBytes() const
+{
+    return droppedBytes;
+}
 
-    do {
-        if (c == '-')
-            isNegative = true;
-        else if (c == '.')
-            isFraction = true;
-        else if (c >= '0' && c <= '9') { // is c a digit?
-            value = value * 10 + c - '0';
-            if (isFraction)
-                fraction *= 0.1;
+bool MicroBoxCore::reserveOutput(size_t len)
+{
+#if MICROBOX_TX_BUFFER_SIZE > 0
+    // XOFF holds what doesn't fit in the queue any more instead of dropping it
+    if (outputPaused && MICROBOX_TX_BUFFER_SIZE - txCount < len)
+        waitForXon();
+    flushOutput();
+    if (len > MICROBOX_TX_BUFFER_SIZE) {
+        // too big to ever fit, send it the blocking way behind what is queued
+        waitForXon();
+        blockingOutput = true;
+        while (txCount > 0) {
+            size_t chunk = txCount;
+            if (chunk > MICROBOX_TX_BUFFER_SIZE - txHead)
+                chunk = MICROBOX_TX_BUFFER_SIZE - txHead;
+            writePort(txBuffer + txHead, chunk);
+            txHead = (txHead + chunk) % MICROBOX_TX_BUFFER_SIZE;
+            txCount -= chunk;
         }
-        c = pBuf[idx++];
-    } while ((c >= '0' && c <= '9') || c == '.');
-
-    if (isNegative)
-        value = -value;
-    if (isFraction)
-        return value * fraction;
-    else
-        return value;
+        return true;
+    }
+    return (MICROBOX_TX_BUFFER_SIZE - txCount) >= len;
+#else
+    (void)len;
+    waitForXon();
+    return true;
+#endif
 }
 
-void MicroBox::showHelp(char** pParam, uint8_t parCnt)
+// XOFF holds the caller until XON, for output that can't be queued. The input read meanwhile
+// stays in the chunk for the shell; only what doesn't fit in it any more is lost
+void MicroBoxCore::waitForXon()
 {
-    if (parCnt == 0) {
-        printf("List of available commands:\n\r\n\r");
-        printCommands();
-        printf("\n\rTo get detailed information about <cmd>, type \"help <cmd>\".\n\r");
-    } else {
-        char* cmdName = pParam[0];
-        uint8_t i = 0;
-        while (commands[i].commandName != nullptr) {
-            if (!strcmp(commands[i].commandName, cmdName)) {
-                printf("%s", commands[i].commandDescription);
-                return;
-            }
-            ++i;
+    while (outputPaused) {
+        // XON may already be waiting behind the character that is being handled
+        uint8_t kept = rxChunkPosition;
+        for (uint8_t i = rxChunkPosition; i < rxChunkLength; i++) {
+            if (rxChunk[i] == XON || rxChunk[i] == XOFF)
+                outputPaused = (rxChunk[i] == XOFF);
+            else
+                rxChunk[kept++] = rxChunk[i];
         }
+        rxChunkLength = kept;
+        if (!outputPaused)
+            break;
 
-        printf("ERROR: Command %s not found.\n\r", cmdName);
+        if (rxChunkPosition > 0) {
+            memmove(rxChunk, rxChunk + rxChunkPosition, rxChunkLength - rxChunkPosition);
+            rxChunkLength -= rxChunkPosition;
+            rxChunkPosition = 0;
+        }
+        if (portHandler->available() <= 0)
+            continue;
+        int ch = portHandler->read();
+        if (ch < 0)
+            continue;
+#ifdef MICROBOX_ENABLE_STATS
+        stats.bytesIn++;
+#endif
+        if (ch == XON || ch == XOFF)
+            outputPaused = (ch == XOFF);
+        else if (rxChunkLength < sizeof(rxChunk))
+            rxChunk[rxChunkLength++] = (uint8_t)ch;
     }
 }
 
-void MicroBox::printCommands()
+void MicroBoxCore::putChar(uint8_t ch)
 {
-    uint8_t index = 0;
-    while (commands[index].commandName != nullptr) {
-        printf("%s\n\r", commands[index].commandName);
-        index++;
+    putChars(&ch, 1);
+}
+
+void MicroBoxCore::putChars(const uint8_t* data, size_t len)
+{
+#ifdef MICROBOX_ENABLE_CACHE
+    if (capturingOutput)
+        cache->append(data, len);
+#endif
+#if MICROBOX_TX_BUFFER_SIZE > 0
+    // while XOFF is in effect everything is queued
+    if (txCount == 0 && !outputPaused) {
+        // nothing queued, hand over directly as much as the port takes
+        int room = blockingOutput ? -1 : portHandler->availableForWrite();
+        size_t chunk = (room < 0 || (size_t)room >= len) ? len : (size_t)room;
+        size_t written = chunk ? writePort(data, chunk) : 0;
+        data += written;
+        len -= written;
     }
-}
\ No newline at end of file
+    while (len > 0) {
+        if (txCount == MICROBOX_TX_BUFFER_SIZE) {
+            droppedBytes += len;
+            return;
+        }
+        size_t tail = (txHead + txCount) % MICROBOX_TX_BUFFER_SIZE;
+        size_t chunk = MICROBOX_TX_BUFFER_SIZE - txCount;
+        if (chunk > MICROBOX_TX_BUFFER_SIZE - tail)
+            chunk = MICROBOX_TX_BUFFER_SIZE - tail;
+        if (chunk > len)
+            chunk = len;
+        memcpy(txBuffer + tail, data, chunk);
+        txCount += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+#else
+    waitForXon();
+    droppedBytes += len - writePort(data, len);
+#endif
+}
+
+size_t MicroBoxCore::writePort(const uint8_t* data, size_t len)
+{
+    MICROBOX_TRACE(TRACE_EVENT_FLUSH, 'B', 0);
+    size_t written = portHandler->writeBytes(data, len);
+    MICROBOX_TRACE(TRACE_EVENT_FLUSH, 'E', written);
+#ifdef MICROBOX_ENABLE_STATS
+    stats.bytesOut += written;
+#endif
+    return written;
+}
+
+// sends as much of the output buffer as the port accepts without blocking
+void MicroBoxCore::flushOutput()
+{
+#if MICROBOX_TX_BUFFER_SIZE > 0
+    if (outputPaused)
+        return;
+
+    int room = portHandler->availableForWrite();
+    while (txCount > 0 && room != 0) {
+        size_t chunk = txCount;
+        if (chunk > MICROBOX_TX_BUFFER_SIZE - txHead)
+            chunk = MICROBOX_TX_BUFFER_SIZE - txHead;
+        if (room > 0 && chunk > (size_t)room)
+            chunk = room;
+        size_t written = writePort(txBuffer + txHead, chunk);
+        txHead = (txHead + written) % MICROBOX_TX_BUFFER_SIZE;
+        txCount -= written;
+        if (written < chunk)
+            break;
+        if (room > 0)
+            room -= written;
+    }
+#endif
+}
+
+void MicroBoxCore::showPrompt()
+{
+    print(hostName);
+    print("> ");
+}
+
+uint8_t MicroBoxCore::parseCommandParameters(char* pParam)
+{
+    uint8_t index = 0;
+
+    parameterPointer[index] = pParam;
+    if (pParam != nullptr) {
+        index++;
+        while (index < parameterNumber && (pParam = strchr(pParam, ' ')) != nullptr) {
+            pParam[0] = 0;
+            pParam++;
+            parameterPointer[index++] = pParam;
+        }
+    }
+    return index;
+}
+
+// walks down the groups of the command line word by word, returns the entry it selects or -1;
+// pParam points to the text after it, nullptr if there is none
+int8_t MicroBoxCore::lookupCommand(char*& pParam)
+{
+    int8_t i;
+    int8_t list = firstCommand;
+    char* word = commandBuffer;
+
+    MICROBOX_TRACE(TRACE_EVENT_LOOKUP, 'B', 0);
+    for (;;) {
+        pParam = strchr(word, ' ');
+        i = findCommand(list, word, pParam != nullptr ? (size_t)(pParam - word) : strlen(word));
+        if (pParam != nullptr)
+            pParam++;
+        if (i < 0 || commands[i].commandFunction != nullptr || pParam == nullptr)
+            break;
+        list = commands[i].firstChild;
+        word = pParam;
+    }
+    MICROBOX_TRACE(TRACE_EVENT_LOOKUP, 'E', 0);
+    return i;
+}
+
+void MicroBoxCore::executeCommand()
+{
+    commandsThisPass++;
+    MICROBOX_TRACE(TRACE_EVENT_LINE, 'i', bufferPosition);
+    print("\n\r");
+    if (streamCommand >= 0) {
+        // the end of a line that was too long for the buffer
+        runStream(streamCommand, commandBuffer, bufferPosition, true);
+        streamCommand = -1;
+        bufferPosition = 0;
+        commandBuffer[0] = 0;
+        showPrompt();
+    } else if (bufferPosition > 0) {
+        buffer_pos_t lineLength = bufferPosition;
+        char* pParam;
+
+        commandBuffer[bufferPosition] = 0;
+        addToHistory(commandBuffer);
+        historyCursorPosition = -1;
+#ifdef MICROBOX_ENABLE_STATS
+        stats.linesExecuted++;
+#endif
+
+        int8_t i = lookupCommand(pParam);
+        bufferPosition = 0;
+
+        if (i >= 0 && commands[i].isStreaming) {
+            runStream(i, pParam != nullptr ? pParam : commandBuffer + lineLength,
+                pParam != nullptr ? (buffer_pos_t)(commandBuffer + lineLength - pParam) : 0, true);
+            showPrompt();
+        } else if (i >= 0 && commands[i].isGenerator) {
+            // the first row too waits until the output has room, runGenerator() produces it
+            generatorCommand = i;
+            generatorParCnt = parseCommandParameters(pParam);
+            generatorRow = 0;
+            pageRows = 0;
+#ifdef MICROBOX_ENABLE_STATS
+            commands[i].stats.calls++;
+#endif
+        } else if (i >= 0 && commands[i].commandFunction != nullptr) {
+#ifdef MICROBOX_ENABLE_CACHE
+            if (serveCached(i, lineLength)) {
+                showPrompt();
+                return;
+            }
+#else
+            (void)lineLength;
+#endif
+            MICROBOX_TRACE(TRACE_EVENT_HANDLER, 'B', i);
+            uint8_t parCnt = parseCommandParameters(pParam);
+#ifdef MICROBOX_ENABLE_STATS
+            uint32_t start = tickSource ? tickSource() : 0;
+            (commands[i].commandFunction)(parameterPointer, parCnt);
+            uint32_t ticks = tickSource ? tickSource() - start : 0;
+            COMMAND_STATS& cmdStats = commands[i].stats;
+            if (cmdStats.calls == 0 || ticks < cmdStats.minTicks)
+                cmdStats.minTicks = ticks;
+            if (ticks > cmdStats.maxTicks)
+                cmdStats.maxTicks = ticks;
+            cmdStats.totalTicks += ticks;
+            cmdStats.calls++;
+#else
+            (commands[i].commandFunction)(parameterPointer, parCnt);
+#endif
+            MICROBOX_TRACE(TRACE_EVENT_HANDLER, 'E', i);
+#ifdef MICROBOX_ENABLE_CACHE
+            if (capturingOutput) {
+                // with output dropped the capture isn't what the command printed
+                if (droppedBytes != captureDroppedBytes)
+                    cache->failEntry();
+                cache->commitEntry(tickSource ? tickSource() : 0, commands[i].cacheGeneration);
+                capturingOutput = false;
+            }
+#endif
+            bool promptLater = false;
+#ifdef MICROBOX_ENABLE_TRANSFER
+            // the prompt follows when the transfer is over
+            promptLater = promptLater || transferMode != TRANSFER_NONE;
+#endif
+#ifdef MICROBOX_ENABLE_WATCH
+            // the prompt follows when the watch is stopped
+            promptLater = promptLater || watchCommand >= 0;
+#endif
+            if (!promptLater)
+                showPrompt();
+        } else {
+            if (i >= 0)
+                printf("%s needs a subcommand, see \"help\" for the list.\n\r", commands[i].commandName);
+            else
+                errorCommand();
+            showPrompt();
+        }
+    } else
+        showPrompt();
+}
+
+// hands the full line buffer to a streaming command, the first time only if the line starts
+// with one; returns false if the line isn't streamed. A word cut by the end of the buffer
+// stays in it for the next chunk
+bool MicroBoxCore::streamLine()
+{
+    buffer_pos_t start = 0;
+
+    commandBuffer[bufferPosition] = 0;
+    if (streamCommand < 0) {
+        char* pParam;
+        int8_t i = lookupCommand(pParam);
+        if (i < 0 || !commands[i].isStreaming || pParam == nullptr)
+            return false;
+        streamCommand = i;
+        start = pParam - commandBuffer;
+        historyCursorPosition = -1;
+#ifdef MICROBOX_ENABLE_STATS
+        stats.linesExecuted++;
+#endif
+    }
+
+    buffer_pos_t end = bufferPosition;
+    while (end > start && commandBuffer[end - 1] != ' ')
+        end--;
+    if (end == start)
+        end = bufferPosition;
+    if (end > start)
+        runStream(streamCommand, commandBuffer + start, end - start, false);
+    memmove(commandBuffer, commandBuffer + end, bufferPosition - end);
+    bufferPosition -= end;
+    commandBuffer[bufferPosition] = 0;
+    return true;
+}
+
+void MicroBoxCore::runStream(int8_t index, char* chunk, buffer_pos_t len, bool last)
+{
+    char saved = chunk[len];
+
+    MICROBOX_TRACE(TRACE_EVENT_HANDLER, 'B', index);
+    chunk[len] = 0;
+    streamChunk = chunk;
+    streamLength = len;
+    streamLast = last;
+    (commands[index].commandFunction)(nullptr, 0);
+    chunk[len] = saved;
+    MICROBOX_TRACE(TRACE_EVENT_HANDLER, 'E', index);
+}
+
+// returns true if input is left over because the budget of this pass is used up, or if a
+// generator command has more rows or a download more frames to send
+bool MicroBoxCore::commandParser()
+{
+    size_t byteBudget = maxBytesPerPass ? maxBytesPerPass : (size_t)-1;
+    bool budgetLeft = true;
+
+    flushOutput();
+    commandsThisPass = 0;
+    if (generatorCommand >= 0)
+        return runGenerator();
+#ifdef MICROBOX_ENABLE_TRANSFER
+    if (transferMode != TRANSFER_NONE)
+        return runTransfer();
+#endif
+#ifdef MICROBOX_ENABLE_WATCH
+    if (watchCommand >= 0)
+        return watchKeys();
+#endif
+#ifdef MICROBOX_ENABLE_STATS
+    // time the left over input of the previous pass had to wait
+    if (inputWaiting && tickSource) {
+        uint32_t wait = tickSource() - inputWaitStart;
+        if (wait > stats.maxInputWait)
+            stats.maxInputWait = wait;
+    }
+    inputWaiting = false;
+#endif
+
+    while (budgetLeft) {
+        if (rxChunkPosition == rxChunkLength) {
+            if (byteBudget == 0 || !fillChunk(byteBudget))
+                break;
+            byteBudget -= rxChunkLength;
+        }
+
+        while (rxChunkPosition < rxChunkLength) {
+            // the input after a generator command waits until it is done
+            if (generatorCommand >= 0 || (maxCommandsPerPass && commandsThisPass >= maxCommandsPerPass)) {
+                budgetLeft = false;
+                break;
+            }
+#ifdef MICROBOX_ENABLE_TRANSFER
+            // from here on the input belongs to the transfer
+            if (transferMode != TRANSFER_NONE) {
+                budgetLeft = false;
+                break;
+            }
+#endif
+#ifdef MICROBOX_ENABLE_WATCH
+            // a key stops the watch
+            if (watchCommand >= 0) {
+                budgetLeft = false;
+                break;
+            }
+#endif
+            // plain text goes into the command line and the echo in one piece
+            size_t run = 0;
+            if (escapeSequence == ESCAPE_STATE_NONE) {
+                size_t room = (commandBufferSize - 1) - bufferPosition;
+                while (run < room && rxChunkPosition + run < rxChunkLength && isPlainChar(rxChunk[rxChunkPosition + run]))
+                    run++;
+            }
+            if (run > 0) {
+                memcpy(commandBuffer + bufferPosition, rxChunk + rxChunkPosition, run);
+                bufferPosition += run;
+                commandBuffer[bufferPosition] = 0;
+                rxChunkPosition += run;
+                // from the command line, waiting for XON may move the chunk
+                if (localEcho)
+                    putChars((const uint8_t*)commandBuffer + bufferPosition - run, run);
+            } else {
+                handleChar(rxChunk[rxChunkPosition++]);
+            }
+        }
+    }
+
+    if (generatorCommand >= 0)
+        return true;
+#ifdef MICROBOX_ENABLE_TRANSFER
+    if (transferMode != TRANSFER_NONE)
+        return runTransfer();
+#endif
+#if MICROBOX_ASYNC_SLOTS > 0
+    flushAsync();
+#endif
+
+    if (pendingInput() == 0)
+        return false;
+#ifdef MICROBOX_ENABLE_STATS
+    stats.budgetExhausted++;
+    inputWaiting = true;
+    inputWaitStart = tickSource ? tickSource() : 0;
+#endif
+    return true;
+}
+
+// space the output can take right now without dropping anything
+size_t MicroBoxCore::outputRoom()
+{
+    if (outputPaused)
+        return 0;
+#if MICROBOX_TX_BUFFER_SIZE > 0
+    return MICROBOX_TX_BUFFER_SIZE - txCount;
+#else
+    int room = portHandler->availableForWrite();
+    return room < 0 ? (size_t)-1 : (size_t)room;
+#endif
+}
+
+// serves the running generator command; of the input only the keys for it are taken: XON/XOFF,
+// Ctrl-C to stop and, at the pager prompt, "q" to stop or any other key to go on. Anything else
+// waits for the shell. Returns true if it should be called again without waiting for input
+bool MicroBoxCore::runGenerator()
+{
+    const size_t rowRoom = MICROBOX_TX_BUFFER_SIZE > 0 && MICROBOX_TX_BUFFER_SIZE < MICROBOX_GENERATOR_ROW_ROOM ?
+        MICROBOX_TX_BUFFER_SIZE : MICROBOX_GENERATOR_ROW_ROOM;
+
+    // typed ahead commands stay in the chunk for the shell, only the keys meant for the
+    // generator are taken
+    while (rxChunkPosition < rxChunkLength || fillChunk(sizeof(rxChunk))) {
+        uint8_t key = rxChunk[rxChunkPosition];
+        if (flowControl && (key == XON || key == XOFF)) {
+            outputPaused = (key == XOFF);
+            flushOutput();
+        } else if (key == 0x03 || (pagerWaiting && key == 'q')) {
+            rxChunkPosition++;
+            stopGenerator();
+            return pendingInput() > 0;
+        } else if (pagerWaiting) {
+            print("\r\x1B[K");
+            pagerWaiting = false;
+            pageRows = 0;
+        } else {
+            break;
+        }
+        rxChunkPosition++;
+    }
+
+    for (uint8_t rows = 0; rows < MICROBOX_GENERATOR_ROWS_PER_PASS && !pagerWaiting; rows++) {
+        if (outputRoom() < rowRoom)
+            return true;
+        generatorMore = false;
+        (commands[generatorCommand].commandFunction)(parameterPointer, generatorParCnt);
+        generatorRow++;
+        if (!generatorMore) {
+            stopGenerator();
+            return pendingInput() > 0;
+        }
+        if (pageLength && ++pageRows >= pageLength) {
+            print("--More--");
+            pagerWaiting = true;
+        }
+    }
+    return !pagerWaiting || pendingInput() > 0;
+}
+
+void MicroBoxCore::stopGenerator()
+{
+    if (pagerWaiting)
+        print("\r\x1B[K");
+    generatorCommand = -1;
+    pagerWaiting = false;
+    showPrompt();
+}
+
+// reads the next chunk of input, at most maxLen bytes; false if nothing was received
+bool MicroBoxCore::fillChunk(size_t maxLen)
+{
+    int available = portHandler->available();
+    size_t len = sizeof(rxChunk);
+
+    if (available <= 0)
+        return false;
+    if ((size_t)available < len)
+        len = available;
+    if (maxLen < len)
+        len = maxLen;
+    MICROBOX_TRACE(TRACE_EVENT_RECEIVE, 'B', 0);
+    rxChunkLength = portHandler->readBytes(rxChunk, len);
+    MICROBOX_TRACE(TRACE_EVENT_RECEIVE, 'E', rxChunkLength);
+    rxChunkPosition = 0;
+#ifdef MICROBOX_ENABLE_STATS
+    stats.bytesIn += rxChunkLength;
+#endif
+    return rxChunkLength > 0;
+}
+
+// limits the work done by one commandParser() call, so one flooded console can't hold up
+// the others served from the same loop; 0 means no limit
+void MicroBoxCore::setBudget(size_t maxBytes, uint8_t maxCommands)
+{
+    maxBytesPerPass = maxBytes;
+    maxCommandsPerPass = maxCommands;
+}
+
+// received bytes waiting to be processed
+size_t MicroBoxCore::pendingInput()
+{
+    int available = portHandler->available();
+    return (rxChunkLength - rxChunkPosition) + (available > 0 ? available : 0);
+}
+
+bool MicroBoxCore::isPlainChar(uint8_t ch)
+{
+    return ch >= 0x20 && ch != 0x7F;
+}
+
+void MicroBoxCore::handleChar(uint8_t ch)
+{
+    if (flowControl && (ch == XON || ch == XOFF)) {
+        outputPaused = (ch == XOFF);
+        flushOutput();
+        return;
+    }
+#ifdef MICROBOX_ENABLE_TRANSFER
+    // CANs left over from an abort and a repeated EOT are not typed into the command line
+    if (ch == TRANSFER_CAN || ch == TRANSFER_EOT)
+        return;
+#endif
+
+    if (handleEscapeSequence(ch))
+        return;
+
+    if (ch == 0x7F || ch == 0x08) {
+        if (bufferPosition > 0) {
+            bufferPosition--;
+            commandBuffer[bufferPosition] = 0;
+            putChar(ch);
+            print(" \x1B[1D");
+        } else {
+            print("\a");
+        }
+    } else if (ch == '\t') {
+        if (streamCommand < 0)
+            handleTab();
+    } else if (ch != '\r' && bufferPosition < (commandBufferSize - 1)) {
+        if (ch != '\n') {
+            if (localEcho)
+                putChar(ch);
+            commandBuffer[bufferPosition++] = ch;
+            commandBuffer[bufferPosition] = 0;
+        }
+    } else if (ch != '\r' && ch != '\n' && streamLine()) {
+        // the buffer went to a streaming command, the character starts the next chunk
+        if (localEcho)
+            putChar(ch);
+        commandBuffer[bufferPosition++] = ch;
+        commandBuffer[bufferPosition] = 0;
+    } else {
+#ifdef MICROBOX_ENABLE_STATS
+        if (ch != '\r' && ch != '\n')
+            stats.parserOverruns++;
+#endif
+        executeCommand();
+    }
+}
+
+bool MicroBoxCore::handleEscapeSequence(unsigned char ch)
+{
+    bool ret = false;
+
+    if (ch == 27) {
+        escapeSequence = ESCAPE_STATE_START;
+        ret = true;
+    } else if (escapeSequence == ESCAPE_STATE_START) {
+        if (ch == 0x5B) {
+            escapeSequence = ESCAPE_STATE_CODE;
+            ret = true;
+        } else
+            escapeSequence = ESCAPE_STATE_NONE;
+    } else if (escapeSequence == ESCAPE_STATE_CODE) {
+        MICROBOX_TRACE(TRACE_EVENT_ESCAPE, 'B', ch);
+        if (streamCommand >= 0) // the history can't replace a streamed line
+        {
+        } else if (ch == 0x41) // Cursor Up
+        {
+            historyUp();
+        } else if (ch == 0x42) // Cursor Down
+        {
+            historyDown();
+        } else if (ch == 0x43) // Cursor Right
+        {
+        } else if (ch == 0x44) // Cursor Left
+        {
+        }
+        MICROBOX_TRACE(TRACE_EVENT_ESCAPE, 'E', ch);
+        escapeSequence = ESCAPE_STATE_NONE;
+        ret = true;
+    }
+    return ret;
+}
+
+buffer_pos_t MicroBoxCore::compareParameter(uint8_t idx1, uint8_t idx2)
+{
+    buffer_pos_t i = 0;
+
+    const char* pName1 = commands[idx1].commandName;
+    const char* pName2 = commands[idx2].commandName;
+
+    while (pName1[i] != 0 && pName2[i] != 0) {
+        if (pName1[i] != pName2[i])
+            return i;
+        i++;
+    }
+    return i;
+}
+
+// the entry in the list starting at 'first' named exactly like the len characters of name
+int8_t MicroBoxCore::findCommand(int8_t first, const char* name, size_t len)
+{
+    for (int8_t i = first; i >= 0; i = commands[i].nextSibling) {
+        if (strncmp(commands[i].commandName, name, len) == 0 && commands[i].commandName[len] == 0)
+            return i;
+    }
+    return -1;
+}
+
+// the first entry from startIdx on in its list that starts with the len characters of pCmd
+int8_t MicroBoxCore::getCommandIndex(const char* pCmd, size_t len, int8_t startIdx)
+{
+    while (startIdx >= 0) {
+        if (strncmp(commands[startIdx].commandName, pCmd, len) == 0) {
+            return startIdx;
+        }
+        startIdx = commands[startIdx].nextSibling;
+    }
+    return -1;
+}
+
+// completes the last word among the commands of the group named by the words before it
+void MicroBoxCore::handleTab()
+{
+    int8_t idx, idx2;
+    int8_t list = firstCommand;
+    char* pParam = commandBuffer;
+    char* space;
+    buffer_pos_t len = 0;
+    buffer_pos_t matchlen, inlen = 0;
+
+    while ((space = strchr(pParam, ' ')) != nullptr) {
+        idx = findCommand(list, pParam, space - pParam);
+        if (idx < 0 || commands[idx].commandFunction != nullptr)
+            return;
+        list = commands[idx].firstChild;
+        pParam = space + 1;
+    }
+
+    inlen = strlen(pParam);
+    idx = getCommandIndex(pParam, inlen, list);
+    if (idx >= 0) {
+        matchlen = strlen(commands[idx].commandName);
+        idx2 = idx;
+        while ((idx2 = getCommandIndex(pParam, inlen, commands[idx2].nextSibling)) != -1) {
+            buffer_pos_t common = compareParameter(idx, idx2);
+            if (common < matchlen)
+                matchlen = common;
+        }
+        if (matchlen > inlen) {
+            len = matchlen - inlen;
+            if ((bufferPosition + len) < commandBufferSize) {
+                strncat(commandBuffer, commands[idx].commandName + inlen, len);
+                bufferPosition += len;
+            } else
+                len = 0;
+        }
+    }
+    if (len > 0) {
+        print(pParam + inlen);
+    }
+}
+
+void MicroBoxCore::historyUp()
+{
+    if (historyBufferSize == 0 || historyWritePosition == 0)
+        return;
+
+    if (historyCursorPosition == -1)
+        historyCursorPosition = historyWritePosition - 2;
+
+    while (historyBuffer[historyCursorPosition] != 0 && historyCursorPosition > 0) {
+        historyCursorPosition--;
+    }
+    if (historyCursorPosition > 0)
+        historyCursorPosition++;
+
+    strcpy(commandBuffer, historyBuffer + historyCursorPosition);
+    historyPrintHelper();
+    if (historyCursorPosition > 1)
+        historyCursorPosition -= 2;
+}
+
+void MicroBoxCore::historyDown()
+{
+    int pos;
+    if (historyCursorPosition != -1 && historyCursorPosition != historyWritePosition - 2) {
+        pos = historyCursorPosition + 2;
+        pos += strlen(historyBuffer + pos) + 1;
+
+        strcpy(commandBuffer, historyBuffer + pos);
+        historyPrintHelper();
+        historyCursorPosition = pos - 2;
+    }
+}
+
+void MicroBoxCore::historyPrintHelper()
+{
+    buffer_pos_t i;
+    buffer_pos_t len;
+
+    len = strlen(commandBuffer);
+    for (i = 0; i < bufferPosition; i++)
+        print("\b");
+    print(commandBuffer);
+    if (len < bufferPosition) {
+        print("\x1B[K");
+    }
+    bufferPosition = len;
+}
+
+void MicroBoxCore::addToHistory(char* buf)
+{
+    buffer_pos_t len;
+    int blockStart = 0;
+
+    len = strlen(buf);
+    // a line that can't fit even in the empty history isn't kept
+    if (historyBufferSize > 0 && len + 2 <= historyBufferSize) {
+        if (historyWritePosition + len + 1 >= historyBufferSize) {
+            // keep room for the entry, its terminator and the end marker behind it
+            while (historyWritePosition + len + 1 - blockStart >= historyBufferSize) {
+                blockStart += strlen(historyBuffer + blockStart) + 1;
+#ifdef MICROBOX_ENABLE_STATS
+                stats.historyEvictions++;
+#endif
+            }
+            memmove(historyBuffer, historyBuffer + blockStart, historyWritePosition - blockStart);
+            historyWritePosition -= blockStart;
+        }
+        strcpy(historyBuffer + historyWritePosition, buf);
+        historyWritePosition += len + 1;
+        historyBuffer[historyWritePosition] = 0;
+    }
+}
+
+void MicroBoxCore::errorCommand()
+{
+    print("Command not found. Use \"help\" or \"help <cmd>\" for details.\n\r");
+}
+
+// Taken from Stream.cpp
+double MicroBoxCore::parseFloat(char* pBuf)
+{
+    bool isNegative = false;
+    bool isFraction = false;
+    long value = 0;
+    unsigned char c;
+    double fraction = 1.0;
+    uint8_t idx = 0;
+
+    c = pBuf[idx++];
+    // ignore non numeric leading characters
+    if (c > 127)
+        return 0; // zero returned if timeout
+
+    do {
+        if (c == '-')
+            isNegative = true;
+        else if (c == '.')
+            isFraction = true;
+        else if (c >= '0' && c <= '9') { // is c a digit?
+            value = value * 10 + c - '0';
+            if (isFraction)
+                fraction *= 0.1;
+        }
+        c = pBuf[idx++];
+    } while ((c >= '0' && c <= '9') || c == '.');
+
+    if (isNegative)
+        value = -value;
+    if (isFraction)
+        return value * fraction;
+    else
+        return value;
+}
+
+// a generator, the command list goes out one row at a time; "help net ip" lists the commands
+// of a group, the description of a command is printed as a whole
+bool MicroBoxCore::showHelp(char** pParam, uint8_t parCnt, uint32_t row)
+{
+    if (row == 0) {
+        int8_t node = -1;
+        helpCursor = firstCommand;
+        for (uint8_t i = 0; i < parCnt; i++) {
+            node = findCommand(helpCursor, pParam[i], strlen(pParam[i]));
+            if (node < 0) {
+                printf("ERROR: Command %s not found.\n\r", pParam[i]);
+                return false;
+            }
+            if (commands[node].commandFunction != nullptr) {
+                printDescription(commands[node]);
+                return false;
+            }
+            helpCursor = commands[node].firstChild;
+        }
+        if (node >= 0 && commands[node].commandDescription != nullptr)
+            printDescription(commands[node]);
+        print("List of available commands:\n\r\n\r");
+        return true;
+    }
+
+    if (helpCursor >= 0) {
+        const COMMAND_ENTRY& entry = commands[helpCursor];
+        printf(entry.commandFunction != nullptr ? "%s\n\r" : "%s ...\n\r", entry.commandName);
+        helpCursor = entry.nextSibling;
+        return true;
+    }
+    print("\n\rTo get detailed information about <cmd>, type \"help <cmd>\".\n\r");
+    return false;
+}
+
+// dictionary for the descriptions compressed by tools/microbox_help_compress.py
+void MicroBoxCore::setHelpDictionary(const char* dictionary)
+{
+    helpDictionary = dictionary;
+    helpDictionaryInFlash = false;
+}
+
+#ifdef __AVR__
+void MicroBoxCore::setHelpDictionary(const __FlashStringHelper* dictionary)
+{
+    helpDictionary = reinterpret_cast<const char*>(dictionary);
+    helpDictionaryInFlash = true;
+}
+#endif
+
+// plain descriptions are printed as they are, compressed ones are expanded piece by piece
+// straight from where they are stored, no RAM is needed for the decoding
+void MicroBoxCore::printDescription(const COMMAND_ENTRY& entry)
+{
+    const char* p = entry.commandDescription;
+    bool inFlash = entry.descriptionInFlash;
+
+    if (storedByte(p, inFlash) != HELP_COMPRESSED) {
+        size_t len = 0;
+        while (storedByte(p + len, inFlash) != 0)
+            len++;
+        printStored(p, len, inFlash);
+        return;
+    }
+    if (helpDictionary == nullptr) {
+        print("ERROR: no help dictionary set.\n\r");
+        return;
+    }
+
+    p++;
+    uint8_t ch = storedByte(p, inFlash);
+    while (ch != 0) {
+        const char* run = p;
+        while (ch != 0 && ch < HELP_FIRST_ENTRY)
+            ch = storedByte(++p, inFlash);
+        if (p > run)
+            printStored(run, p - run, inFlash);
+
+        if (ch == HELP_ESCAPE) {
+            printStored(p + 1, 1, inFlash);
+            p += 2;
+        } else if (ch != 0) {
+            const char* dictionaryEntry = helpDictionary;
+            for (uint8_t index = ch - HELP_FIRST_ENTRY; index > 0; index--)
+                dictionaryEntry += storedByte(dictionaryEntry, helpDictionaryInFlash) + 1;
+            printStored(dictionaryEntry + 1, storedByte(dictionaryEntry, helpDictionaryInFlash), helpDictionaryInFlash);
+            p++;
+        }
+        ch = storedByte(p, inFlash);
+    }
+}
+
+// text from flash goes out through a small buffer on AVR
+void MicroBoxCore::printStored(const char* str, size_t len, bool inFlash)
+{
+#ifdef __AVR__
+    char buffer[16];
+
+    while (inFlash && len > 0) {
+        size_t chunk = len < sizeof(buffer) ? len : sizeof(buffer);
+        memcpy_P(buffer, str, chunk);
+        print(buffer, chunk);
+        str += chunk;
+        len -= chunk;
+    }
+#endif
+    if (!inFlash)
+        print(str, len);
+}
+
+uint8_t MicroBoxCore::storedByte(const char* p, bool inFlash)
+{
+#ifdef __AVR__
+    if (inFlash)
+        return pgm_read_byte(p);
+#else
+    (void)inFlash;
+#endif
+    return (uint8_t)*p;
+}
+
+#ifdef MICROBOX_ENABLE_STATS
+const MICROBOX_STATS& MicroBoxCore::getStats() const
+{
+    return stats;
+}
+
+const COMMAND_STATS* MicroBoxCore::getCommandStats(const char* commandName) const
+{
+    uint8_t i = 0;
+    while (commands[i].commandName != nullptr) {
+        if (commands[i].commandFunction != nullptr && !strcmp(commands[i].commandName, commandName))
+            return &commands[i].stats;
+        ++i;
+    }
+    return nullptr;
+}
+
+void MicroBoxCore::resetStats()
+{
+    uint8_t i = 0;
+    memset(&stats, 0, sizeof(stats));
+    while (commands[i].commandName != nullptr) {
+        memset(&commands[i].stats, 0, sizeof(commands[i].stats));
+        ++i;
+    }
+}
+
+void MicroBoxCore::showStats(char** pParam, uint8_t parCnt)
+{
+    if (parCnt > 0 && !strcmp(pParam[0], "reset")) {
+        resetStats();
+        return;
+    }
+
+    printf("bytes in:           %lu\n", (unsigned long)stats.bytesIn);
+    printf("bytes out:          %lu\n", (unsigned long)stats.bytesOut);
+    printf("bytes dropped:      %lu\n", (unsigned long)droppedBytes);
+    printf("lines executed:     %lu\n", (unsigned long)stats.linesExecuted);
+    printf("history evictions:  %lu\n", (unsigned long)stats.historyEvictions);
+    printf("parser overruns:    %lu\n", (unsigned long)stats.parserOverruns);
+    printf("budget exhausted:   %lu\n", (unsigned long)stats.budgetExhausted);
+    printf("max input wait:     %lu\n\n", (unsigned long)stats.maxInputWait);
+
+    printf("%-16s %8s %10s %10s %10s\n", "command", "calls", "min", "avg", "max");
+    uint8_t i = 0;
+    for (; commands[i].commandName != nullptr; ++i) {
+        const COMMAND_STATS& cmdStats = commands[i].stats;
+        if (commands[i].commandFunction == nullptr)
+            continue;
+        printf("%-16s %8lu %10lu %10lu %10lu\n", commands[i].commandName, (unsigned long)cmdStats.calls,
+            (unsigned long)cmdStats.minTicks, (unsigned long)(cmdStats.calls ? cmdStats.totalTicks / cmdStats.calls : 0),
+            (unsigned long)cmdStats.maxTicks);
+    }
+}
+#endif
+
+#ifdef MICROBOX_ENABLE_LOG
+void MicroBoxCore::addLogEntry(const char* format, const uintptr_t* args, const uint8_t* argTypes, uint8_t argCount)
+{
+    LOG_ENTRY* entry;
+
+    if (logCount == MICROBOX_LOG_ENTRIES) {
+        // overwrite the oldest entry
+        logHead = (logHead + 1) % MICROBOX_LOG_ENTRIES;
+        logCount--;
+        lostLogEntries++;
+    }
+    entry = &logEntries[(logHead + logCount) % MICROBOX_LOG_ENTRIES];
+    entry->format = format;
+    entry->timestamp = tickSource ? tickSource() : 0;
+    entry->argCount = argCount;
+    memcpy(entry->argTypes, argTypes, sizeof(entry->argTypes));
+    memcpy(entry->args, args, sizeof(entry->args));
+    logCount++;
+}
+
+// formats the pending log entries, call it when there is time to spare
+void MicroBoxCore::flushLog()
+{
+    while (logCount > 0) {
+        const LOG_ENTRY& entry = logEntries[logHead];
+        printf("[%10lu] ", (unsigned long)entry.timestamp);
+        printLogEntry(entry);
+        print("\n");
+        logHead = (logHead + 1) % MICROBOX_LOG_ENTRIES;
+        logCount--;
+    }
+}
+
+// the arguments were stored as raw words, so the format is taken apart here and every
+// conversion gets its argument back in the type it expects
+void MicroBoxCore::printLogEntry(const LOG_ENTRY& entry)
+{
+    const char* p = entry.format;
+    uint8_t index = 0;
+
+    while (*p != '\0') {
+        const char* percent = strchr(p, '%');
+        if (percent == nullptr) {
+            print(p);
+            return;
+        }
+        print(p, percent - p);
+        const char* end = percent + 1 + strspn(percent + 1, "-+ #0123456789.hlzjtL");
+        if (*end == '\0') {
+            print(percent);
+            return;
+        }
+        size_t len = end - percent + 1;
+        if (*end == '%') {
+            print("%");
+        } else if (len < FORMAT_CONVERSION_SIZE) {
+            char spec[FORMAT_CONVERSION_SIZE];
+            memcpy(spec, percent, len);
+            spec[len] = '\0';
+            printLogArgument(spec, entry, index++);
+        } else {
+            print(percent, len);
+        }
+        p = end + 1;
+    }
+}
+
+void MicroBoxCore::printLogArgument(const char* spec, const LOG_ENTRY& entry, uint8_t index)
+{
+    size_t len = strlen(spec);
+    char conversion = spec[len - 1];
+    char length = len >= 2 ? spec[len - 2] : '\0';
+    bool doubled = len >= 3 && spec[len - 3] == length;
+    uintptr_t raw = index < entry.argCount ? entry.args[index] : 0;
+    uint8_t type = index < entry.argCount ? entry.argTypes[index] : LOG_ARG_UNSIGNED;
+    long long value = type == LOG_ARG_SIGNED ? (long long)(intptr_t)raw : (long long)raw;
+
+    if (index >= entry.argCount || length == 'L' || strchr(spec, '*') != nullptr) {
+        // nothing stored for it, or nothing that fits it
+        print(spec);
+        return;
+    }
+    switch (conversion) {
+    case 'd':
+    case 'i':
+        if (length == 'l' && doubled)
+            printf(spec, value);
+        else if (length == 'l')
+            printf(spec, (long)value);
+        else if (length == 'z')
+            printf(spec, (size_t)value);
+        else if (length == 'j')
+            printf(spec, (intmax_t)value);
+        else if (length == 't')
+            printf(spec, (ptrdiff_t)value);
+        else
+            printf(spec, (int)value);
+        break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+    case 'b':
+        if (length == 'l' && doubled)
+            printf(spec, (unsigned long long)value);
+        else if (length == 'l')
+            printf(spec, (unsigned long)value);
+        else if (length == 'z')
+            printf(spec, (size_t)value);
+        else if (length == 'j')
+            printf(spec, (uintmax_t)value);
+        else if (length == 't')
+            printf(spec, (ptrdiff_t)value);
+        else
+            printf(spec, (unsigned int)value);
+        break;
+    case 'c':
+        printf(spec, (int)value);
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+        printf(spec, type == LOG_ARG_SIGNED ? (double)value : (double)(unsigned long long)value);
+        break;
+    case 's':
+        if (type == LOG_ARG_POINTER)
+            printf(spec, (const char*)raw);
+        else
+            print(spec);
+        break;
+    case 'p':
+        printf(spec, (void*)raw);
+        break;
+    default:
+        print(spec);
+        break;
+    }
+}
+
+uint32_t MicroBoxCore::getLostLogEntries() const
+{
+    return lostLogEntries;
+}
+
+void MicroBoxCore::showLog(char** pParam, uint8_t parCnt)
+{
+    if (lostLogEntries > 0) {
+        printf("%lu log entries lost\n", (unsigned long)lostLogEntries);
+        lostLogEntries = 0;
+    }
+    if (parCnt == 0) {
+        flushLog();
+        return;
+    }
+    if (strcmp(pParam[0], "raw") != 0) {
+        printf("ERROR: unknown option %s\n", pParam[0]);
+        return;
+    }
+
+    // format address, timestamp and arguments in hex, to be decoded on the host
+    while (logCount > 0) {
+        const LOG_ENTRY& entry = logEntries[logHead];
+        printf("%lx %lx", (unsigned long)(uintptr_t)entry.format, (unsigned long)entry.timestamp);
+        for (uint8_t i = 0; i < entry.argCount; i++)
+            printf(" %lx", (unsigned long)entry.args[i]);
+        print("\n");
+        logHead = (logHead + 1) % MICROBOX_LOG_ENTRIES;
+        logCount--;
+    }
+}
+#endif
+
+#ifdef MICROBOX_ENABLE_TRACE
+// keeps the latest MICROBOX_TRACE_ENTRIES events, the oldest one is overwritten
+void MicroBoxCore::trace(uint8_t event, char phase, size_t arg)
+{
+    TRACE_EVENT* entry;
+
+    if (!tracing)
+        return;
+    if (traceCount == MICROBOX_TRACE_ENTRIES) {
+        traceHead = (traceHead + 1) % MICROBOX_TRACE_ENTRIES;
+        traceCount--;
+    }
+    entry = &traceRing[(traceHead + traceCount) % MICROBOX_TRACE_ENTRIES];
+    entry->timestamp = tickSource ? tickSource() : 0;
+    // counts beyond 32 bits, only possible on a 64 bit host, are shown as 4294967295
+    entry->arg = (unsigned long long)arg > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)arg;
+    entry->event = event;
+    entry->phase = phase;
+    traceCount++;
+}
+
+void MicroBoxCore::clearTrace()
+{
+    traceHead = 0;
+    traceCount = 0;
+}
+
+// prints the events as a Chrome trace JSON array, to be loaded in chrome://tracing or Perfetto;
+// timestamps are relative to the oldest event so that a wrapping tick source doesn't matter
+void MicroBoxCore::dumpTrace()
+{
+    static const char* const eventNames[] = { "receive", "escape", "line", "lookup", "handler", "printf", "flush" };
+
+    // the dump itself is not traced
+    tracing = false;
+    print("[\n");
+    for (uint16_t i = 0; i < traceCount; i++) {
+        const TRACE_EVENT& entry = traceRing[(traceHead + i) % MICROBOX_TRACE_ENTRIES];
+        const char* name = eventNames[entry.event];
+        if (entry.event == TRACE_EVENT_HANDLER && commands[entry.arg].commandName != nullptr)
+            name = commands[entry.arg].commandName;
+        printf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu,\"pid\":1,\"tid\":1", i ? ",\n" : "", name, entry.phase,
+            (unsigned long)((entry.timestamp - traceRing[traceHead].timestamp) / MICROBOX_TRACE_TICKS_PER_US));
+        if (entry.phase == 'i')
+            print(",\"s\":\"t\"");
+        printf(",\"args\":{\"arg\":%lu}}", (unsigned long)entry.arg);
+    }
+    print("\n]\n");
+    tracing = true;
+}
+
+void MicroBoxCore::showTrace(char** pParam, uint8_t parCnt)
+{
+    if (parCnt > 0 && !strcmp(pParam[0], "dump")) {
+        dumpTrace();
+    } else if (parCnt > 0 && !strcmp(pParam[0], "clear")) {
+        clearTrace();
+    } else {
+        print("usage: trace dump|clear\n");
+    }
+}
+#endif
+
+#ifdef MICROBOX_ENABLE_CACHE
+// the cache may be shared with other MicroBox objects, e.g. all sessions of a console server
+void MicroBoxCore::setCache(MicroBoxCache* cache)
+{
+    this->cache = cache;
+}
+
+// the output of the command is reused for the same command line until it is ttlTicks old
+// (0: no age limit, needs the tick source otherwise) or *generation has changed; generator
+// commands can't be cached
+bool MicroBoxCore::setCacheable(const char* commandName, uint32_t ttlTicks, const uint32_t* generation, int8_t group)
+{
+    int8_t index = findCommand(group >= 0 ? commands[group].firstChild : firstCommand, commandName, strlen(commandName));
+
+    if (index < 0 || commands[index].commandFunction == nullptr || commands[index].isGenerator)
+        return false;
+    commands[index].isCacheable = true;
+    commands[index].cacheTtl = ttlTicks;
+    commands[index].cacheGeneration = generation;
+    return true;
+}
+
+// sends the cached output of the command line in one piece, or starts capturing it on a miss
+bool MicroBoxCore::serveCached(int8_t index, buffer_pos_t lineLength)
+{
+    const COMMAND_ENTRY& entry = commands[index];
+
+    if (cache == nullptr || !entry.isCacheable || (entry.cacheTtl && !tickSource))
+        return false;
+#if MICROBOX_MAX_LINE_SIZE > 256
+    if (lineLength > 255)
+        return false;
+#endif
+
+#ifdef MICROBOX_ENABLE_WRITER
+    uint8_t mode = outputMode;
+#else
+    uint8_t mode = 0;
+#endif
+    const CACHE_ENTRY* cached = cache->find(commandBuffer, lineLength, mode, tickSource ? tickSource() : 0, entry.cacheTtl);
+    if (cached != nullptr) {
+        const uint8_t* output = cache->arena + cached->offset + cached->keyLength;
+        if (reserveOutput(cached->length))
+            putChars(output, cached->length);
+        else
+            droppedBytes += cached->length;
+#if MICROBOX_TX_BUFFER_SIZE > 0
+        blockingOutput = false;
+#endif
+        return true;
+    }
+    cache->beginEntry(commandBuffer, lineLength, mode);
+    capturingOutput = true;
+    captureDroppedBytes = droppedBytes;
+    return false;
+}
+
+void MicroBoxCache::invalidate()
+{
+    count = 0;
+    used = 0;
+}
+
+uint32_t MicroBoxCache::getHits() const
+{
+    return hits;
+}
+
+uint32_t MicroBoxCache::getMisses() const
+{
+    return misses;
+}
+
+const CACHE_ENTRY* MicroBoxCache::find(const char* key, uint8_t keyLength, uint8_t outputMode, uint32_t now, uint32_t ttl)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        const CACHE_ENTRY& entry = entries[i];
+        if (entry.keyLength != keyLength || entry.outputMode != outputMode || memcmp(arena + entry.offset, key, keyLength) != 0)
+            continue;
+        if ((ttl && now - entry.timestamp >= ttl) ||
+            (entry.generationSource && *entry.generationSource != entry.generation)) {
+            remove(i);
+            break;
+        }
+        hits++;
+        return &entry;
+    }
+    misses++;
+    return nullptr;
+}
+
+// the command line and the captured output go behind the last entry
+void MicroBoxCache::beginEntry(const char* key, uint8_t keyLength, uint8_t outputMode)
+{
+    captureLength = 0;
+    captureKeyLength = keyLength;
+    captureOutputMode = outputMode;
+    captureFailed = false;
+    if (count == MICROBOX_CACHE_ENTRIES)
+        remove(0);
+    if (!makeRoom(keyLength)) {
+        captureFailed = true;
+        captureLength = 0;
+        return;
+    }
+    memcpy(arena + used, key, keyLength);
+    captureLength = keyLength;
+}
+
+void MicroBoxCache::append(const uint8_t* data, size_t len)
+{
+    if (captureFailed)
+        return;
+    if (!makeRoom(len)) {
+        captureFailed = true;
+        captureLength = 0;
+        return;
+    }
+    memcpy(arena + used + captureLength, data, len);
+    captureLength += len;
+}
+
+// the capture is incomplete, commitEntry() forgets it
+void MicroBoxCache::failEntry()
+{
+    captureFailed = true;
+}
+
+void MicroBoxCache::commitEntry(uint32_t now, const uint32_t* generation)
+{
+    if (!captureFailed) {
+        CACHE_ENTRY& entry = entries[count++];
+        entry.offset = used;
+        entry.length = captureLength - captureKeyLength;
+        entry.keyLength = captureKeyLength;
+        entry.outputMode = captureOutputMode;
+        entry.timestamp = now;
+        entry.generation = generation ? *generation : 0;
+        entry.generationSource = generation;
+        used += captureLength;
+    }
+    captureLength = 0;
+}
+
+// drops the oldest entries until len more bytes fit behind the capture
+bool MicroBoxCache::makeRoom(size_t len)
+{
+    while (arenaSize - used - captureLength < len) {
+        if (count == 0)
+            return false;
+        remove(0);
+    }
+    return true;
+}
+
+// removes an entry and moves everything behind it, including a running capture, down
+void MicroBoxCache::remove(uint8_t index)
+{
+    size_t start = entries[index].offset;
+    size_t size = entries[index].keyLength + entries[index].length;
+
+    memmove(arena + start, arena + start + size, used + captureLength - start - size);
+    used -= size;
+    count--;
+    for (uint8_t i = index; i < count; i++) {
+        entries[i] = entries[i + 1];
+        entries[i].offset -= size;
+    }
+}
+#endif
+
+#ifdef MICROBOX_ENABLE_WRITER
+// how MicroBoxWriter renders the output of this session, OUTPUT_MODE_TEXT, _JSON or _CBOR
+void MicroBoxCore::setOutputMode(uint8_t mode)
+{
+    outputMode = mode;
+}
+
+uint8_t MicroBoxCore::getOutputMode() const
+{
+    return outputMode;
+}
+
+void MicroBoxCore::showFormat(char** pParam, uint8_t parCnt)
+{
+    static const char* const modeNames[] = { "text", "json", "cbor" };
+
+    if (parCnt == 0) {
+        printf("%s\n", modeNames[outputMode]);
+        return;
+    }
+    for (uint8_t i = 0; i < sizeof(modeNames) / sizeof(modeNames[0]); i++) {
+        if (!strcmp(pParam[0], modeNames[i])) {
+            outputMode = i;
+            return;
+        }
+    }
+    printf("ERROR: unknown format %s\n", pParam[0]);
+}
+
+MicroBoxWriter::MicroBoxWriter(MicroBoxCore& microbox) : microbox(microbox), mode(microbox.getOutputMode())
+{
+
+}
+
+void MicroBoxWriter::beginObject()
+{
+    beginContainer(false);
+}
+
+void MicroBoxWriter::endObject()
+{
+    endContainer();
+}
+
+void MicroBoxWriter::beginArray()
+{
+    beginContainer(true);
+}
+
+void MicroBoxWriter::endArray()
+{
+    endContainer();
+}
+
+// text mode prints the key in front of the value, the other modes write it right away
+void MicroBoxWriter::key(const char* name)
+{
+    uint32_t level = depth > 0 ? 1UL << ((depth - 1) % MICROBOX_WRITER_DEPTH) : 0;
+
+    if (mode == OUTPUT_MODE_CBOR) {
+        size_t len = strlen(name);
+        writeCborHead(3, len);
+        microbox.write(name, len);
+    } else if (mode == OUTPUT_MODE_JSON) {
+        if (levelsWithItems & level)
+            microbox.print(",");
+        writeJsonString(name);
+        microbox.print(":");
+    }
+    levelsWithItems |= level;
+    pendingKey = name;
+}
+
+void MicroBoxWriter::value(const char* str)
+{
+    if (mode == OUTPUT_MODE_CBOR) {
+        size_t len = strlen(str);
+        writeCborHead(3, len);
+        microbox.write(str, len);
+    } else {
+        beforeValue(nullptr);
+        if (mode == OUTPUT_MODE_JSON)
+            writeJsonString(str);
+        else
+            microbox.print(str);
+    }
+    afterValue();
+}
+
+void MicroBoxWriter::value(bool flag)
+{
+    uint8_t cbor = flag ? 0xF5 : 0xF4;
+
+    if (mode == OUTPUT_MODE_CBOR)
+        microbox.write(&cbor, 1);
+    else
+        beforeValue(flag ? "true" : "false");
+    afterValue();
+}
+
+void MicroBoxWriter::value(double number)
+{
+    if (mode == OUTPUT_MODE_CBOR) {
+        uint8_t cbor[9] = { 0xFB };
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        for (uint8_t i = 0; i < 8; i++)
+            cbor[8 - i] = (uint8_t)(bits >> (8 * i));
+        microbox.write(cbor, sizeof(cbor));
+    } else if (mode == OUTPUT_MODE_JSON && !(number - number == 0)) {
+        // JSON has no NaN or infinity
+        beforeValue("null");
+    } else {
+        // JSON gets all the digits needed to read back the same double
+        char text[32];
+        snprintf(text, sizeof(text), "%.*g", mode == OUTPUT_MODE_JSON ? 17 : 6, number);
+        beforeValue(text);
+    }
+    afterValue();
+}
+
+void MicroBoxWriter::valueNull()
+{
+    uint8_t cbor = 0xF6;
+
+    if (mode == OUTPUT_MODE_CBOR)
+        microbox.write(&cbor, 1);
+    else
+        beforeValue(mode == OUTPUT_MODE_JSON ? "null" : "-");
+    afterValue();
+}
+
+void MicroBoxWriter::writeUnsigned(unsigned long long number)
+{
+    if (mode == OUTPUT_MODE_CBOR) {
+        writeCborHead(0, number);
+    } else {
+        beforeValue(nullptr);
+        microbox.printf("%llu", number);
+    }
+    afterValue();
+}
+
+void MicroBoxWriter::writeNegative(long long number)
+{
+    if (mode == OUTPUT_MODE_CBOR) {
+        // CBOR stores -1 - n
+        writeCborHead(1, (unsigned long long)(-(number + 1)));
+    } else {
+        beforeValue(nullptr);
+        microbox.printf("%lld", number);
+    }
+    afterValue();
+}
+
+void MicroBoxWriter::beginContainer(bool isArray)
+{
+    uint8_t indent = depth > 1 ? 2 * (depth - 1) : 0;
+
+    if (mode == OUTPUT_MODE_CBOR) {
+        // indefinite length, closed by a break byte in endContainer()
+        uint8_t cbor = isArray ? 0x9F : 0xBF;
+        microbox.write(&cbor, 1);
+    } else if (mode == OUTPUT_MODE_JSON) {
+        beforeValue(isArray ? "[" : "{");
+    } else if (pendingKey != nullptr) {
+        microbox.printf("%*s%s:\n", indent, "", pendingKey);
+    } else if (depth > 0 && (arrayLevels & (1UL << ((depth - 1) % MICROBOX_WRITER_DEPTH)))) {
+        microbox.printf("%*s-\n", indent, "");
+    }
+    pendingKey = nullptr;
+
+    uint32_t level = 1UL << (depth % MICROBOX_WRITER_DEPTH);
+    if (isArray)
+        arrayLevels |= level;
+    else
+        arrayLevels &= ~level;
+    levelsWithItems &= ~level;
+    depth++;
+}
+
+void MicroBoxWriter::endContainer()
+{
+    if (depth == 0)
+        return;
+    depth--;
+    if (mode == OUTPUT_MODE_CBOR) {
+        uint8_t cbor = 0xFF;
+        microbox.write(&cbor, 1);
+    } else if (mode == OUTPUT_MODE_JSON) {
+        microbox.print((arrayLevels & (1UL << (depth % MICROBOX_WRITER_DEPTH))) ? "]" : "}");
+        if (depth == 0)
+            microbox.print("\n");
+    }
+}
+
+// writes what goes in front of a value: the key or the list marker in text mode, the comma
+// between array items in JSON; then the value itself if it is given as text
+void MicroBoxWriter::beforeValue(const char* text)
+{
+    uint8_t indent = depth > 1 ? 2 * (depth - 1) : 0;
+    uint32_t level = depth > 0 ? 1UL << ((depth - 1) % MICROBOX_WRITER_DEPTH) : 0;
+    bool inArray = (arrayLevels & level) != 0;
+
+    if (mode == OUTPUT_MODE_TEXT) {
+        if (pendingKey != nullptr)
+            microbox.printf("%*s%-*s ", indent, "", MICROBOX_WRITER_KEY_WIDTH, pendingKey);
+        else if (inArray)
+            microbox.printf("%*s- ", indent, "");
+    } else if (inArray) {
+        if (levelsWithItems & level)
+            microbox.print(",");
+        levelsWithItems |= level;
+    }
+    if (text != nullptr)
+        microbox.print(text);
+}
+
+void MicroBoxWriter::afterValue()
+{
+    pendingKey = nullptr;
+    if (mode == OUTPUT_MODE_TEXT || (mode == OUTPUT_MODE_JSON && depth == 0))
+        microbox.print("\n");
+}
+
+void MicroBoxWriter::writeJsonString(const char* str)
+{
+    microbox.print("\"");
+    while (*str) {
+        // plain characters go out in runs
+        const char* run = str;
+        while (*str && *str != '"' && *str != '\\' && (uint8_t)*str >= 0x20)
+            str++;
+        if (str > run)
+            microbox.print(run, str - run);
+        if (*str == '"' || *str == '\\') {
+            microbox.printf("\\%c", *str++);
+        } else if (*str) {
+            microbox.printf("\\u%04x", (unsigned)(uint8_t)*str++);
+        }
+    }
+    microbox.print("\"");
+}
+
+void MicroBoxWriter::writeCborHead(uint8_t major, unsigned long long number)
+{
+    uint8_t head[9];
+    uint8_t bytes = number < 24 ? 0 : number <= 0xFF ? 1 : number <= 0xFFFF ? 2 : number <= 0xFFFFFFFFUL ? 4 : 8;
+
+    head[0] = (uint8_t)(major << 5) | (bytes == 0 ? (uint8_t)number : bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27);
+    for (uint8_t i = 0; i < bytes; i++)
+        head[bytes - i] = (uint8_t)(number >> (8 * i));
+    microbox.write(head, bytes + 1);
+}
+#endif
+
+#ifdef MICROBOX_ENABLE_TRANSFER
+// Called from a command handler: the following input is taken as frames, each payload is
+// handed to the sink, and the shell comes back when the sender ends the transfer with an
+// empty frame and EOT. NAK 0 tells the sender to start
+void MicroBoxCore::beginUpload(transfer_sink_t sink)
+{
+    transferSink = sink;
+    transferMode = TRANSFER_UPLOAD;
+    transferNext = 0;
+    inFrame = false;
+    transferClosing = false;
+    nakSent = true;
+    controlType = 0;
+    transferActivity = tickSource ? tickSource() : 0;
+    sendControl(TRANSFER_NAK, 0);
+}
+
+// Called from a command handler: the data from the source is sent in frames, up to
+// MICROBOX_TRANSFER_WINDOW of them before the first is acknowledged. A NAK makes the
+// sender go back to the block it names, the source is asked for the data again
+void MicroBoxCore::beginDownload(transfer_source_t source)
+{
+    transferSource = source;
+    transferMode = TRANSFER_DOWNLOAD;
+    transferBase = 0;
+    transferNext = 0;
+    transferLast = 0xFFFFFFFFUL;
+    controlType = 0;
+    transferActivity = tickSource ? tickSource() : 0;
+}
+
+// a transfer with nothing received from the other side for this many ticks of the tick
+// source is aborted, 0 waits forever
+void MicroBoxCore::setTransferTimeout(uint32_t ticks)
+{
+    transferTimeout = ticks;
+}
+
+// serves the running transfer, returns true if it should be called again without waiting
+// for input
+bool MicroBoxCore::runTransfer()
+{
+    if (transferMode == TRANSFER_UPLOAD)
+        receiveFrames();
+    else
+        receiveControl();
+    if (transferMode != TRANSFER_NONE && transferTimeout > 0 && tickSource &&
+        tickSource() - transferActivity > transferTimeout) {
+        if (!transferClosing)
+            sendControl(TRANSFER_CAN, TRANSFER_CAN);
+        endTransfer(true);
+    }
+    if (transferMode != TRANSFER_DOWNLOAD)
+        return transferMode == TRANSFER_NONE && pendingInput() > 0;
+    sendFrames();
+    return transferNext < transferBase + MICROBOX_TRANSFER_WINDOW && transferNext <= transferLast;
+}
+
+// takes what is left of the received chunk first, then reads straight from the port into
+// the buffer
+size_t MicroBoxCore::takeInput(uint8_t* buffer, size_t len)
+{
+    size_t taken = rxChunkLength - rxChunkPosition;
+
+    if (taken > 0) {
+        if (taken > len)
+            taken = len;
+        memcpy(buffer, rxChunk + rxChunkPosition, taken);
+        rxChunkPosition += taken;
+    } else {
+        if (portHandler->available() <= 0)
+            return 0;
+        taken = portHandler->readBytes(buffer, len);
+#ifdef MICROBOX_ENABLE_STATS
+        stats.bytesIn += taken;
+#endif
+    }
+    if (taken > 0 && tickSource)
+        transferActivity = tickSource();
+    return taken;
+}
+
+// frame[] holds sequence, length, payload and CRC of the frame being received
+void MicroBoxCore::receiveFrames()
+{
+    for (;;) {
+        if (!inFrame) {
+            uint8_t ch;
+            if (takeInput(&ch, 1) == 0)
+                return;
+            // CAN CAN aborts whenever no frame is being received, also while hunting for
+            // the next SOH after an error, so the sender can always get out
+            if (ch == TRANSFER_CAN && controlType == TRANSFER_CAN) {
+                endTransfer(true);
+                return;
+            }
+            if (ch == TRANSFER_EOT && transferClosing) {
+                sendControl(TRANSFER_ACK, TRANSFER_EOT);
+                endTransfer(false);
+                return;
+            }
+            controlType = ch;
+            inFrame = (ch == TRANSFER_SOH);
+            framePosition = 0;
+            continue;
+        }
+
+        size_t frameLength = framePosition < 2 ? 2 : 2 + frame[1] + 2;
+        framePosition += takeInput(frame + framePosition, frameLength - framePosition);
+        if (framePosition < frameLength)
+            return;
+        if (frameLength == 2) {
+#if MICROBOX_TRANSFER_BLOCK < 255
+            // hunt for the next SOH if the length can't be right
+            inFrame = frame[1] <= MICROBOX_TRANSFER_BLOCK;
+#endif
+            continue;
+        }
+        inFrame = false;
+        controlType = 0;
+
+        uint16_t crc = crc16(frame, 2 + frame[1]);
+        bool valid = frame[2 + frame[1]] == (uint8_t)(crc >> 8) && frame[3 + frame[1]] == (uint8_t)crc;
+        if (valid && frame[0] == (uint8_t)transferNext && !transferClosing) {
+            if (!transferSink(frame + 2, frame[1])) {
+                sendControl(TRANSFER_CAN, TRANSFER_CAN);
+                endTransfer(true);
+                return;
+            }
+            sendControl(TRANSFER_ACK, frame[0]);
+            transferNext++;
+            nakSent = false;
+            // the data is complete, the sender says it got the last ACK with EOT
+            transferClosing = (frame[1] == 0);
+        } else if (valid && frame[0] == (uint8_t)(transferNext - 1)) {
+            // our ACK got lost, the sender repeats the frame
+            sendControl(TRANSFER_ACK, frame[0]);
+        } else if (!transferClosing && (!nakSent || (valid && frame[0] == (uint8_t)(transferNext + 1)))) {
+            // go back N: the frames after a missing one are dropped, it is asked for once per
+            // round; the frame after it coming again means the repeated one got lost too
+            sendControl(TRANSFER_NAK, (uint8_t)transferNext);
+            nakSent = true;
+        }
+    }
+}
+
+// ACK n acknowledges all blocks up to n, NAK n asks to send again from block n, CAN CAN aborts
+void MicroBoxCore::receiveControl()
+{
+    uint8_t ch;
+
+    while (takeInput(&ch, 1) > 0) {
+        if (controlType == 0) {
+            if (ch == TRANSFER_ACK || ch == TRANSFER_NAK || ch == TRANSFER_CAN)
+                controlType = ch;
+            continue;
+        }
+        if (controlType == TRANSFER_CAN) {
+            controlType = 0;
+            if (ch == TRANSFER_CAN) {
+                endTransfer(true);
+                return;
+            }
+            continue;
+        }
+
+        uint32_t block = blockOf(ch);
+        if (controlType == TRANSFER_ACK && block < transferNext) {
+            transferBase = block + 1;
+            if (transferBase > transferLast) {
+                controlType = 0;
+                endTransfer(false);
+                return;
+            }
+        } else if (controlType == TRANSFER_NAK && block <= transferNext) {
+            transferBase = block;
+            transferNext = block;
+        }
+        controlType = 0;
+    }
+}
+
+// the block of the window a sequence number belongs to
+uint32_t MicroBoxCore::blockOf(uint8_t sequence)
+{
+    return transferBase + (uint8_t)(sequence - (uint8_t)transferBase);
+}
+
+void MicroBoxCore::sendFrames()
+{
+    const size_t frameRoom = MICROBOX_TX_BUFFER_SIZE > 0 && MICROBOX_TX_BUFFER_SIZE < MICROBOX_TRANSFER_BLOCK + 5 ?
+        MICROBOX_TX_BUFFER_SIZE : MICROBOX_TRANSFER_BLOCK + 5;
+
+    while (transferNext < transferBase + MICROBOX_TRANSFER_WINDOW && transferNext <= transferLast) {
+        if (outputRoom() < frameRoom)
+            return;
+        size_t len = transferSource(transferNext * MICROBOX_TRANSFER_BLOCK, frame + 2, MICROBOX_TRANSFER_BLOCK);
+        if (len == 0)
+            transferLast = transferNext;
+        frame[0] = (uint8_t)transferNext;
+        frame[1] = (uint8_t)len;
+        uint16_t crc = crc16(frame, 2 + len);
+        frame[2 + len] = (uint8_t)(crc >> 8);
+        frame[3 + len] = (uint8_t)crc;
+
+        uint8_t soh = TRANSFER_SOH;
+        write(&soh, 1);
+        write(frame, 4 + len);
+        transferNext++;
+    }
+}
+
+void MicroBoxCore::sendControl(uint8_t type, uint8_t sequence)
+{
+    uint8_t control[2] = { type, sequence };
+
+    write(control, sizeof(control));
+}
+
+void MicroBoxCore::endTransfer(bool abort)
+{
+    // once the last frame was taken the sink has all data, only EOT is missing
+    if (transferClosing)
+        abort = false;
+    if (abort && transferMode == TRANSFER_UPLOAD)
+        transferSink(nullptr, 0);
+    transferClosing = false;
+    transferMode = TRANSFER_NONE;
+    transferSink = nullptr;
+    transferSource = nullptr;
+    print(abort ? "\n\rtransfer aborted\n\r" : "\n\r");
+    showPrompt();
+}
+
+// CRC-16/XMODEM (polynomial 0x1021, initial value 0)
+uint16_t MicroBoxCore::crc16(const uint8_t* data, size_t len)
+{
+    uint16_t crc = 0;
+
+    while (len--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+#endif
+
+#ifdef MICROBOX_ENABLE_WATCH
+// drives the "watch" command, call it from the main loop with a millisecond clock
+void MicroBoxCore::tick(uint32_t nowMs)
+{
+    if (watchCommand < 0 || (!watchDue && nowMs - watchLastRun < watchInterval))
+        return;
+    watchLastRun = nowMs;
+    watchDue = false;
+    runWatch();
+}
+
+// "watch [-n ms] cmd params": the command runs on the next tick() and every ms from then on
+void MicroBoxCore::startWatch(char** pParam, uint8_t parCnt)
+{
+    uint8_t first = 0;
+    size_t length = 0;
+    char* pCmd;
+
+    watchInterval = 1000;
+    if (parCnt >= 2 && !strcmp(pParam[0], "-n")) {
+        watchInterval = strtoul(pParam[1], nullptr, 10);
+        first = 2;
+    }
+    if (first >= parCnt) {
+        printf("ERROR: check \"help watch\" for the usage\n\r");
+        return;
+    }
+    // the parameters are put back together, the buffer is needed to run the command
+    watchLine[0] = 0;
+    for (uint8_t i = first; i < parCnt && length + strlen(pParam[i]) + 1 < commandBufferSize; i++) {
+        if (i > first)
+            watchLine[length++] = ' ';
+        strcpy(watchLine + length, pParam[i]);
+        length += strlen(pParam[i]);
+    }
+    strcpy(commandBuffer, watchLine);
+    int8_t i = lookupCommand(pCmd);
+    commandBuffer[0] = 0;
+    if (i < 0 || commands[i].commandFunction == nullptr || !strcmp(commands[i].commandName, "watch")) {
+        printf("ERROR: can't watch %s\n\r", watchLine);
+        return;
+    }
+
+    watchCommand = i;
+    watchDue = true;
+    watchRedraw = true;
+}
+
+// runs the command with its output going into watchFrame, then sends what differs from the
+// frame before
+void MicroBoxCore::runWatch()
+{
+    char* pParam;
+
+    memset(watchFrame, ' ', sizeof(watchFrame));
+    watchRow = 0;
+    watchColumn = 0;
+    watchEscape = false;
+    watchCapturing = true;
+    printf("Every %lu ms: %s\n\n", (unsigned long)watchInterval, watchLine);
+
+    strcpy(commandBuffer, watchLine);
+    int8_t i = lookupCommand(pParam);
+    if (i >= 0 && commands[i].commandFunction != nullptr) {
+        MICROBOX_TRACE(TRACE_EVENT_HANDLER, 'B', i);
+        if (commands[i].isStreaming) {
+            buffer_pos_t len = pParam != nullptr ? (buffer_pos_t)strlen(pParam) : 0;
+            runStream(i, pParam != nullptr ? pParam : commandBuffer + strlen(commandBuffer), len, true);
+        } else {
+            uint8_t parCnt = parseCommandParameters(pParam);
+            generatorRow = 0;
+            do {
+                // a generator fills the screen row by row
+                generatorMore = false;
+                (commands[i].commandFunction)(parameterPointer, parCnt);
+                generatorRow++;
+            } while (commands[i].isGenerator && generatorMore && watchRow < MICROBOX_WATCH_ROWS);
+        }
+        MICROBOX_TRACE(TRACE_EVENT_HANDLER, 'E', i);
+    }
+    commandBuffer[0] = 0;
+    watchCapturing = false;
+    drawWatch();
+}
+
+// puts output into the frame like a terminal would; escape sequences are dropped, whatever
+// doesn't fit is cut off
+void MicroBoxCore::captureWatch(const char* str, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        char ch = str[i];
+        if (watchEscape) {
+            watchEscape = !(ch >= 0x40 && ch <= 0x7E && ch != '[');
+        } else if (ch == 0x1B) {
+            watchEscape = true;
+        } else if (ch == '\n') {
+            // rows below the screen all count as the one just past it
+            if (watchRow < MICROBOX_WATCH_ROWS)
+                watchRow++;
+            watchColumn = 0;
+        } else if (ch == '\r') {
+            watchColumn = 0;
+        } else if (ch == '\t') {
+            if (watchColumn < 0xF8)
+                watchColumn = (watchColumn | 7) + 1;
+        } else if ((uint8_t)ch >= 0x20 && ch != 0x7F) {
+            if (watchRow < MICROBOX_WATCH_ROWS && watchColumn < MICROBOX_WATCH_COLUMNS)
+                watchFrame[watchRow][watchColumn] = ch;
+            if (watchColumn < 0xFF)
+                watchColumn++;
+        }
+    }
+}
+
+// every changed run of a row goes out as cursor position and text; unchanged cells shorter
+// than a cursor position are sent along instead of jumping over them
+void MicroBoxCore::drawWatch()
+{
+    uint32_t dropped = droppedBytes;
+    bool drawn = false;
+
+    if (watchRedraw) {
+        print("\x1B[H\x1B[2J");
+        memset(watchShown, ' ', sizeof(watchShown));
+        watchRedraw = false;
+    }
+    for (uint8_t row = 0; row < MICROBOX_WATCH_ROWS; row++) {
+        const char* frameRow = watchFrame[row];
+        char* shownRow = watchShown[row];
+        uint8_t column = 0;
+
+        while (column < MICROBOX_WATCH_COLUMNS) {
+            if (frameRow[column] == shownRow[column]) {
+                column++;
+                continue;
+            }
+            uint8_t last = column;
+            for (uint8_t next = column + 1; next < MICROBOX_WATCH_COLUMNS && next - last <= 6; next++) {
+                if (frameRow[next] != shownRow[next])
+                    last = next;
+            }
+            printf("\x1B[%u;%uH", row + 1, column + 1);
+            write(frameRow + column, last - column + 1);
+            memcpy(shownRow + column, frameRow + column, last - column + 1);
+            column = last + 1;
+            drawn = true;
+        }
+    }
+    if (drawn)
+        printf("\x1B[%u;1H", MICROBOX_WATCH_ROWS + 1);
+    // what the terminal shows isn't known any more, start over with the next frame
+    if (droppedBytes != dropped)
+        watchRedraw = true;
+}
+
+// input while watching: XON/XOFF, any other key stops the watch
+bool MicroBoxCore::watchKeys()
+{
+    while (rxChunkPosition < rxChunkLength || fillChunk(sizeof(rxChunk))) {
+        uint8_t key = rxChunk[rxChunkPosition++];
+        if (flowControl && (key == XON || key == XOFF)) {
+            outputPaused = (key == XOFF);
+            flushOutput();
+        } else if (key != '\n') {
+            // the \n of a \r\n line end isn't a key
+            stopWatch();
+            return pendingInput() > 0;
+        }
+    }
+    return false;
+}
+
+void MicroBoxCore::stopWatch()
+{
+    watchCommand = -1;
+    printf("\x1B[%u;1H", MICROBOX_WATCH_ROWS + 1);
+    showPrompt();
+}
+#endif
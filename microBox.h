@@ -4,68 +4,937 @@
 #include <stdint.h>
 #include <string.h>
 #include <functional>
+#include <type_traits>
+#ifdef MICROBOX_THREAD_SAFE
+#include <atomic>
+#endif
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#endif
 
+// define this globally (e.g. -DMICROBOX_INCLUDE_CONFIG_H) to override the sizes below
+// in a microBox_config.h header file
+#ifdef MICROBOX_INCLUDE_CONFIG_H
+#include "microBox_config.h"
+#endif
+
+#include "microBox_format.h"
+
+#ifndef MAX_COMMAND_NUMBER
 #define MAX_COMMAND_NUMBER          20
+#endif
+#ifndef MAX_HISTORY_BUFFER_SIZE
 #define MAX_HISTORY_BUFFER_SIZE     1000
+#endif
 
+#ifndef MAX_COMMAND_BUFFER_SIZE
 #define MAX_COMMAND_BUFFER_SIZE     40
+#endif
+#ifndef MAX_PARAMETER_NUMBER
+#define MAX_PARAMETER_NUMBER        10
+#endif
 
 #define ESCAPE_STATE_NONE           0
 #define ESCAPE_STATE_START          1
 #define ESCAPE_STATE_CODE           2
 
-#define PRINTF_BUFFER_SIZE          256
+// number of received bytes taken from the port at once
+#ifndef MICROBOX_RX_CHUNK_SIZE
+#define MICROBOX_RX_CHUNK_SIZE      32
+#endif
+
+
+// size of the output buffer, 0 writes straight to the port
+#ifndef MICROBOX_TX_BUFFER_SIZE
+#define MICROBOX_TX_BUFFER_SIZE     0
+#endif
+
+// queue for output from outside of command handlers, 0 disables asyncPrintf()
+#ifndef MICROBOX_ASYNC_SLOTS
+#define MICROBOX_ASYNC_SLOTS        0
+#endif
+#ifndef MICROBOX_ASYNC_SLOT_SIZE
+#define MICROBOX_ASYNC_SLOT_SIZE    64
+#endif
+
+// generator commands: a row is produced only when this much output space is free (or the
+// whole output buffer, if it is smaller), at most MICROBOX_GENERATOR_ROWS_PER_PASS per pass
+#ifndef MICROBOX_GENERATOR_ROW_ROOM
+#define MICROBOX_GENERATOR_ROW_ROOM 32
+#endif
+#ifndef MICROBOX_GENERATOR_ROWS_PER_PASS
+#define MICROBOX_GENERATOR_ROWS_PER_PASS    4
+#endif
+
+// deferred log channel, only compiled with MICROBOX_ENABLE_LOG
+#ifndef MICROBOX_LOG_ENTRIES
+#define MICROBOX_LOG_ENTRIES        16
+#endif
+#define MICROBOX_LOG_ARGS           4
+
+// how a stored log argument is turned back into the type its conversion expects
+#define LOG_ARG_SIGNED              0
+#define LOG_ARG_UNSIGNED            1
+#define LOG_ARG_POINTER             2
+
+// execution trace, only compiled with MICROBOX_ENABLE_TRACE; the timestamps come from the tick
+// source and are divided by MICROBOX_TRACE_TICKS_PER_US for the microseconds of the trace viewer
+#ifndef MICROBOX_TRACE_ENTRIES
+#define MICROBOX_TRACE_ENTRIES      128
+#endif
+#ifndef MICROBOX_TRACE_TICKS_PER_US
+#define MICROBOX_TRACE_TICKS_PER_US 1
+#endif
+
+#define TRACE_EVENT_RECEIVE         0
+#define TRACE_EVENT_ESCAPE          1
+#define TRACE_EVENT_LINE            2
+#define TRACE_EVENT_LOOKUP          3
+#define TRACE_EVENT_HANDLER         4
+#define TRACE_EVENT_PRINTF          5
+#define TRACE_EVENT_FLUSH           6
+
+// first byte of a description compressed by tools/microbox_help_compress.py
+#define HELP_COMPRESSED             0x01
+#define HELP_FIRST_ENTRY            0x80
+#define HELP_ESCAPE                 0xFF
+
+// help texts that stay in flash; on AVR flash is a separate address space read with
+// pgm_read_byte(), so they are passed as const __FlashStringHelper* like the F() strings of
+// Arduino. Elsewhere flash is mapped and both macros do nothing
+#ifdef __AVR__
+class __FlashStringHelper;
+#define MICROBOX_PROGMEM            PROGMEM
+#define MICROBOX_FLASH(text)        (reinterpret_cast<const __FlashStringHelper*>(text))
+#else
+#define MICROBOX_PROGMEM
+#define MICROBOX_FLASH(text)        (text)
+#endif
+
+// result cache for query commands, only compiled with MICROBOX_ENABLE_CACHE
+#ifndef MICROBOX_CACHE_ENTRIES
+#define MICROBOX_CACHE_ENTRIES      8
+#endif
+
+// structured output, only compiled with MICROBOX_ENABLE_WRITER
+#define OUTPUT_MODE_TEXT            0
+#define OUTPUT_MODE_JSON            1
+#define OUTPUT_MODE_CBOR            2
+#ifndef MICROBOX_WRITER_DEPTH
+#define MICROBOX_WRITER_DEPTH       8
+#endif
+#ifndef MICROBOX_WRITER_KEY_WIDTH
+#define MICROBOX_WRITER_KEY_WIDTH   16
+#endif
+
+// binary transfers, only compiled with MICROBOX_ENABLE_TRANSFER; a frame is SOH, sequence
+// number, length, up to MICROBOX_TRANSFER_BLOCK bytes and a CRC-16, answered by ACK/NAK + sequence,
+// CAN CAN aborts; after the empty last frame of an upload the sender ends with EOT, answered by ACK EOT
+#ifndef MICROBOX_TRANSFER_BLOCK
+#define MICROBOX_TRANSFER_BLOCK     128
+#endif
+#ifndef MICROBOX_TRANSFER_WINDOW
+#define MICROBOX_TRANSFER_WINDOW    4
+#endif
+#define TRANSFER_NONE               0
+#define TRANSFER_UPLOAD             1
+#define TRANSFER_DOWNLOAD           2
+#define TRANSFER_SOH                0x01
+#define TRANSFER_EOT                0x04
+#define TRANSFER_ACK                0x06
+#define TRANSFER_NAK                0x15
+#define TRANSFER_CAN                0x18
+
+// "watch" command, only compiled with MICROBOX_ENABLE_WATCH; the output of the watched command
+// is kept as a screen of MICROBOX_WATCH_ROWS x MICROBOX_WATCH_COLUMNS characters, twice
+#ifndef MICROBOX_WATCH_ROWS
+#define MICROBOX_WATCH_ROWS         24
+#endif
+#ifndef MICROBOX_WATCH_COLUMNS
+#define MICROBOX_WATCH_COLUMNS      80
+#endif
+
+#define XON                         0x11
+#define XOFF                        0x13
+
+// lets the compiler check printf arguments against the format string
+#if defined(__GNUC__)
+#define MICROBOX_PRINTF_FORMAT(fmt, args) __attribute__((format(__printf__, fmt, args)))
+#else
+#define MICROBOX_PRINTF_FORMAT(fmt, args)
+#endif
+
+static_assert(MAX_COMMAND_NUMBER >= 3 && MAX_COMMAND_NUMBER <= 127, "MAX_COMMAND_NUMBER must be 3..127");
+static_assert(MAX_COMMAND_BUFFER_SIZE >= 2 && MAX_COMMAND_BUFFER_SIZE <= 65535, "MAX_COMMAND_BUFFER_SIZE must be 2..65535");
+static_assert(MAX_HISTORY_BUFFER_SIZE > MAX_COMMAND_BUFFER_SIZE, "history must hold at least one full command line");
+static_assert(MICROBOX_LOG_ENTRIES >= 1 && MICROBOX_LOG_ENTRIES <= 255, "MICROBOX_LOG_ENTRIES must be 1..255");
+static_assert(MICROBOX_TRACE_ENTRIES >= 1 && MICROBOX_TRACE_ENTRIES <= 65535, "MICROBOX_TRACE_ENTRIES must be 1..65535");
+static_assert(MICROBOX_TRACE_TICKS_PER_US >= 1, "MICROBOX_TRACE_TICKS_PER_US must be at least 1");
+static_assert(MICROBOX_ASYNC_SLOTS >= 0 && MICROBOX_ASYNC_SLOTS <= 128 && (MICROBOX_ASYNC_SLOTS & (MICROBOX_ASYNC_SLOTS - 1)) == 0,
+    "MICROBOX_ASYNC_SLOTS must be 0 or a power of two up to 128");
+static_assert(MICROBOX_ASYNC_SLOT_SIZE >= 2, "MICROBOX_ASYNC_SLOT_SIZE is too small");
+#ifdef MICROBOX_THREAD_SAFE
+static_assert(MICROBOX_ASYNC_SLOTS > 0, "MICROBOX_THREAD_SAFE needs MICROBOX_ASYNC_SLOTS");
+#endif
+static_assert(MICROBOX_GENERATOR_ROWS_PER_PASS >= 1 && MICROBOX_GENERATOR_ROWS_PER_PASS <= 255,
+    "MICROBOX_GENERATOR_ROWS_PER_PASS must be 1..255");
+static_assert(MICROBOX_CACHE_ENTRIES >= 1 && MICROBOX_CACHE_ENTRIES <= 255, "MICROBOX_CACHE_ENTRIES must be 1..255");
+static_assert(MICROBOX_WRITER_DEPTH >= 1 && MICROBOX_WRITER_DEPTH <= 32, "MICROBOX_WRITER_DEPTH must be 1..32");
+static_assert(MICROBOX_TRANSFER_BLOCK >= 1 && MICROBOX_TRANSFER_BLOCK <= 255, "MICROBOX_TRANSFER_BLOCK must be 1..255");
+static_assert(MICROBOX_TRANSFER_WINDOW >= 1 && MICROBOX_TRANSFER_WINDOW <= 127, "MICROBOX_TRANSFER_WINDOW must be 1..127");
+static_assert(MICROBOX_WATCH_ROWS >= 2 && MICROBOX_WATCH_ROWS <= 255, "MICROBOX_WATCH_ROWS must be 2..255");
+static_assert(MICROBOX_WATCH_COLUMNS >= 16 && MICROBOX_WATCH_COLUMNS <= 255, "MICROBOX_WATCH_COLUMNS must be 16..255");
+static_assert(MICROBOX_RX_CHUNK_SIZE >= 1 && MICROBOX_RX_CHUNK_SIZE <= 255, "MICROBOX_RX_CHUNK_SIZE must be 1..255");
+static_assert(MAX_PARAMETER_NUMBER >= 1 && MAX_PARAMETER_NUMBER <= 255, "MAX_PARAMETER_NUMBER must be 1..255");
+
+// the longest command line of any console in the program, consoles sized with MicroBoxSized<>
+// may have lines up to this; it only picks the width of the line positions
+#ifndef MICROBOX_MAX_LINE_SIZE
+#define MICROBOX_MAX_LINE_SIZE      MAX_COMMAND_BUFFER_SIZE
+#endif
+
+static_assert(MICROBOX_MAX_LINE_SIZE >= MAX_COMMAND_BUFFER_SIZE && MICROBOX_MAX_LINE_SIZE <= 65535,
+    "MICROBOX_MAX_LINE_SIZE must be MAX_COMMAND_BUFFER_SIZE..65535");
+
+// position in the command line, as small as MICROBOX_MAX_LINE_SIZE allows
+#if MICROBOX_MAX_LINE_SIZE > 255
+typedef uint16_t buffer_pos_t;
+#else
+typedef uint8_t buffer_pos_t;
+#endif
 
 typedef std::function<void (char** param, uint8_t parCnt)> callback_t;
+// prints the given row of the result, returns true if more rows follow
+typedef std::function<bool (char** param, uint8_t parCnt, uint32_t row)> generator_t;
+
+// gets the parameters of a streaming command piece by piece, chunk is zero terminated and ends
+// at a word boundary unless a word is longer than the line buffer; last is set for the final one
+typedef std::function<void (const char* chunk, size_t len, bool last)> stream_t;
+
+// receives the data of an upload, len is 0 at the end and data nullptr if the transfer was
+// aborted; returning false aborts it
+typedef std::function<bool (const uint8_t* data, size_t len)> transfer_sink_t;
+// fills buffer with the download data at offset, less than size bytes only at the end
+typedef std::function<size_t (uint32_t offset, uint8_t* buffer, size_t size)> transfer_source_t;
+
+// user supplied time base (cycle counter, micros(), ...)
+typedef uint32_t (*tick_source_t)();
 
 class PortHandler;
 
+#ifdef MICROBOX_ENABLE_STATS
+typedef struct
+{
+    uint32_t calls;
+    uint32_t minTicks;
+    uint32_t maxTicks;
+    uint32_t totalTicks;
+} COMMAND_STATS;
+
+typedef struct
+{
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    uint32_t linesExecuted;
+    uint32_t historyEvictions;
+    uint32_t parserOverruns;
+    uint32_t budgetExhausted;
+    uint32_t maxInputWait;
+} MICROBOX_STATS;
+#endif
+
+#ifdef MICROBOX_ENABLE_LOG
+typedef struct
+{
+    const char* format;
+    uint32_t timestamp;
+    uint8_t argCount;
+    uint8_t argTypes[MICROBOX_LOG_ARGS];
+    uintptr_t args[MICROBOX_LOG_ARGS];
+} LOG_ENTRY;
+#endif
+
+#ifdef MICROBOX_ENABLE_TRACE
+typedef struct
+{
+    uint32_t timestamp;
+    uint32_t arg;           // byte count or command index
+    uint8_t event;
+    char phase;             // 'B' begin, 'E' end or 'i' instant, as in the Chrome trace format
+} TRACE_EVENT;
+#endif
+
+#if MICROBOX_ASYNC_SLOTS > 0
+typedef struct
+{
+#ifdef MICROBOX_THREAD_SAFE
+    // ticket of the message in this slot, stored relative to the slot index so that 0 means free
+    std::atomic<uint32_t> sequence;
+#endif
+    char text[MICROBOX_ASYNC_SLOT_SIZE];
+} ASYNC_SLOT;
+#endif
+
 typedef struct
 {
     const char* commandName;
     const char* commandDescription;
-    callback_t commandFunction;
+    callback_t commandFunction;     // nullptr for a group
+    bool isGenerator;
+    bool isStreaming;
+    bool descriptionInFlash;        // read with pgm_read_byte() on AVR
+    int8_t firstChild;
+    int8_t nextSibling;
+#ifdef MICROBOX_ENABLE_CACHE
+    bool isCacheable;
+    uint32_t cacheTtl;
+    const uint32_t* cacheGeneration;
+#endif
+#ifdef MICROBOX_ENABLE_STATS
+    COMMAND_STATS stats;
+#endif
 } COMMAND_ENTRY;
 
-class MicroBox {
+// a command, or a group of commands if children is set, for registering whole trees at once
+typedef struct COMMAND_TABLE_ENTRY
+{
+    const char* commandName;
+    callback_t commandFunction;
+    const char* commandDescription;
+    const struct COMMAND_TABLE_ENTRY* children;
+    uint8_t childCount;
+} COMMAND_TABLE_ENTRY;
+
+#ifdef MICROBOX_ENABLE_CACHE
+typedef struct
+{
+    size_t offset;                      // of the command line in the arena, the output follows it
+    size_t length;                      // of the output
+    uint8_t keyLength;
+    uint8_t outputMode;                 // results rendered for other output modes don't match
+    uint32_t timestamp;
+    uint32_t generation;
+    const uint32_t* generationSource;
+} CACHE_ENTRY;
+
+// Rendered output of cacheable commands, keyed by the command line. One cache can be shared by
+// several MicroBox sessions; the arena is used first in, first out.
+class MicroBoxCache {
+public:
+    MicroBoxCache(uint8_t* arena, size_t size) : arena(arena), arenaSize(size)
+    {
+
+    }
+
+    void invalidate();
+    uint32_t getHits() const;
+    uint32_t getMisses() const;
+
+private:
+    friend class MicroBoxCore;
+    const CACHE_ENTRY* find(const char* key, uint8_t keyLength, uint8_t outputMode, uint32_t now, uint32_t ttl);
+    void beginEntry(const char* key, uint8_t keyLength, uint8_t outputMode);
+    void failEntry();
+    void append(const uint8_t* data, size_t len);
+    void commitEntry(uint32_t now, const uint32_t* generation);
+    bool makeRoom(size_t len);
+    void remove(uint8_t index);
+
+private:
+    uint8_t* arena;
+    size_t arenaSize;
+    size_t used =                                   0;
+    CACHE_ENTRY entries[MICROBOX_CACHE_ENTRIES] =   {};
+    uint8_t count =                                 0;
+    size_t captureLength =                          0;
+    uint8_t captureKeyLength =                      0;
+    uint8_t captureOutputMode =                     0;
+    bool captureFailed =                            false;
+    uint32_t hits =                                 0;
+    uint32_t misses =                               0;
+};
+#endif
+
+// Buffers of one console, owned by whoever creates it; MicroBoxSized<Config> below has them
+// as arrays of its own. The history may be empty (size 0), it then keeps nothing.
+typedef struct
+{
+    char* commandBuffer;
+    uint16_t commandBufferSize;
+    char* historyBuffer;
+    int historyBufferSize;
+    COMMAND_ENTRY* commands;
+    uint8_t commandNumber;
+    char** parameterPointer;
+    uint8_t parameterNumber;
+#ifdef MICROBOX_ENABLE_WATCH
+    char* watchLine;
+#endif
+} MICROBOX_STORAGE;
+
+// The console itself, working on the buffers it is given. Use MicroBox for the sizes set with
+// the MAX_* defines or MicroBoxSized<Config> for sizes of its own; functions that take any
+// console take a MicroBoxCore&.
+class MicroBoxCore {
 public:
+    explicit MicroBoxCore(const MICROBOX_STORAGE& storage);
+    MicroBoxCore(const MicroBoxCore&) = delete;
+    MicroBoxCore& operator=(const MicroBoxCore&) = delete;
+
     void begin(const char* hostName, PortHandler* portHandler, bool showPrompt = true, bool localEcho = true);
-    void commandParser();
-    bool addCommand(const char* commandName, callback_t commandFunction, const char* commandDescription);
-    void printf(const char* format, ...);
+    bool commandParser();
+    void setBudget(size_t maxBytes, uint8_t maxCommands);
+    size_t pendingInput();
+    bool addCommand(const char* commandName, callback_t commandFunction, const char* commandDescription, int8_t group = -1);
+    bool addGenerator(const char* commandName, generator_t generator, const char* commandDescription, int8_t group = -1);
+    bool addStreamCommand(const char* commandName, stream_t stream, const char* commandDescription, int8_t group = -1);
+    int8_t addGroup(const char* groupName, const char* groupDescription, int8_t parent = -1);
+#ifdef __AVR__
+    bool addCommand(const char* commandName, callback_t commandFunction, const __FlashStringHelper* commandDescription, int8_t group = -1);
+    bool addGenerator(const char* commandName, generator_t generator, const __FlashStringHelper* commandDescription, int8_t group = -1);
+    bool addStreamCommand(const char* commandName, stream_t stream, const __FlashStringHelper* commandDescription, int8_t group = -1);
+    int8_t addGroup(const char* groupName, const __FlashStringHelper* groupDescription, int8_t parent = -1);
+    void setHelpDictionary(const __FlashStringHelper* dictionary);
+#endif
+    bool addCommands(const COMMAND_TABLE_ENTRY* table, uint8_t count, int8_t group = -1);
+#ifdef MICROBOX_ENABLE_WATCH
+    void tick(uint32_t nowMs);
+#endif
+#ifdef MICROBOX_ENABLE_TRANSFER
+    void beginUpload(transfer_sink_t sink);
+    void beginDownload(transfer_source_t source);
+    void setTransferTimeout(uint32_t ticks);
+#endif
+#ifdef MICROBOX_ENABLE_WRITER
+    void setOutputMode(uint8_t mode);
+    uint8_t getOutputMode() const;
+#endif
+#ifdef MICROBOX_ENABLE_CACHE
+    void setCache(MicroBoxCache* cache);
+    bool setCacheable(const char* commandName, uint32_t ttlTicks, const uint32_t* generation = nullptr, int8_t group = -1);
+#endif
+    void setPageLength(uint8_t rows);
+    void printf(const char* format, ...) MICROBOX_PRINTF_FORMAT(2, 3);
+    // called by MICROBOX_PRINTF(), Format carries the format string as a constexpr text()
+    template<typename Format, typename... Args>
+    void printFormat(Format format, Args... args)
+    {
+        FORMAT_OUTPUT out;
+        (void)format;
+        out.length = 0;
+        printFormatFrom<Format, 0>(out, args...);
+    }
+    void print(const char* str);
+    void print(const char* str, size_t len);
+    void write(const void* data, size_t len);
     void showPrompt();
+    void setFlowControl(bool xonXoff);
+    uint32_t getDroppedBytes() const;
+    void setTickSource(tick_source_t tickSource);
+    void setHelpDictionary(const char* dictionary);
+#if MICROBOX_ASYNC_SLOTS > 0
+    bool asyncPrintf(const char* format, ...) MICROBOX_PRINTF_FORMAT(2, 3);
+#endif
+#ifdef MICROBOX_ENABLE_STATS
+    const MICROBOX_STATS& getStats() const;
+    const COMMAND_STATS* getCommandStats(const char* commandName) const;
+    void resetStats();
+#endif
+#ifdef MICROBOX_ENABLE_LOG
+    // stores the format and the raw arguments only, the text is formatted later by flushLog()
+    // or the "log" command; the format and %s arguments must stay valid until then
+    template<typename... Args>
+    void log(const char* format, Args... args)
+    {
+        static_assert(sizeof...(Args) <= MICROBOX_LOG_ARGS, "too many log arguments");
+        const uintptr_t values[MICROBOX_LOG_ARGS + 1] = { toLogArg(args)... };
+        const uint8_t types[MICROBOX_LOG_ARGS + 1] = { logArgType<Args>()... };
+        addLogEntry(format, values, types, sizeof...(Args));
+    }
+    void flushLog();
+    uint32_t getLostLogEntries() const;
+#endif
+#ifdef MICROBOX_ENABLE_TRACE
+    void dumpTrace();
+    void clearTrace();
+#endif
 
 private:
-    void showHelp(char** pParam, uint8_t parCnt);
-    void printCommands();
+    // one step of printFormat(): the text up to the next conversion, then the conversion
+    template<typename Format, size_t Pos, typename... Args>
+    void printFormatFrom(FORMAT_OUTPUT& out, Args... args)
+    {
+        constexpr size_t literal = MicroBoxFormat::literalEnd(Format::text(), Pos);
+        constexpr int step = MicroBoxFormat::step(Format::text(), literal);
+        // a "%%" goes out with the text before it
+        constexpr size_t printed = literal + (step == FORMAT_STEP_PERCENT ? 1 : 0);
+        if (printed > Pos)
+            formatText(out, Format::text() + Pos, printed - Pos);
+        printFormatAt<Format, literal>(out, std::integral_constant<int, step>(), args...);
+    }
+
+    template<typename Format, size_t Pos, typename... Args>
+    void printFormatAt(FORMAT_OUTPUT& out, std::integral_constant<int, FORMAT_STEP_END>, Args...)
+    {
+        static_assert(sizeof...(Args) == 0, "more arguments than conversions in the format");
+        print(out.text, out.length);
+    }
+
+    template<typename Format, size_t Pos, typename... Args>
+    void printFormatAt(FORMAT_OUTPUT& out, std::integral_constant<int, FORMAT_STEP_PERCENT>, Args... args)
+    {
+        printFormatFrom<Format, Pos + 2>(out, args...);
+    }
+
+    template<typename Format, size_t Pos>
+    void printFormatAt(FORMAT_OUTPUT&, std::integral_constant<int, FORMAT_STEP_CONVERSION>)
+    {
+        static_assert(MicroBoxFormat::conversion(Format::text(), Pos) != '\0', "the format ends inside a conversion");
+        static_assert(sizeof(Format) == 0, "fewer arguments than conversions in the format");
+    }
+
+    template<typename Format, size_t Pos, typename T, typename... Args>
+    void printFormatAt(FORMAT_OUTPUT& out, std::integral_constant<int, FORMAT_STEP_CONVERSION>, T value, Args... args)
+    {
+        constexpr char conversion = MicroBoxFormat::conversion(Format::text(), Pos);
+        constexpr int length = MicroBoxFormat::length(Format::text(), Pos);
+        static_assert(conversion != '\0', "the format ends inside a conversion");
+        static_assert(conversion != '*' && conversion != '.', "'*' widths and precisions are not supported, write the number");
+        static_assert(conversion != 'n', "%n is not supported");
+        static_assert(MicroBoxFormat::isKnownConversion(conversion), "unknown conversion in the format");
+        static_assert(length != FORMAT_LENGTH_LONG_DOUBLE, "long double is not supported");
+        static_assert(!MicroBoxFormat::isIntegerConversion(conversion) || MicroBoxFormat::isInteger<T>(),
+            "%d, %i, %u, %o, %x, %X, %b and %c need an integer argument");
+        static_assert(!MicroBoxFormat::isFloatConversion(conversion) || std::is_arithmetic<T>::value,
+            "%f, %e and %g need a number");
+        static_assert(conversion != 's' || std::is_convertible<T, const char*>::value, "%s needs a string");
+        static_assert(conversion != 'p' || std::is_pointer<T>::value || std::is_same<T, decltype(nullptr)>::value,
+            "%p needs a pointer");
+        static_assert(MicroBoxFormat::end(Format::text(), Pos) - Pos < FORMAT_CONVERSION_SIZE, "conversion is too long");
+
+        formatArgument<Format, Pos>(out, value, std::integral_constant<int, MicroBoxFormat::kind(conversion)>());
+        printFormatFrom<Format, MicroBoxFormat::end(Format::text(), Pos)>(out, args...);
+    }
+
+    // integers are converted here, with the conversion decoded while compiling; the value is
+    // promoted and cut to the length modifier the way printf() reads it from the argument list
+    template<typename Format, size_t Pos, typename T>
+    void formatArgument(FORMAT_OUTPUT& out, T value, std::integral_constant<int, FORMAT_KIND_INTEGER>)
+    {
+        typedef decltype(+value) promoted_t;
+        typedef typename std::make_signed<promoted_t>::type signed_t;
+        typedef typename std::make_unsigned<promoted_t>::type unsigned_t;
+        typedef typename std::conditional<(sizeof(promoted_t) > sizeof(unsigned long)), unsigned long long, unsigned long>::type magnitude_t;
+        constexpr FORMAT_SPEC spec = MicroBoxFormat::spec(Format::text(), Pos);
+        constexpr int length = MicroBoxFormat::length(Format::text(), Pos);
+        static_assert(sizeof(promoted_t) <= MicroBoxFormat::lengthSize(length),
+            "the argument is wider than the conversion, add the length modifier (l, ll, z, ...)");
+
+        promoted_t promoted = +value;
+        if (spec.conversion == 'c') {
+            char c = (char)promoted;
+            formatPadded(out, &c, 1, spec);
+        } else if (spec.conversion == 'd' || spec.conversion == 'i') {
+            signed_t number = length == FORMAT_LENGTH_HH ? (signed char)promoted
+                : length == FORMAT_LENGTH_H ? (short)promoted : (signed_t)promoted;
+            formatInteger(out, number < 0 ? 0U - (magnitude_t)number : (magnitude_t)number, number < 0, spec);
+        } else {
+            unsigned_t number = length == FORMAT_LENGTH_HH ? (unsigned char)promoted
+                : length == FORMAT_LENGTH_H ? (unsigned short)promoted : (unsigned_t)promoted;
+            formatInteger(out, (magnitude_t)number, false, spec);
+        }
+    }
+
+    template<typename Format, size_t Pos, typename T>
+    void formatArgument(FORMAT_OUTPUT& out, T value, std::integral_constant<int, FORMAT_KIND_STRING>)
+    {
+        formatString(out, value, MicroBoxFormat::spec(Format::text(), Pos));
+    }
+
+    // floating point and pointers are left to printf(), with nothing but their own conversion
+    template<typename Format, size_t Pos, typename T>
+    void formatArgument(FORMAT_OUTPUT& out, T value, std::integral_constant<int, FORMAT_KIND_FLOAT>)
+    {
+        formatConversion(out, Format::text() + Pos, MicroBoxFormat::end(Format::text(), Pos) - Pos, (double)value);
+    }
+
+    template<typename Format, size_t Pos, typename T>
+    void formatArgument(FORMAT_OUTPUT& out, T value, std::integral_constant<int, FORMAT_KIND_POINTER>)
+    {
+        formatConversion(out, Format::text() + Pos, MicroBoxFormat::end(Format::text(), Pos) - Pos, (const void*)value);
+    }
+
+    void formatText(FORMAT_OUTPUT& out, const char* text, size_t len);
+    void formatFill(FORMAT_OUTPUT& out, char c, size_t count);
+    void formatInteger(FORMAT_OUTPUT& out, unsigned long magnitude, bool negative, FORMAT_SPEC spec);
+    void formatInteger(FORMAT_OUTPUT& out, unsigned long long magnitude, bool negative, FORMAT_SPEC spec);
+    void formatNumber(FORMAT_OUTPUT& out, const char* digits, size_t len, bool zero, bool negative, FORMAT_SPEC spec);
+    void formatString(FORMAT_OUTPUT& out, const char* str, FORMAT_SPEC spec);
+    void formatPadded(FORMAT_OUTPUT& out, const char* text, size_t len, FORMAT_SPEC spec);
+    void formatConversion(FORMAT_OUTPUT& out, const char* conversion, size_t len, ...);
+    bool showHelp(char** pParam, uint8_t parCnt, uint32_t row);
+    void printDescription(const COMMAND_ENTRY& entry);
+    void printStored(const char* str, size_t len, bool inFlash);
+    static uint8_t storedByte(const char* p, bool inFlash);
+#ifdef __AVR__
+    void setDescriptionInFlash(int8_t group);
+#endif
+#ifdef MICROBOX_ENABLE_STATS
+    void showStats(char** pParam, uint8_t parCnt);
+#endif
+#ifdef MICROBOX_ENABLE_LOG
+    void showLog(char** pParam, uint8_t parCnt);
+    void addLogEntry(const char* format, const uintptr_t* args, const uint8_t* argTypes, uint8_t argCount);
+    void printLogEntry(const LOG_ENTRY& entry);
+    void printLogArgument(const char* spec, const LOG_ENTRY& entry, uint8_t index);
+    template<typename T>
+    static uintptr_t toLogArg(T value)
+    {
+        static_assert(std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+            "log arguments must be integers or pointers");
+        static_assert(sizeof(T) <= sizeof(uintptr_t), "log argument is too wide");
+        return (uintptr_t)value;
+    }
+    template<typename T>
+    static constexpr uint8_t logArgType()
+    {
+        return std::is_pointer<T>::value ? LOG_ARG_POINTER
+            : std::is_signed<typename std::conditional<std::is_enum<T>::value, std::underlying_type<T>,
+                std::common_type<T>>::type::type>::value ? LOG_ARG_SIGNED : LOG_ARG_UNSIGNED;
+    }
+#endif
+#ifdef MICROBOX_ENABLE_WRITER
+    void showFormat(char** pParam, uint8_t parCnt);
+#endif
+#ifdef MICROBOX_ENABLE_TRACE
+    void showTrace(char** pParam, uint8_t parCnt);
+    void trace(uint8_t event, char phase, size_t arg);
+#endif
 
 private:
     uint8_t parseCommandParameters(char* pParam);
     void errorCommand();
-    int8_t getCommandIndex(char* pCmd, int8_t startIdx = 0);
-    uint8_t compareParameter(uint8_t idx1, uint8_t idx2);
+    int8_t addEntry(const char* commandName, callback_t commandFunction, const char* commandDescription, int8_t group);
+    int8_t findCommand(int8_t first, const char* name, size_t len);
+    int8_t getCommandIndex(const char* pCmd, size_t len, int8_t startIdx);
+    buffer_pos_t compareParameter(uint8_t idx1, uint8_t idx2);
     void handleTab();
     void historyUp();
     void historyDown();
     void historyPrintHelper();
     void addToHistory(char* buf);
+    int8_t lookupCommand(char*& pParam);
     void executeCommand();
+    bool streamLine();
+    void runStream(int8_t index, char* chunk, buffer_pos_t len, bool last);
+    bool runGenerator();
+    bool fillChunk(size_t maxLen);
+#ifdef MICROBOX_ENABLE_CACHE
+    bool serveCached(int8_t index, buffer_pos_t lineLength);
+#endif
+#ifdef MICROBOX_ENABLE_WATCH
+    void startWatch(char** pParam, uint8_t parCnt);
+    void runWatch();
+    void captureWatch(const char* str, size_t len);
+    void drawWatch();
+    bool watchKeys();
+    void stopWatch();
+#endif
+#ifdef MICROBOX_ENABLE_TRANSFER
+    bool runTransfer();
+    size_t takeInput(uint8_t* buffer, size_t len);
+    void receiveFrames();
+    void receiveControl();
+    void sendFrames();
+    void sendControl(uint8_t type, uint8_t sequence);
+    uint32_t blockOf(uint8_t sequence);
+    void endTransfer(bool abort);
+    static uint16_t crc16(const uint8_t* data, size_t len);
+#endif
+    void stopGenerator();
+    size_t outputRoom();
     double parseFloat(char* pBuf);
     bool handleEscapeSequence(unsigned char ch);
+    void handleChar(uint8_t ch);
+    static bool isPlainChar(uint8_t ch);
+    bool reserveOutput(size_t len);
+    void waitForXon();
+    static void spanOutput(const char* span, size_t len, void* arg);
+    void putChar(uint8_t ch);
+    void putChars(const uint8_t* data, size_t len);
+    size_t writePort(const uint8_t* data, size_t len);
+    void flushOutput();
+#if MICROBOX_ASYNC_SLOTS > 0
+    void flushAsync();
+    char* reserveAsyncSlot(uint32_t& ticket);
+    void commitAsyncSlot(uint32_t ticket);
+    const char* peekAsyncSlot();
+    void releaseAsyncSlot();
+#endif
 
 private:
-    char commandBuffer[MAX_COMMAND_BUFFER_SIZE] =   {0};
-    char* parameterPointer[10] =                    {0};
-    uint8_t bufferPosition =                        0;
+    char* commandBuffer;
+    uint16_t commandBufferSize;
+    uint8_t rxChunk[MICROBOX_RX_CHUNK_SIZE] =       {0};
+    uint8_t rxChunkPosition =                       0;
+    uint8_t rxChunkLength =                         0;
+    size_t maxBytesPerPass =                        0;
+    uint8_t maxCommandsPerPass =                    0;
+    uint8_t commandsThisPass =                      0;
+    char** parameterPointer;
+    uint8_t parameterNumber;
+    buffer_pos_t bufferPosition =                   0;
     uint8_t escapeSequence =                        0;
     const char* hostName =                          nullptr;
-    int historyBufferSize =                         MAX_HISTORY_BUFFER_SIZE;
+    int historyBufferSize;
     int historyWritePosition =                      0;
     int historyCursorPosition =                     -1;
     bool localEcho =                                false;
-    COMMAND_ENTRY commands[MAX_COMMAND_NUMBER] =    {0};
-    char historyBuffer[MAX_HISTORY_BUFFER_SIZE] =   {0};
+    int8_t firstCommand =                           -1;
+    int8_t helpCursor =                             -1;
+    int8_t generatorCommand =                       -1;
+    uint8_t generatorParCnt =                       0;
+    uint32_t generatorRow =                         0;
+    bool generatorMore =                            false;
+    uint8_t pageLength =                            0;
+    uint8_t pageRows =                              0;
+    bool pagerWaiting =                             false;
+    int8_t streamCommand =                          -1;
+    const char* streamChunk =                       nullptr;
+    buffer_pos_t streamLength =                     0;
+    bool streamLast =                               false;
+    COMMAND_ENTRY* commands;
+    uint8_t commandNumber;
+    char* historyBuffer;
     PortHandler* portHandler =                      nullptr;
+    bool flowControl =                              false;
+    bool outputPaused =                             false;
+    uint32_t droppedBytes =                         0;
+    tick_source_t tickSource =                      nullptr;
+    const char* helpDictionary =                    nullptr;
+    bool helpDictionaryInFlash =                    false;
+#ifdef MICROBOX_ENABLE_WRITER
+    uint8_t outputMode =                            OUTPUT_MODE_TEXT;
+#endif
+#ifdef MICROBOX_ENABLE_WATCH
+    int8_t watchCommand =                           -1;
+    char* watchLine;
+    uint32_t watchInterval =                        0;
+    uint32_t watchLastRun =                         0;
+    bool watchDue =                                 false;
+    bool watchCapturing =                           false;
+    bool watchEscape =                              false;
+    bool watchRedraw =                              false;
+    uint8_t watchRow =                              0;
+    uint8_t watchColumn =                           0;
+    char watchFrame[MICROBOX_WATCH_ROWS][MICROBOX_WATCH_COLUMNS];
+    char watchShown[MICROBOX_WATCH_ROWS][MICROBOX_WATCH_COLUMNS];
+#endif
+#ifdef MICROBOX_ENABLE_TRANSFER
+    uint8_t transferMode =                          TRANSFER_NONE;
+    transfer_sink_t transferSink;
+    transfer_source_t transferSource;
+    uint8_t frame[MICROBOX_TRANSFER_BLOCK + 4] =    {0};
+    uint16_t framePosition =                        0;
+    bool inFrame =                                  false;
+    bool transferClosing =                          false;
+    bool nakSent =                                  false;
+    uint8_t controlType =                           0;
+    uint32_t transferBase =                         0;
+    uint32_t transferNext =                         0;
+    uint32_t transferLast =                         0xFFFFFFFFUL;
+    uint32_t transferTimeout =                      0;
+    uint32_t transferActivity =                     0;
+#endif
+#ifdef MICROBOX_ENABLE_CACHE
+    MicroBoxCache* cache =                          nullptr;
+    bool capturingOutput =                          false;
+    uint32_t captureDroppedBytes =                  0;
+#endif
+#ifdef MICROBOX_ENABLE_STATS
+    MICROBOX_STATS stats =                          {0};
+    uint32_t inputWaitStart =                       0;
+    bool inputWaiting =                             false;
+#endif
+#ifdef MICROBOX_ENABLE_LOG
+    LOG_ENTRY logEntries[MICROBOX_LOG_ENTRIES] =    {0};
+    uint8_t logHead =                               0;
+    uint8_t logCount =                              0;
+    uint32_t lostLogEntries =                       0;
+#endif
+#ifdef MICROBOX_ENABLE_TRACE
+    TRACE_EVENT traceRing[MICROBOX_TRACE_ENTRIES] = {0};
+    uint16_t traceHead =                            0;
+    uint16_t traceCount =                           0;
+    bool tracing =                                  true;
+#endif
+#if MICROBOX_ASYNC_SLOTS > 0
+    ASYNC_SLOT asyncSlots[MICROBOX_ASYNC_SLOTS] =   {};
+#ifdef MICROBOX_THREAD_SAFE
+    std::atomic<uint32_t> asyncWriteTicket =        {0};
+#else
+    uint32_t asyncWriteTicket =                     0;
+#endif
+    uint32_t asyncReadTicket =                      0;
+#endif
+#if MICROBOX_TX_BUFFER_SIZE > 0
+    uint8_t txBuffer[MICROBOX_TX_BUFFER_SIZE] =     {0};
+    size_t txHead =                                 0;
+    size_t txCount =                                0;
+    bool blockingOutput =                           false;
+#endif
+};
+
+// Sizes of a console for MicroBoxSized<Config>; derive from it and change what differs:
+//
+//     struct DebugConsole : MicroBoxDefaultConfig {
+//         static constexpr uint16_t commandBufferSize =   24;
+//         static constexpr int historyBufferSize =        0;
+//         static constexpr uint8_t commandNumber =        6;
+//         static constexpr uint8_t parameterNumber =      2;
+//     };
+//     MicroBoxSized<DebugConsole> debugConsole;
+struct MicroBoxDefaultConfig {
+    static constexpr uint16_t commandBufferSize =   MAX_COMMAND_BUFFER_SIZE;
+    static constexpr int historyBufferSize =        MAX_HISTORY_BUFFER_SIZE;
+    static constexpr uint8_t commandNumber =        MAX_COMMAND_NUMBER;
+    static constexpr uint8_t parameterNumber =      MAX_PARAMETER_NUMBER;
+};
+
+// RAM of a console by part, total is the whole object
+typedef struct
+{
+    size_t commandLine;
+    size_t history;
+    size_t commands;
+    size_t parameters;
+    size_t total;
+} MICROBOX_FOOTPRINT;
+
+// A console that holds its buffers, sized by Config, so every console of a program can have
+// sizes of its own
+template<typename Config>
+class MicroBoxSized : public MicroBoxCore {
+    static_assert(Config::commandNumber >= 3 && Config::commandNumber <= 127, "commandNumber must be 3..127");
+    static_assert(Config::commandBufferSize >= 2 && Config::commandBufferSize <= MICROBOX_MAX_LINE_SIZE,
+        "commandBufferSize must be 2..MICROBOX_MAX_LINE_SIZE, define MICROBOX_MAX_LINE_SIZE for longer lines");
+    static_assert(Config::historyBufferSize == 0 || Config::historyBufferSize > Config::commandBufferSize,
+        "the history must be 0 or hold at least one full command line");
+    static_assert(Config::parameterNumber >= 1, "parameterNumber must be 1..255");
+
+public:
+    MicroBoxSized() : MicroBoxCore(storage(this))
+    {
+
+    }
+
+    // usable at compile time, e.g. static_assert(MicroBoxSized<DebugConsole>::footprint().total < 300, "")
+    static constexpr MICROBOX_FOOTPRINT footprint()
+    {
+        return MICROBOX_FOOTPRINT{
+#ifdef MICROBOX_ENABLE_WATCH
+            sizeof(MicroBoxSized::commandLine) + sizeof(MicroBoxSized::watchLine),
+#else
+            sizeof(MicroBoxSized::commandLine),
+#endif
+            Config::historyBufferSize > 0 ? sizeof(MicroBoxSized::history) : 0,
+            sizeof(MicroBoxSized::commandTable), sizeof(MicroBoxSized::parameters), sizeof(MicroBoxSized) };
+    }
+
+private:
+    // the arrays are not initialized yet, only their addresses are taken
+    static MICROBOX_STORAGE storage(MicroBoxSized* self)
+    {
+        MICROBOX_STORAGE buffers;
+        buffers.commandBuffer = self->commandLine;
+        buffers.commandBufferSize = Config::commandBufferSize;
+        buffers.historyBuffer = self->history;
+        buffers.historyBufferSize = Config::historyBufferSize;
+        buffers.commands = self->commandTable;
+        buffers.commandNumber = Config::commandNumber;
+        buffers.parameterPointer = self->parameters;
+        buffers.parameterNumber = Config::parameterNumber;
+#ifdef MICROBOX_ENABLE_WATCH
+        buffers.watchLine = self->watchLine;
+#endif
+        return buffers;
+    }
+
+private:
+    char commandLine[Config::commandBufferSize] =                                   {0};
+    char history[Config::historyBufferSize > 0 ? Config::historyBufferSize : 1] =   {0};
+    COMMAND_ENTRY commandTable[Config::commandNumber] =                             {};
+    char* parameters[Config::parameterNumber] =                                     {0};
+#ifdef MICROBOX_ENABLE_WATCH
+    char watchLine[Config::commandBufferSize] =                                     {0};
+#endif
+};
+
+// the console with the sizes of the MAX_* defines
+class MicroBox : public MicroBoxSized<MicroBoxDefaultConfig> {
+};
+
+#ifdef MICROBOX_ENABLE_WRITER
+// Streams objects, arrays and values straight to the console, as aligned text for people or as
+// compact JSON or CBOR for host tools, as set with setOutputMode(). Nothing is buffered, the
+// calls just have to be properly nested:
+//
+//     MicroBoxWriter out(microbox);
+//     out.beginObject();
+//     out.field("uptime", seconds);
+//     out.key("channels");
+//     out.beginArray();
+//     ...
+//     out.endArray();
+//     out.endObject();
+class MicroBoxWriter {
+public:
+    explicit MicroBoxWriter(MicroBoxCore& microbox);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(const char* name);
+
+    void value(const char* str);
+    void value(bool flag);
+    void value(double number);
+    void valueNull();
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type value(T number)
+    {
+        if (std::is_signed<T>::value && number < 0)
+            writeNegative((long long)number);
+        else
+            writeUnsigned((unsigned long long)number);
+    }
+
+    template<typename T>
+    void field(const char* name, T fieldValue)
+    {
+        key(name);
+        value(fieldValue);
+    }
+
+private:
+    void beginContainer(bool isArray);
+    void endContainer();
+    void beforeValue(const char* text);
+    void afterValue();
+    void writeUnsigned(unsigned long long number);
+    void writeNegative(long long number);
+    void writeJsonString(const char* str);
+    void writeCborHead(uint8_t major, unsigned long long number);
+
+private:
+    MicroBoxCore& microbox;
+    uint8_t mode;
+    uint8_t depth =                                 0;
+    uint32_t arrayLevels =                          0;
+    uint32_t levelsWithItems =                      0;
+    const char* pendingKey =                        nullptr;
 };
+#endif
 
 #endif // MICROBOX_H
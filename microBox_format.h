@@ -0,0 +1,210 @@
+#ifndef MICROBOX_FORMAT_H
+#define MICROBOX_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// Compile-time side of MICROBOX_PRINTF(): everything here runs while compiling, on the format
+// string literal, so a call site ends up as a fixed sequence of literal spans and conversions.
+// The functions are C++11 constexpr, one return statement each; a conversion is addressed by
+// the position of its '%'. The recursion goes one step per character, so a format should stay
+// below a few hundred characters (the compilers' default constexpr depth is 512).
+
+#define FORMAT_FLAG_LEFT            0x01
+#define FORMAT_FLAG_PLUS            0x02
+#define FORMAT_FLAG_SPACE           0x04
+#define FORMAT_FLAG_ZERO            0x08
+#define FORMAT_FLAG_HASH            0x10
+
+#define FORMAT_LENGTH_NONE          0
+#define FORMAT_LENGTH_HH            1
+#define FORMAT_LENGTH_H             2
+#define FORMAT_LENGTH_L             3
+#define FORMAT_LENGTH_LL            4
+#define FORMAT_LENGTH_Z             5
+#define FORMAT_LENGTH_J             6
+#define FORMAT_LENGTH_T             7
+#define FORMAT_LENGTH_LONG_DOUBLE   8
+
+#define FORMAT_STEP_END             0
+#define FORMAT_STEP_PERCENT         1
+#define FORMAT_STEP_CONVERSION      2
+
+#define FORMAT_KIND_INTEGER         0
+#define FORMAT_KIND_STRING          1
+#define FORMAT_KIND_FLOAT           2
+#define FORMAT_KIND_POINTER         3
+
+// room for a floating point or pointer conversion handed to printf(), with its '%' and the zero
+#define FORMAT_CONVERSION_SIZE      16
+
+// MICROBOX_PRINTF() collects its output on the stack and prints it in pieces of this size
+#ifndef MICROBOX_FORMAT_BUFFER_SIZE
+#define MICROBOX_FORMAT_BUFFER_SIZE 64
+#endif
+
+static_assert(MICROBOX_FORMAT_BUFFER_SIZE >= 16, "MICROBOX_FORMAT_BUFFER_SIZE is too small");
+
+// one conversion as the runtime part needs it, precision is -1 if there is none
+typedef struct
+{
+    uint8_t flags;
+    char conversion;
+    int width;
+    int precision;
+} FORMAT_SPEC;
+
+typedef struct
+{
+    char text[MICROBOX_FORMAT_BUFFER_SIZE];
+    size_t length;
+} FORMAT_OUTPUT;
+
+struct MicroBoxFormat {
+    // end of the text from i that goes out as it is
+    static constexpr size_t literalEnd(const char* s, size_t i)
+    {
+        return (s[i] == '\0' || s[i] == '%') ? i : literalEnd(s, i + 1);
+    }
+
+    static constexpr int step(const char* s, size_t i)
+    {
+        return s[i] == '\0' ? FORMAT_STEP_END : s[i + 1] == '%' ? FORMAT_STEP_PERCENT : FORMAT_STEP_CONVERSION;
+    }
+
+    static constexpr uint8_t flag(char c)
+    {
+        return c == '-' ? FORMAT_FLAG_LEFT : c == '+' ? FORMAT_FLAG_PLUS : c == ' ' ? FORMAT_FLAG_SPACE
+            : c == '0' ? FORMAT_FLAG_ZERO : c == '#' ? FORMAT_FLAG_HASH : 0;
+    }
+
+    static constexpr uint8_t flags(const char* s, size_t i)
+    {
+        return flag(s[i]) != 0 ? (uint8_t)(flag(s[i]) | flags(s, i + 1)) : 0;
+    }
+
+    static constexpr size_t flagsEnd(const char* s, size_t i)
+    {
+        return flag(s[i]) != 0 ? flagsEnd(s, i + 1) : i;
+    }
+
+    static constexpr bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static constexpr size_t digitsEnd(const char* s, size_t i)
+    {
+        return isDigit(s[i]) ? digitsEnd(s, i + 1) : i;
+    }
+
+    static constexpr int number(const char* s, size_t i, int value)
+    {
+        return isDigit(s[i]) ? number(s, i + 1, value * 10 + (s[i] - '0')) : value;
+    }
+
+    // the parts of the conversion whose '%' is at i
+    static constexpr size_t widthAt(const char* s, size_t i)
+    {
+        return flagsEnd(s, i + 1);
+    }
+
+    static constexpr size_t precisionAt(const char* s, size_t i)
+    {
+        return digitsEnd(s, widthAt(s, i));
+    }
+
+    static constexpr size_t lengthAt(const char* s, size_t i)
+    {
+        return s[precisionAt(s, i)] == '.' ? digitsEnd(s, precisionAt(s, i) + 1) : precisionAt(s, i);
+    }
+
+    static constexpr int lengthOf(const char* p)
+    {
+        return p[0] == 'h' ? (p[1] == 'h' ? FORMAT_LENGTH_HH : FORMAT_LENGTH_H)
+            : p[0] == 'l' ? (p[1] == 'l' ? FORMAT_LENGTH_LL : FORMAT_LENGTH_L)
+            : p[0] == 'z' ? FORMAT_LENGTH_Z : p[0] == 'j' ? FORMAT_LENGTH_J : p[0] == 't' ? FORMAT_LENGTH_T
+            : p[0] == 'L' ? FORMAT_LENGTH_LONG_DOUBLE : FORMAT_LENGTH_NONE;
+    }
+
+    static constexpr int length(const char* s, size_t i)
+    {
+        return lengthOf(s + lengthAt(s, i));
+    }
+
+    static constexpr size_t conversionAt(const char* s, size_t i)
+    {
+        return lengthAt(s, i) + (length(s, i) == FORMAT_LENGTH_HH || length(s, i) == FORMAT_LENGTH_LL ? 2
+            : length(s, i) != FORMAT_LENGTH_NONE ? 1 : 0);
+    }
+
+    static constexpr char conversion(const char* s, size_t i)
+    {
+        return s[conversionAt(s, i)];
+    }
+
+    // where the text after the conversion starts
+    static constexpr size_t end(const char* s, size_t i)
+    {
+        return conversion(s, i) == '\0' ? conversionAt(s, i) : conversionAt(s, i) + 1;
+    }
+
+    static constexpr FORMAT_SPEC spec(const char* s, size_t i)
+    {
+        return FORMAT_SPEC{ flags(s, i + 1), conversion(s, i), number(s, widthAt(s, i), 0),
+            s[precisionAt(s, i)] == '.' ? number(s, precisionAt(s, i) + 1, 0) : -1 };
+    }
+
+    static constexpr bool isIntegerConversion(char c)
+    {
+        return c == 'd' || c == 'i' || c == 'u' || c == 'o' || c == 'x' || c == 'X' || c == 'b' || c == 'c';
+    }
+
+    static constexpr bool isFloatConversion(char c)
+    {
+        return c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G';
+    }
+
+    static constexpr bool isKnownConversion(char c)
+    {
+        return isIntegerConversion(c) || isFloatConversion(c) || c == 's' || c == 'p';
+    }
+
+    static constexpr int kind(char c)
+    {
+        return c == 's' ? FORMAT_KIND_STRING : c == 'p' ? FORMAT_KIND_POINTER
+            : isFloatConversion(c) ? FORMAT_KIND_FLOAT : FORMAT_KIND_INTEGER;
+    }
+
+    // the widest integer the length modifier announces
+    static constexpr size_t lengthSize(int length)
+    {
+        return length == FORMAT_LENGTH_L ? sizeof(long) : length == FORMAT_LENGTH_LL ? sizeof(long long)
+            : length == FORMAT_LENGTH_Z ? sizeof(size_t) : length == FORMAT_LENGTH_J ? sizeof(intmax_t)
+            : length == FORMAT_LENGTH_T ? sizeof(ptrdiff_t) : sizeof(int);
+    }
+
+    template<typename T>
+    static constexpr bool isInteger()
+    {
+        return std::is_integral<T>::value || std::is_enum<T>::value;
+    }
+};
+
+// Formats like microbox.printf(), but the format string is parsed while compiling: the text
+// between the conversions goes out as it is and every argument is formatted with its conversion
+// already decoded. The arguments are checked against the conversions, a mismatch, a missing or
+// an extra argument stops the build. The format has to be a string literal; '*' widths,
+// long double and %n are not supported.
+//
+//     MICROBOX_PRINTF(microbox, "%-8s %5u rx %lu\n", name, count, bytes);
+#define MICROBOX_PRINTF(microbox, format, ...)                                                  \
+    do {                                                                                        \
+        struct MicroBoxFormatText {                                                             \
+            static constexpr const char* text() { return format; }                              \
+        };                                                                                      \
+        (microbox).printFormat(MicroBoxFormatText(), ##__VA_ARGS__);                            \
+    } while (0)
+
+#endif // MICROBOX_FORMAT_H
@@ -6,6 +6,27 @@ public:
     virtual size_t write(uint8_t c) = 0;
     virtual int read()              = 0;
     virtual int available()         = 0;
+
+    // writes a whole block, override it if the port can do better than byte by byte
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size)
+    {
+        size_t written = 0;
+        while (written < size && write(buffer[written]))
+            written++;
+        return written;
+    }
+
+    // reads up to size bytes that are already received, must not wait for more
+    virtual size_t readBytes(uint8_t* buffer, size_t size)
+    {
+        size_t received = 0;
+        while (received < size && available() > 0)
+            buffer[received++] = read();
+        return received;
+    }
+
+    // free space in the transmit buffer, -1 if the port can't tell
+    virtual int availableForWrite() { return -1; }
 };
 
 #endif // MICROBOX_PORT_HANDLER_H
\ No newline at end of file
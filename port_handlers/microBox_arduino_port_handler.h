@@ -20,16 +20,35 @@ public:
         return port.write(c);
     }
 
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        return port.write(buffer, size);
+    }
+
     virtual int read() override
     {
         return port.read();
     }
 
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        // never ask Stream::readBytes for more than is buffered, it would wait for the rest
+        int count = port.available();
+        if (count <= 0)
+            return 0;
+        return port.readBytes(buffer, (size_t)count < size ? (size_t)count : size);
+    }
+
     virtual int available() override
     {
         return port.available();
     }
 
+    virtual int availableForWrite() override
+    {
+        return port.availableForWrite();
+    }
+
 private:
     HardwareSerial& port;
 };
@@ -0,0 +1,93 @@
+#ifndef MICROBOX_BUFFER_PORT_HANDLER_H
+#define MICROBOX_BUFFER_PORT_HANDLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "../port_handler.h"
+
+// In-memory port: input is read from a fixed buffer, output is collected in another one.
+// Useful to feed scripted input to microBox on a host, e.g. for tests and benchmarks.
+class BufferPortHandler : public PortHandler {
+public:
+    BufferPortHandler(uint8_t* txBuffer, size_t txSize) : txBuffer(txBuffer), txSize(txSize)
+    {
+
+    }
+
+    void setInput(const void* data, size_t size)
+    {
+        rxBuffer = static_cast<const uint8_t*>(data);
+        rxSize = size;
+        rxPosition = 0;
+    }
+
+    // forget the collected output, the output buffer is reused from the start
+    void clearOutput()
+    {
+        txPosition = 0;
+    }
+
+    const uint8_t* output() const
+    {
+        return txBuffer;
+    }
+
+    size_t outputSize() const
+    {
+        return txPosition;
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        if (txPosition >= txSize)
+            return 0;
+        txBuffer[txPosition++] = c;
+        return 1;
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        if (size > txSize - txPosition)
+            size = txSize - txPosition;
+        memcpy(txBuffer + txPosition, buffer, size);
+        txPosition += size;
+        return size;
+    }
+
+    virtual int read() override
+    {
+        if (rxPosition >= rxSize)
+            return -1;
+        return rxBuffer[rxPosition++];
+    }
+
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        if (size > rxSize - rxPosition)
+            size = rxSize - rxPosition;
+        memcpy(buffer, rxBuffer + rxPosition, size);
+        rxPosition += size;
+        return size;
+    }
+
+    virtual int available() override
+    {
+        return (int)(rxSize - rxPosition);
+    }
+
+    virtual int availableForWrite() override
+    {
+        return (int)(txSize - txPosition);
+    }
+
+private:
+    const uint8_t* rxBuffer = nullptr;
+    size_t rxSize = 0;
+    size_t rxPosition = 0;
+    uint8_t* txBuffer;
+    size_t txSize;
+    size_t txPosition = 0;
+};
+
+#endif // MICROBOX_BUFFER_PORT_HANDLER_H
@@ -0,0 +1,434 @@
+#ifdef __linux__
+
+#ifndef MICROBOX_EPOLL_SERVER_H
+#define MICROBOX_EPOLL_SERVER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <functional>
+#include <vector>
+#include "../port_handler.h"
+#include "../microBox.h"
+
+#ifndef MICROBOX_SERVER_MAX_SESSIONS
+#define MICROBOX_SERVER_MAX_SESSIONS    256
+#endif
+#ifndef MICROBOX_SOCKET_RX_SIZE
+#define MICROBOX_SOCKET_RX_SIZE         1024
+#endif
+// output a session may have queued before its input waits until the client has taken some;
+// the queue itself grows as far as a command prints, nothing is dropped
+#ifndef MICROBOX_SOCKET_TX_SIZE
+#define MICROBOX_SOCKET_TX_SIZE         4096
+#endif
+
+// Port on a non-blocking socket. Received data is pulled in bulk by fill(), output is collected
+// and sent in one system call by flush(), both are driven by MicroBoxServer. What the socket
+// doesn't take stays queued for the next flush().
+class SocketPortHandler : public PortHandler {
+public:
+    explicit SocketPortHandler(int fd) : fd(fd)
+    {
+
+    }
+
+    int socket() const
+    {
+        return fd;
+    }
+
+    // reads what the socket has, false if the connection failed; a peer that closed its side
+    // only sets inputClosed(), what it sent before is still served
+    bool fill()
+    {
+        if (rxHead > 0) {
+            memmove(rxBuffer, rxBuffer + rxHead, rxTail - rxHead);
+            rxTail -= rxHead;
+            rxHead = 0;
+        }
+        while (rxTail < sizeof(rxBuffer)) {
+            ssize_t received = recv(fd, rxBuffer + rxTail, sizeof(rxBuffer) - rxTail, 0);
+            if (received > 0) {
+                rxTail += received;
+            } else if (received == 0) {
+                peerClosed = true;
+                return true;
+            } else {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+        }
+        return true;
+    }
+
+    // sends the collected output, false if the peer is gone
+    bool flush()
+    {
+        while (txSent < txBuffer.size()) {
+            ssize_t written = send(fd, txBuffer.data() + txSent, txBuffer.size() - txSent, MSG_NOSIGNAL);
+            if (written > 0) {
+                txSent += written;
+            } else if (written < 0 && errno == EINTR) {
+                continue;
+            } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                return false;
+            }
+        }
+        if (txSent == txBuffer.size()) {
+            txBuffer.clear();
+            txSent = 0;
+        } else if (txSent >= MICROBOX_SOCKET_TX_SIZE) {
+            txBuffer.erase(txBuffer.begin(), txBuffer.begin() + txSent);
+            txSent = 0;
+        }
+        return true;
+    }
+
+    bool hasPendingOutput() const
+    {
+        return txSent < txBuffer.size();
+    }
+
+    // the client is behind: no more input is processed until it has taken some output
+    bool outputBlocked() const
+    {
+        return txBuffer.size() - txSent >= MICROBOX_SOCKET_TX_SIZE;
+    }
+
+    bool inputClosed() const
+    {
+        return peerClosed;
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        return writeBytes(&c, 1);
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        if (txBuffer.size() - txSent + size > MICROBOX_SOCKET_TX_SIZE)
+            flush();
+        txBuffer.insert(txBuffer.end(), buffer, buffer + size);
+        return size;
+    }
+
+    virtual int read() override
+    {
+        if (rxHead == rxTail)
+            return -1;
+        return rxBuffer[rxHead++];
+    }
+
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        if (size > rxTail - rxHead)
+            size = rxTail - rxHead;
+        memcpy(buffer, rxBuffer + rxHead, size);
+        rxHead += size;
+        return size;
+    }
+
+    virtual int available() override
+    {
+        return (int)(rxTail - rxHead);
+    }
+
+    virtual int availableForWrite() override
+    {
+        return outputBlocked() ? 0 : (int)(MICROBOX_SOCKET_TX_SIZE - (txBuffer.size() - txSent));
+    }
+
+private:
+    int fd;
+    uint8_t rxBuffer[MICROBOX_SOCKET_RX_SIZE];
+    size_t rxHead = 0;
+    size_t rxTail = 0;
+    std::vector<uint8_t> txBuffer;
+    size_t txSent = 0;
+    bool peerClosed = false;
+};
+
+// Serves many consoles from one thread: every TCP or Unix socket client gets its own MicroBox
+// session, an epoll loop reads in bulk on readiness and sends each session's output at once.
+class MicroBoxServer {
+public:
+    // called for every new session, register the commands on the given MicroBox here
+    typedef std::function<void (MicroBox& microbox)> session_setup_t;
+
+    ~MicroBoxServer()
+    {
+        for (int i = 0; i < MICROBOX_SERVER_MAX_SESSIONS; i++) {
+            if (sessions[i] != nullptr)
+                closeSession(sessions[i]);
+        }
+        if (listenFd >= 0)
+            close(listenFd);
+        if (epollFd >= 0)
+            close(epollFd);
+    }
+
+    bool beginTcp(uint16_t port, const char* hostName, session_setup_t setup)
+    {
+        struct sockaddr_in address;
+        int enable = 1;
+
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return false;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        return begin(fd, (struct sockaddr*)&address, sizeof(address), hostName, setup);
+    }
+
+    bool beginUnix(const char* path, const char* hostName, session_setup_t setup)
+    {
+        struct sockaddr_un address;
+
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(address.sun_path))
+            return false;
+        strcpy(address.sun_path, path);
+        unlink(path);
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return false;
+        return begin(fd, (struct sockaddr*)&address, sizeof(address), hostName, setup);
+    }
+
+    // limits the input bytes and commands one session may process per poll(), sessions with
+    // input left over are served again on the next poll() without waiting for socket activity
+    void setSessionBudget(size_t maxBytes, uint8_t maxCommands)
+    {
+        budgetBytes = maxBytes;
+        budgetCommands = maxCommands;
+    }
+
+    // waits up to timeoutMs for socket activity and serves it, call it from the main loop
+    void poll(int timeoutMs)
+    {
+        struct epoll_event events[64];
+
+        ++pass;
+        int count = epoll_wait(epollFd, events, 64, backlogSessions > 0 ? 0 : timeoutMs);
+        for (int i = 0; i < count; i++) {
+            Session* session = static_cast<Session*>(events[i].data.ptr);
+            if (session == nullptr) {
+                acceptSessions();
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                if (!session->port.fill()) {
+                    closeSession(session);
+                    continue;
+                }
+            }
+            serve(session);
+        }
+
+        // one round over the sessions with left over input, starting after the last one served
+        if (backlogSessions > 0) {
+            for (int i = 0; i < MICROBOX_SERVER_MAX_SESSIONS; i++) {
+                Session* session = sessions[(nextBacklog + i) % MICROBOX_SERVER_MAX_SESSIONS];
+                if (session != nullptr && session->backlog && session->lastPass != pass)
+                    serve(session);
+            }
+            nextBacklog = (nextBacklog + 1) % MICROBOX_SERVER_MAX_SESSIONS;
+        }
+    }
+
+    // received bytes the session hasn't processed yet
+    size_t sessionQueueDepth(int slot)
+    {
+        return sessions[slot] != nullptr ? sessions[slot]->microbox.pendingInput() : 0;
+    }
+
+    // most polls input of the session had to wait for its turn
+    uint32_t sessionMaxWait(int slot) const
+    {
+        return sessions[slot] != nullptr ? sessions[slot]->maxWait : 0;
+    }
+
+    int sessionCount() const
+    {
+        return activeSessions;
+    }
+
+private:
+    struct Session {
+        explicit Session(int fd) : port(fd)
+        {
+
+        }
+
+        SocketPortHandler port;
+        MicroBox microbox;
+        int slot = -1;
+        uint32_t watchedEvents = EPOLLIN;
+        bool backlog = false;
+        uint32_t backlogSince = 0;
+        uint32_t maxWait = 0;
+        uint32_t lastPass = 0;
+    };
+
+    void serve(Session* session)
+    {
+        if (session->backlog) {
+            uint32_t wait = pass - session->backlogSince;
+            if (wait > session->maxWait)
+                session->maxWait = wait;
+        }
+        session->lastPass = pass;
+
+        if (!session->port.flush()) {
+            closeSession(session);
+            return;
+        }
+        // while the client is behind, its session waits for EPOLLOUT instead of taking input
+        bool more = true;
+        if (!session->port.outputBlocked())
+            more = session->microbox.commandParser();
+        if (!session->port.flush()) {
+            closeSession(session);
+            return;
+        }
+        // only sessions that can go on right away keep poll() from sleeping
+        bool backlog = more && !session->port.outputBlocked();
+        if (backlog != session->backlog) {
+            backlogSessions += backlog ? 1 : -1;
+            session->backlog = backlog;
+        }
+        session->backlogSince = pass;
+
+        // the peer closed its side: its last commands are answered before hanging up
+        if (session->port.inputClosed() && !more && !session->port.hasPendingOutput()) {
+            closeSession(session);
+            return;
+        }
+        watchOutput(session, session->port.hasPendingOutput());
+    }
+
+    bool begin(int fd, struct sockaddr* address, socklen_t length, const char* hostName, session_setup_t setup)
+    {
+        struct epoll_event event;
+
+        if (bind(fd, address, length) < 0 || listen(fd, SOMAXCONN) < 0) {
+            close(fd);
+            return false;
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            close(fd);
+            return false;
+        }
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+
+        listenFd = fd;
+        this->hostName = hostName;
+        this->setup = setup;
+        return true;
+    }
+
+    void acceptSessions()
+    {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+
+            int slot = 0;
+            while (slot < MICROBOX_SERVER_MAX_SESSIONS && sessions[slot] != nullptr)
+                slot++;
+            if (slot == MICROBOX_SERVER_MAX_SESSIONS) {
+                close(fd);
+                continue;
+            }
+
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+            Session* session = new Session(fd);
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.ptr = session;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+                delete session;
+                close(fd);
+                continue;
+            }
+            session->slot = slot;
+            sessions[slot] = session;
+            activeSessions++;
+
+            session->microbox.begin(hostName, &session->port, false);
+            session->microbox.setBudget(budgetBytes, budgetCommands);
+            if (setup)
+                setup(session->microbox);
+            session->microbox.showPrompt();
+            session->port.flush();
+        }
+    }
+
+    // asks epoll to report when the socket can take the rest of the output; after the peer
+    // closed its side, or while the client is behind with its output, only that is waited for
+    void watchOutput(Session* session, bool enable)
+    {
+        struct epoll_event event;
+
+        event.events = 0;
+        if (!session->port.inputClosed() && !session->port.outputBlocked())
+            event.events |= EPOLLIN;
+        if (enable)
+            event.events |= EPOLLOUT;
+        if (session->watchedEvents == event.events)
+            return;
+        event.data.ptr = session;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, session->port.socket(), &event);
+        session->watchedEvents = event.events;
+    }
+
+    void closeSession(Session* session)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, session->port.socket(), nullptr);
+        close(session->port.socket());
+        sessions[session->slot] = nullptr;
+        activeSessions--;
+        if (session->backlog)
+            backlogSessions--;
+        delete session;
+    }
+
+private:
+    int listenFd = -1;
+    int epollFd = -1;
+    const char* hostName = nullptr;
+    session_setup_t setup;
+    Session* sessions[MICROBOX_SERVER_MAX_SESSIONS] = {nullptr};
+    int activeSessions = 0;
+    int backlogSessions = 0;
+    int nextBacklog = 0;
+    uint32_t pass = 0;
+    size_t budgetBytes = 0;
+    uint8_t budgetCommands = 0;
+};
+
+#endif // MICROBOX_EPOLL_SERVER_H
+
+#endif
@@ -0,0 +1,339 @@
+#ifdef __linux__
+
+#ifndef MICROBOX_RECORDING_PORT_HANDLER_H
+#define MICROBOX_RECORDING_PORT_HANDLER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "../port_handler.h"
+#include "../microBox.h"
+
+// Session recording: a file starts with "MBRC" and a version byte, followed by records of
+// one kind byte, the microseconds since the previous record and the payload length (both
+// as base-128 varints) and the payload.
+#define MICROBOX_RECORD_VERSION     1
+#define MICROBOX_RECORD_INPUT       0
+#define MICROBOX_RECORD_OUTPUT      1
+
+// replay moves on to the next input record after this many passes in a row without progress,
+// or when the console polls the empty input this often without returning, e.g. while it
+// waits for an XON that was recorded later
+#define MICROBOX_REPLAY_IDLE_PASSES 64
+#define MICROBOX_REPLAY_IDLE_POLLS  100000
+
+static inline uint64_t microBoxRecordMicros()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Wraps the real port and writes everything that passes through it to a recording file,
+// the session can then be played back on a host with ReplayPortHandler.
+class RecordingPortHandler : public PortHandler {
+public:
+    explicit RecordingPortHandler(PortHandler* port) : port(port)
+    {
+
+    }
+
+    ~RecordingPortHandler()
+    {
+        end();
+    }
+
+    bool begin(const char* path)
+    {
+        static const uint8_t header[] = { 'M', 'B', 'R', 'C', MICROBOX_RECORD_VERSION };
+
+        file = fopen(path, "wb");
+        if (file == nullptr)
+            return false;
+        fwrite(header, 1, sizeof(header), file);
+        lastRecord = microBoxRecordMicros();
+        return true;
+    }
+
+    void end()
+    {
+        if (file != nullptr)
+            fclose(file);
+        file = nullptr;
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        return writeBytes(&c, 1);
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        size_t written = port->writeBytes(buffer, size);
+        record(MICROBOX_RECORD_OUTPUT, buffer, written);
+        return written;
+    }
+
+    virtual int read() override
+    {
+        int c = port->read();
+        if (c >= 0) {
+            uint8_t byte = c;
+            record(MICROBOX_RECORD_INPUT, &byte, 1);
+        }
+        return c;
+    }
+
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        size_t received = port->readBytes(buffer, size);
+        record(MICROBOX_RECORD_INPUT, buffer, received);
+        return received;
+    }
+
+    virtual int available() override
+    {
+        return port->available();
+    }
+
+    virtual int availableForWrite() override
+    {
+        return port->availableForWrite();
+    }
+
+private:
+    void record(uint8_t kind, const uint8_t* data, size_t size)
+    {
+        if (file == nullptr || size == 0)
+            return;
+        uint64_t now = microBoxRecordMicros();
+        fputc(kind, file);
+        putVarint(now - lastRecord);
+        putVarint(size);
+        fwrite(data, 1, size, file);
+        lastRecord = now;
+    }
+
+    void putVarint(uint64_t value)
+    {
+        while (value >= 0x80) {
+            fputc((int)(value & 0x7F) | 0x80, file);
+            value >>= 7;
+        }
+        fputc((int)value, file);
+    }
+
+private:
+    PortHandler* port;
+    FILE* file = nullptr;
+    uint64_t lastRecord = 0;
+};
+
+typedef struct
+{
+    uint32_t inputRecords;
+    size_t inputBytes;
+    size_t outputBytes;
+    double seconds;
+    double avgLatencyUs;
+    double maxLatencyUs;
+    long firstMismatch;
+} MICROBOX_REPLAY_RESULT;
+
+// Plays a recording back through commandParser() as fast as possible. Begin the MicroBox
+// on this port and register the same commands as on the recorded device, then call run().
+class ReplayPortHandler : public PortHandler {
+public:
+    bool load(const char* path)
+    {
+        uint8_t header[5];
+
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr)
+            return false;
+        bool ok = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+            memcmp(header, "MBRC", 4) == 0 && header[4] == MICROBOX_RECORD_VERSION;
+
+        while (ok) {
+            int kind = fgetc(file);
+            if (kind == EOF)
+                break;
+            uint64_t delay, size;
+            ok = getVarint(file, delay) && getVarint(file, size) && kind <= MICROBOX_RECORD_OUTPUT;
+            if (!ok)
+                break;
+            std::vector<uint8_t>& target = kind == MICROBOX_RECORD_INPUT ? input : expected;
+            size_t offset = target.size();
+            target.resize(offset + size);
+            ok = fread(target.data() + offset, 1, size, file) == size;
+            if (kind == MICROBOX_RECORD_INPUT)
+                inputRecords.push_back(offset);
+        }
+        fclose(file);
+        inputRecords.push_back(input.size());
+        return ok;
+    }
+
+    // feeds the input records one by one, each one is processed completely before the next
+    // unless the console is stuck waiting for input that comes in a later record
+    MICROBOX_REPLAY_RESULT run(MicroBoxCore& microbox)
+    {
+        MICROBOX_REPLAY_RESULT result = {0};
+        double totalLatency = 0;
+        uint32_t measured = 0;
+
+        rxPosition = 0;
+        rxEnd = 0;
+        nextRecord = 0;
+        uint64_t start = microBoxRecordMicros();
+        while (nextRecord + 1 < inputRecords.size()) {
+            releaseRecord();
+            uint64_t fed = microBoxRecordMicros();
+            // a generator or queued output can need more passes after the input is taken
+            uint32_t idle = 0;
+            while (idle < MICROBOX_REPLAY_IDLE_PASSES) {
+                size_t before = rxPosition + output.size();
+                if (!microbox.commandParser() && microbox.pendingInput() == 0)
+                    break;
+                idle = rxPosition + output.size() == before ? idle + 1 : 0;
+            }
+            double latency = (double)(microBoxRecordMicros() - fed);
+            totalLatency += latency;
+            if (latency > result.maxLatencyUs)
+                result.maxLatencyUs = latency;
+            measured++;
+        }
+        result.inputRecords = nextRecord;
+        result.seconds = (microBoxRecordMicros() - start) / 1e6;
+        result.inputBytes = input.size();
+        result.outputBytes = output.size();
+        if (measured > 0)
+            result.avgLatencyUs = totalLatency / measured;
+
+        result.firstMismatch = -1;
+        for (size_t i = 0; i < output.size() || i < expected.size(); i++) {
+            if (i >= output.size() || i >= expected.size() || output[i] != expected[i]) {
+                result.firstMismatch = (long)i;
+                break;
+            }
+        }
+        return result;
+    }
+
+    // prints the numbers and, if the output differs from the recording, both versions around
+    // the first difference
+    void report(const MICROBOX_REPLAY_RESULT& result, FILE* out)
+    {
+        fprintf(out, "%u input records, %zu bytes in, %zu bytes out in %.3f s\n",
+            result.inputRecords, result.inputBytes, result.outputBytes, result.seconds);
+        if (result.seconds > 0)
+            fprintf(out, "%.0f bytes/s in, %.0f bytes/s out\n",
+                result.inputBytes / result.seconds, result.outputBytes / result.seconds);
+        fprintf(out, "latency per record: avg %.2f us, max %.2f us\n", result.avgLatencyUs, result.maxLatencyUs);
+
+        if (result.firstMismatch < 0) {
+            fprintf(out, "output matches the recording\n");
+            return;
+        }
+        fprintf(out, "output differs at byte %ld\n", result.firstMismatch);
+        printContext(out, "recorded", expected, result.firstMismatch);
+        printContext(out, "replayed", output, result.firstMismatch);
+    }
+
+    const std::vector<uint8_t>& replayedOutput() const
+    {
+        return output;
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        output.push_back(c);
+        return 1;
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        output.insert(output.end(), buffer, buffer + size);
+        return size;
+    }
+
+    virtual int read() override
+    {
+        if (rxPosition >= rxEnd)
+            return -1;
+        idlePolls = 0;
+        return input[rxPosition++];
+    }
+
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        if (size > rxEnd - rxPosition)
+            size = rxEnd - rxPosition;
+        memcpy(buffer, input.data() + rxPosition, size);
+        rxPosition += size;
+        if (size > 0)
+            idlePolls = 0;
+        return size;
+    }
+
+    virtual int available() override
+    {
+        // the console keeps asking without returning: it waits for a later record
+        if (rxPosition == rxEnd && ++idlePolls >= MICROBOX_REPLAY_IDLE_POLLS && nextRecord + 1 < inputRecords.size())
+            releaseRecord();
+        return (int)(rxEnd - rxPosition);
+    }
+
+private:
+    // the records lie one behind the other, the next one just extends the input
+    void releaseRecord()
+    {
+        rxEnd = inputRecords[++nextRecord];
+        idlePolls = 0;
+    }
+
+    static bool getVarint(FILE* file, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = fgetc(file);
+            if (c == EOF)
+                return false;
+            value |= (uint64_t)(c & 0x7F) << shift;
+            if (!(c & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    static void printContext(FILE* out, const char* label, const std::vector<uint8_t>& data, long position)
+    {
+        size_t from = position > 32 ? position - 32 : 0;
+        size_t to = position + 32 < (long)data.size() ? position + 32 : data.size();
+
+        fprintf(out, "%s: \"", label);
+        for (size_t i = from; i < to; i++) {
+            if (data[i] >= 0x20 && data[i] < 0x7F && data[i] != '"' && data[i] != '\\')
+                fputc(data[i], out);
+            else
+                fprintf(out, "\\x%02X", data[i]);
+        }
+        fprintf(out, "\"\n");
+    }
+
+private:
+    std::vector<uint8_t> input;
+    std::vector<size_t> inputRecords;
+    std::vector<uint8_t> expected;
+    std::vector<uint8_t> output;
+    size_t rxPosition = 0;
+    size_t rxEnd = 0;
+    size_t nextRecord = 0;
+    uint32_t idlePolls = 0;
+};
+
+#endif // MICROBOX_RECORDING_PORT_HANDLER_H
+
+#endif
@@ -0,0 +1,240 @@
+#ifdef __linux__
+
+#ifndef MICROBOX_SHM_PORT_HANDLER_H
+#define MICROBOX_SHM_PORT_HANDLER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include "../port_handler.h"
+
+// size of each direction's ring, must be a power of two
+#ifndef MICROBOX_SHM_RING_SIZE
+#define MICROBOX_SHM_RING_SIZE  65536
+#endif
+
+static_assert((MICROBOX_SHM_RING_SIZE & (MICROBOX_SHM_RING_SIZE - 1)) == 0, "MICROBOX_SHM_RING_SIZE must be a power of two");
+
+// Single-producer/single-consumer byte ring living in shared memory. The positions only grow,
+// the reader sleeps on a futex on 'written' when the ring is empty.
+struct ShmRing {
+    std::atomic<uint32_t> written;
+    std::atomic<uint32_t> read;
+    std::atomic<uint32_t> readerWaiting;
+    uint8_t data[MICROBOX_SHM_RING_SIZE];
+
+    size_t available() const
+    {
+        return written.load(std::memory_order_acquire) - read.load(std::memory_order_relaxed);
+    }
+
+    size_t freeSpace() const
+    {
+        return MICROBOX_SHM_RING_SIZE - (written.load(std::memory_order_relaxed) - read.load(std::memory_order_acquire));
+    }
+
+    size_t put(const uint8_t* buffer, size_t size)
+    {
+        uint32_t position = written.load(std::memory_order_relaxed);
+        size_t space = freeSpace();
+        if (size > space)
+            size = space;
+
+        size_t index = position % MICROBOX_SHM_RING_SIZE;
+        size_t first = MICROBOX_SHM_RING_SIZE - index;
+        if (first > size)
+            first = size;
+        memcpy(data + index, buffer, first);
+        memcpy(data, buffer + first, size - first);
+        written.store(position + size, std::memory_order_seq_cst);
+
+        if (size > 0 && readerWaiting.load(std::memory_order_seq_cst))
+            syscall(SYS_futex, &written, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        return size;
+    }
+
+    size_t get(uint8_t* buffer, size_t size)
+    {
+        uint32_t position = read.load(std::memory_order_relaxed);
+        size_t count = available();
+        if (size > count)
+            size = count;
+
+        size_t index = position % MICROBOX_SHM_RING_SIZE;
+        size_t first = MICROBOX_SHM_RING_SIZE - index;
+        if (first > size)
+            first = size;
+        memcpy(buffer, data + index, first);
+        memcpy(buffer + first, data, size - first);
+        read.store(position + size, std::memory_order_release);
+        return size;
+    }
+
+    // sleeps until the ring has data or timeoutMs is over, -1 waits forever; a wake-up without
+    // data, e.g. a late FUTEX_WAKE meant for an earlier wait, goes back to sleep for the rest
+    bool wait(int timeoutMs)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        uint32_t position = read.load(std::memory_order_relaxed);
+        readerWaiting.store(1, std::memory_order_seq_cst);
+        for (;;) {
+            uint32_t current = written.load(std::memory_order_seq_cst);
+            if (current != position)
+                break;
+            struct timespec timeout;
+            if (timeoutMs >= 0) {
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+                timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+                if (timeout.tv_nsec < 0) {
+                    timeout.tv_sec--;
+                    timeout.tv_nsec += 1000000000L;
+                }
+                if (timeout.tv_sec < 0)
+                    break;
+            }
+            syscall(SYS_futex, &written, FUTEX_WAIT, current, timeoutMs < 0 ? nullptr : &timeout, nullptr, 0);
+        }
+        readerWaiting.store(0, std::memory_order_relaxed);
+        return available() > 0;
+    }
+};
+
+struct ShmConsole {
+    ShmRing toDevice;
+    ShmRing fromDevice;
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs plain 32 bit atomics");
+
+// maps the named shared memory console, creates and clears it if 'create' is set
+static inline ShmConsole* microBoxShmMap(const char* name, bool create)
+{
+    int fd = shm_open(name, create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0600);
+    if (fd < 0)
+        return nullptr;
+    if (create && ftruncate(fd, sizeof(ShmConsole)) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* memory = mmap(nullptr, sizeof(ShmConsole), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return memory == MAP_FAILED ? nullptr : static_cast<ShmConsole*>(memory);
+}
+
+// Port for local control-plane tools: commands arrive through POSIX shared memory without
+// system calls or kernel copies, a futex wakes the sleeping side.
+class ShmPortHandler : public PortHandler {
+public:
+    ~ShmPortHandler()
+    {
+        if (console != nullptr)
+            munmap(console, sizeof(ShmConsole));
+        if (name != nullptr)
+            shm_unlink(name);
+    }
+
+    bool begin(const char* name)
+    {
+        console = microBoxShmMap(name, true);
+        if (console == nullptr)
+            return false;
+        this->name = name;
+        return true;
+    }
+
+    // lets the main loop sleep until a client sends something
+    bool waitForInput(int timeoutMs)
+    {
+        return console->toDevice.wait(timeoutMs);
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        return console->fromDevice.put(&c, 1);
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        return console->fromDevice.put(buffer, size);
+    }
+
+    virtual int read() override
+    {
+        uint8_t c;
+        return console->toDevice.get(&c, 1) ? c : -1;
+    }
+
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        return console->toDevice.get(buffer, size);
+    }
+
+    virtual int available() override
+    {
+        return (int)console->toDevice.available();
+    }
+
+    virtual int availableForWrite() override
+    {
+        return (int)console->fromDevice.freeSpace();
+    }
+
+private:
+    ShmConsole* console = nullptr;
+    const char* name = nullptr;
+};
+
+// Client side of ShmPortHandler, for the tools that drive the console.
+class ShmConsoleClient {
+public:
+    ~ShmConsoleClient()
+    {
+        if (console != nullptr)
+            munmap(console, sizeof(ShmConsole));
+    }
+
+    bool open(const char* name)
+    {
+        console = microBoxShmMap(name, false);
+        return console != nullptr;
+    }
+
+    // queues as much as fits, returns the number of bytes taken
+    size_t send(const void* data, size_t size)
+    {
+        return console->toDevice.put(static_cast<const uint8_t*>(data), size);
+    }
+
+    // takes what the console has printed, waits up to timeoutMs if there is nothing yet
+    size_t receive(void* buffer, size_t size, int timeoutMs)
+    {
+        if (console->fromDevice.available() == 0 && (timeoutMs == 0 || !console->fromDevice.wait(timeoutMs)))
+            return 0;
+        return console->fromDevice.get(static_cast<uint8_t*>(buffer), size);
+    }
+
+private:
+    ShmConsole* console = nullptr;
+};
+
+#endif // MICROBOX_SHM_PORT_HANDLER_H
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef MICROBOX_PORT_POLICY_H
+#define MICROBOX_PORT_POLICY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <utility>
+#include "microBox.h"
+#include "port_handler.h"
+
+// Port known while compiling, e.g. the one UART of a fixed board, written without virtual
+// functions: a port derives from PortPolicy<itself> and has write(), read() and available() as
+// plain members. writeBytes(), readBytes() and availableForWrite() are taken from here unless the
+// port has its own; their loops call the port's byte functions directly, so those are inlined.
+//
+// The console itself is compiled once for all ports and still reaches the port through a
+// PortHandler, with one virtual call per block of input or output (see PortPolicyHandler). What
+// a policy saves is the virtual call per byte of a port that only moves single bytes.
+//
+//     class Uart0 : public PortPolicy<Uart0> {
+//     public:
+//         size_t write(uint8_t c)     { while (!(UCSR0A & _BV(UDRE0))); UDR0 = c; return 1; }
+//         int read()                  { return (UCSR0A & _BV(RXC0)) ? UDR0 : -1; }
+//         int available()             { return (UCSR0A & _BV(RXC0)) ? 1 : 0; }
+//     };
+template<typename Port>
+class PortPolicy {
+public:
+    size_t writeBytes(const uint8_t* buffer, size_t size)
+    {
+        size_t written = 0;
+        while (written < size && self().write(buffer[written]))
+            written++;
+        return written;
+    }
+
+    // reads up to size bytes that are already received, must not wait for more
+    size_t readBytes(uint8_t* buffer, size_t size)
+    {
+        size_t received = 0;
+        while (received < size && self().available() > 0)
+            buffer[received++] = self().read();
+        return received;
+    }
+
+    // free space in the transmit buffer, -1 if the port can't tell
+    int availableForWrite()
+    {
+        return -1;
+    }
+
+private:
+    Port& self()
+    {
+        return static_cast<Port&>(*this);
+    }
+};
+
+// Puts a PortPolicy behind the PortHandler interface; the console calls it like any other port,
+// the byte loops of the block functions run without virtual calls.
+template<typename Port>
+class PortPolicyHandler final : public PortHandler {
+public:
+    explicit PortPolicyHandler(Port& port) : port(port)
+    {
+
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        return port.write(c);
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        return port.writeBytes(buffer, size);
+    }
+
+    virtual int read() override
+    {
+        return port.read();
+    }
+
+    virtual size_t readBytes(uint8_t* buffer, size_t size) override
+    {
+        return port.readBytes(buffer, size);
+    }
+
+    virtual int available() override
+    {
+        return port.available();
+    }
+
+    virtual int availableForWrite() override
+    {
+        return port.availableForWrite();
+    }
+
+private:
+    Port& port;
+};
+
+// Console on a fixed port: it holds the port, built from the constructor's arguments, and its
+// PortHandler. Ports chosen at runtime keep using MicroBox with a PortHandler.
+//
+//     MicroBoxOn<Uart0> microbox;
+//     microbox.begin("uno");
+template<typename Port, typename Config = MicroBoxDefaultConfig>
+class MicroBoxOn : public MicroBoxSized<Config> {
+public:
+    template<typename... Args>
+    explicit MicroBoxOn(Args&&... args) : fixedPort(std::forward<Args>(args)...), portHandler(fixedPort)
+    {
+
+    }
+
+    void begin(const char* hostName, bool showPrompt = true, bool localEcho = true)
+    {
+        MicroBoxCore::begin(hostName, &portHandler, showPrompt, localEcho);
+    }
+
+    Port& port()
+    {
+        return fixedPort;
+    }
+
+private:
+    Port fixedPort;
+    PortPolicyHandler<Port> portHandler;
+};
+
+#endif // MICROBOX_PORT_POLICY_H
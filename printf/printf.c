@@ -44,20 +44,27 @@
 #endif
 
 
-// 'ntoa' conversion buffer size, this must be big enough to hold one converted
-// numeric number including padded zeros (dynamically created on stack)
+// 'ntoa' conversion buffer size, this must be big enough to hold the digits of one
+// converted number, the zeros for precision and width are not kept in it (created on stack)
 // default: 32 byte
 #ifndef PRINTF_NTOA_BUFFER_SIZE
 #define PRINTF_NTOA_BUFFER_SIZE    32U
 #endif
 
-// 'ftoa' conversion buffer size, this must be big enough to hold one converted
-// float number including padded zeros (dynamically created on stack)
+// 'ftoa' fraction buffer size, up to this precision %f is done with integer arithmetic for
+// the usual values (dynamically created on stack)
 // default: 32 byte
 #ifndef PRINTF_FTOA_BUFFER_SIZE
 #define PRINTF_FTOA_BUFFER_SIZE    32U
 #endif
 
+// 'span' output buffer size, short pieces of output are collected here and handed
+// to the span output function together (created on stack)
+// default: 32 byte
+#ifndef PRINTF_SPAN_BUFFER_SIZE
+#define PRINTF_SPAN_BUFFER_SIZE    32U
+#endif
+
 // support for the floating point type (%f)
 // default: activated
 #ifndef PRINTF_DISABLE_SUPPORT_FLOAT
@@ -70,18 +77,19 @@
 #define PRINTF_SUPPORT_EXPONENTIAL
 #endif
 
+// define this to convert every double exactly and round it half to even, as glibc prints
+// it, through a base-1e9 bignum on the stack (about 350 bytes for IEEE doubles); otherwise
+// only the usual %f values are exact, %e and %g estimate the exponent and scale the value
+// with double arithmetic, which is faster but can be off in the last digit
+// default: undefined
+// #define PRINTF_EXACT_FLOAT
+
 // define the default floating point precision
 // default: 6 digits
 #ifndef PRINTF_DEFAULT_FLOAT_PRECISION
 #define PRINTF_DEFAULT_FLOAT_PRECISION  6U
 #endif
 
-// define the largest float suitable to print with %f
-// default: 1e9
-#ifndef PRINTF_MAX_FLOAT
-#define PRINTF_MAX_FLOAT  1e9
-#endif
-
 // support for the long long types (%llu or %p)
 // default: activated
 #ifndef PRINTF_DISABLE_SUPPORT_LONG_LONG
@@ -110,11 +118,14 @@
 #define FLAGS_LONG_LONG (1U <<  9U)
 #define FLAGS_PRECISION (1U << 10U)
 #define FLAGS_ADAPT_EXP (1U << 11U)
+#define FLAGS_EXPONENT  (1U << 12U)
+#define FLAGS_TRIM      (1U << 13U)
 
 
-// import float.h for DBL_MAX
+// import float.h for DBL_MAX and the double layout, math.h for frexp() and signbit()
 #if defined(PRINTF_SUPPORT_FLOAT)
 #include <float.h>
+#include <math.h>
 #endif
 
 
@@ -166,6 +177,43 @@ static inline void _out_fct(char character, void* buffer, size_t idx, size_t max
 }
 
 
+// wrapper (used as buffer) for span output function type
+typedef struct {
+  void  (*fct)(const char* span, size_t len, void* arg);
+  void* arg;
+  size_t len;
+  char  buf[PRINTF_SPAN_BUFFER_SIZE];
+} out_span_wrap_type;
+
+
+// internal span output: hand the collected characters over to the span output function
+static void _out_span_flush(out_span_wrap_type* wrap)
+{
+  if (wrap->len) {
+    wrap->fct(wrap->buf, wrap->len, wrap->arg);
+    wrap->len = 0U;
+  }
+}
+
+
+// internal span output function wrapper, single characters are collected, the termination flushes
+static void _out_span(char character, void* buffer, size_t idx, size_t maxlen)
+{
+  (void)idx; (void)maxlen;
+  // buffer is the span wrapper
+  out_span_wrap_type* wrap = (out_span_wrap_type*)buffer;
+  if (character) {
+    wrap->buf[wrap->len++] = character;
+    if (wrap->len == PRINTF_SPAN_BUFFER_SIZE) {
+      _out_span_flush(wrap);
+    }
+  }
+  else {
+    _out_span_flush(wrap);
+  }
+}
+
+
 // internal secure strlen
 // \return The length of the string (excluding the terminating 0) limited by 'maxsize'
 static inline unsigned int _strnlen_s(const char* str, size_t maxsize)
@@ -195,86 +243,202 @@ static unsigned int _atoi(const char** str)
 }
 
 
-// output the specified string in reverse, taking care of any zero-padding
-static size_t _out_rev(out_fct_type out, char* buffer, size_t idx, size_t maxlen, const char* buf, size_t len, unsigned int width, unsigned int flags)
+// output a run of characters, in one piece if the output function supports it
+static size_t _out_str(out_fct_type out, char* buffer, size_t idx, size_t maxlen, const char* str, size_t len)
 {
-  const size_t start_idx = idx;
-
-  // pad spaces up to given width
-  if (!(flags & FLAGS_LEFT) && !(flags & FLAGS_ZEROPAD)) {
-    for (size_t i = len; i < width; i++) {
-      out(' ', buffer, idx++, maxlen);
+  if (out == _out_span) {
+    out_span_wrap_type* wrap = (out_span_wrap_type*)(void*)buffer;
+    if (len > PRINTF_SPAN_BUFFER_SIZE - wrap->len) {
+      // too long to collect, pass it on directly
+      _out_span_flush(wrap);
+      wrap->fct(str, len, wrap->arg);
+      return idx + len;
+    }
+    for (size_t i = 0U; i < len; i++) {
+      wrap->buf[wrap->len++] = str[i];
     }
+    if (wrap->len == PRINTF_SPAN_BUFFER_SIZE) {
+      _out_span_flush(wrap);
+    }
+    return idx + len;
+  }
+  if (out == _out_buffer) {
+    for (size_t i = 0U; (i < len) && (idx + i < maxlen); i++) {
+      buffer[idx + i] = str[i];
+    }
+    return idx + len;
+  }
+  while (len--) {
+    out(*(str++), buffer, idx++, maxlen);
   }
+  return idx;
+}
 
-  // reverse string
-  while (len) {
-    out(buf[--len], buffer, idx++, maxlen);
+
+// output the given number of pad spaces
+static size_t _out_pad(out_fct_type out, char* buffer, size_t idx, size_t maxlen, size_t count)
+{
+  static const char spaces[] = "                ";
+  while (count) {
+    const size_t len = (count < sizeof(spaces) - 1U) ? count : sizeof(spaces) - 1U;
+    idx = _out_str(out, buffer, idx, maxlen, spaces, len);
+    count -= len;
   }
+  return idx;
+}
 
-  // append pad spaces up to given width
-  if (flags & FLAGS_LEFT) {
-    while (idx - start_idx < width) {
-      out(' ', buffer, idx++, maxlen);
+
+// output the front of a number of 'size' characters: the pad spaces up to the given width, the
+// sign or base prefix and the leading zeros, with the zero padding up to the width added to them
+static size_t _out_front(out_fct_type out, char* buffer, size_t idx, size_t maxlen, const char* prefix, size_t prefix_len, size_t zeros, size_t size, unsigned int width, unsigned int flags)
+{
+  if (!(flags & FLAGS_LEFT) && (size < width)) {
+    if (flags & FLAGS_ZEROPAD) {
+      zeros += width - size;
+    }
+    else {
+      idx = _out_pad(out, buffer, idx, maxlen, width - size);
     }
   }
+  idx = _out_str(out, buffer, idx, maxlen, prefix, prefix_len);
+  while (zeros--) {
+    out('0', buffer, idx++, maxlen);
+  }
+  return idx;
+}
+
 
+// output the pad spaces behind a left aligned number of 'size' characters
+static size_t _out_back(out_fct_type out, char* buffer, size_t idx, size_t maxlen, size_t size, unsigned int width, unsigned int flags)
+{
+  if ((flags & FLAGS_LEFT) && (size < width)) {
+    idx = _out_pad(out, buffer, idx, maxlen, width - size);
+  }
   return idx;
 }
 
 
-// internal itoa format
+// internal itoa format: sign, base prefix and the zeros for precision and width around the
+// reversed digits in buf
 static size_t _ntoa_format(out_fct_type out, char* buffer, size_t idx, size_t maxlen, char* buf, size_t len, bool negative, unsigned int base, unsigned int prec, unsigned int width, unsigned int flags)
 {
-  // pad leading zeros
-  if (!(flags & FLAGS_LEFT)) {
-    if (width && (flags & FLAGS_ZEROPAD) && (negative || (flags & (FLAGS_PLUS | FLAGS_SPACE)))) {
-      width--;
-    }
-    while ((len < prec) && (len < PRINTF_NTOA_BUFFER_SIZE)) {
-      buf[len++] = '0';
-    }
-    while ((flags & FLAGS_ZEROPAD) && (len < width) && (len < PRINTF_NTOA_BUFFER_SIZE)) {
-      buf[len++] = '0';
-    }
+  char prefix[3];
+  size_t prefix_len = 0U;
+
+  if (negative) {
+    prefix[prefix_len++] = '-';
+  }
+  else if (flags & FLAGS_PLUS) {
+    prefix[prefix_len++] = '+';  // ignore the space if the '+' exists
+  }
+  else if (flags & FLAGS_SPACE) {
+    prefix[prefix_len++] = ' ';
   }
 
-  // handle hash
+  // handle hash: octal starts with a zero digit, hex and binary get 0x, 0X or 0b
   if (flags & FLAGS_HASH) {
-    if (!(flags & FLAGS_PRECISION) && len && ((len == prec) || (len == width))) {
-      len--;
-      if (len && (base == 16U)) {
-        len--;
+    if (base == 8U) {
+      if ((prec <= len) && (!len || (buf[len - 1U] != '0'))) {
+        prec = (unsigned int)len + 1U;
       }
     }
-    if ((base == 16U) && !(flags & FLAGS_UPPERCASE) && (len < PRINTF_NTOA_BUFFER_SIZE)) {
-      buf[len++] = 'x';
+    else {
+      prefix[prefix_len++] = '0';
+      prefix[prefix_len++] = (base == 2U) ? 'b' : (flags & FLAGS_UPPERCASE) ? 'X' : 'x';
     }
-    else if ((base == 16U) && (flags & FLAGS_UPPERCASE) && (len < PRINTF_NTOA_BUFFER_SIZE)) {
-      buf[len++] = 'X';
+  }
+
+  const size_t zeros = (prec > len) ? prec - len : 0U;
+  const size_t size  = prefix_len + zeros + len;
+  idx = _out_front(out, buffer, idx, maxlen, prefix, prefix_len, zeros, size, width, flags);
+  while (len) {
+    out(buf[--len], buffer, idx++, maxlen);
+  }
+  return _out_back(out, buffer, idx, maxlen, size, width, flags);
+}
+
+
+// two digit lookup table for decimal conversion
+static const char _digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+
+// internal digit generation for 'long' type, the digits are stored reversed
+// decimal is converted two digits per division, other bases are powers of two and use shift/mask
+static size_t _ntoa_digits_long(char* buf, unsigned long value, unsigned long base, unsigned int flags)
+{
+  size_t len = 0U;
+
+  if (base == 10U) {
+    while ((value >= 100U) && (len + 2U <= PRINTF_NTOA_BUFFER_SIZE)) {
+      const unsigned int pair = (unsigned int)(value % 100U) * 2U;
+      value /= 100U;
+      buf[len++] = _digit_pairs[pair + 1U];
+      buf[len++] = _digit_pairs[pair];
     }
-    else if ((base == 2U) && (len < PRINTF_NTOA_BUFFER_SIZE)) {
-      buf[len++] = 'b';
+    if ((value >= 10U) && (len + 2U <= PRINTF_NTOA_BUFFER_SIZE)) {
+      buf[len++] = _digit_pairs[value * 2U + 1U];
+      buf[len++] = _digit_pairs[value * 2U];
     }
-    if (len < PRINTF_NTOA_BUFFER_SIZE) {
-      buf[len++] = '0';
+    else if (len < PRINTF_NTOA_BUFFER_SIZE) {
+      buf[len++] = (char)('0' + (value % 10U));
     }
   }
+  else {
+    const char* digits = (flags & FLAGS_UPPERCASE) ? "0123456789ABCDEF" : "0123456789abcdef";
+    const unsigned int shift = (base == 16U) ? 4U : (base == 8U) ? 3U : 1U;
+    do {
+      buf[len++] = digits[value & (base - 1U)];
+      value >>= shift;
+    } while (value && (len < PRINTF_NTOA_BUFFER_SIZE));
+  }
+
+  return len;
+}
 
-  if (len < PRINTF_NTOA_BUFFER_SIZE) {
-    if (negative) {
-      buf[len++] = '-';
+
+// internal digit generation for 'long long' type, see _ntoa_digits_long()
+#if defined(PRINTF_SUPPORT_LONG_LONG)
+static size_t _ntoa_digits_long_long(char* buf, unsigned long long value, unsigned long long base, unsigned int flags)
+{
+  size_t len = 0U;
+
+  if (base == 10U) {
+    while ((value >= 100U) && (len + 2U <= PRINTF_NTOA_BUFFER_SIZE)) {
+      const unsigned int pair = (unsigned int)(value % 100U) * 2U;
+      value /= 100U;
+      buf[len++] = _digit_pairs[pair + 1U];
+      buf[len++] = _digit_pairs[pair];
     }
-    else if (flags & FLAGS_PLUS) {
-      buf[len++] = '+';  // ignore the space if the '+' exists
+    if ((value >= 10U) && (len + 2U <= PRINTF_NTOA_BUFFER_SIZE)) {
+      buf[len++] = _digit_pairs[value * 2U + 1U];
+      buf[len++] = _digit_pairs[value * 2U];
     }
-    else if (flags & FLAGS_SPACE) {
-      buf[len++] = ' ';
+    else if (len < PRINTF_NTOA_BUFFER_SIZE) {
+      buf[len++] = (char)('0' + (value % 10U));
     }
   }
+  else {
+    const char* digits = (flags & FLAGS_UPPERCASE) ? "0123456789ABCDEF" : "0123456789abcdef";
+    const unsigned int shift = (base == 16U) ? 4U : (base == 8U) ? 3U : 1U;
+    do {
+      buf[len++] = digits[value & (base - 1U)];
+      value >>= shift;
+    } while (value && (len < PRINTF_NTOA_BUFFER_SIZE));
+  }
 
-  return _out_rev(out, buffer, idx, maxlen, buf, len, width, flags);
+  return len;
 }
+#endif  // PRINTF_SUPPORT_LONG_LONG
 
 
 // internal itoa for 'long' type
@@ -283,18 +447,14 @@ static size_t _ntoa_long(out_fct_type out, char* buffer, size_t idx, size_t maxl
   char buf[PRINTF_NTOA_BUFFER_SIZE];
   size_t len = 0U;
 
-  // no hash for 0 values
-  if (!value) {
+  // no hash prefix for 0 values
+  if (!value && (base != 8U)) {
     flags &= ~FLAGS_HASH;
   }
 
   // write if precision != 0 and value is != 0
   if (!(flags & FLAGS_PRECISION) || value) {
-    do {
-      const char digit = (char)(value % base);
-      buf[len++] = digit < 10 ? '0' + digit : (flags & FLAGS_UPPERCASE ? 'A' : 'a') + digit - 10;
-      value /= base;
-    } while (value && (len < PRINTF_NTOA_BUFFER_SIZE));
+    len = _ntoa_digits_long(buf, value, base, flags);
   }
 
   return _ntoa_format(out, buffer, idx, maxlen, buf, len, negative, (unsigned int)base, prec, width, flags);
@@ -308,18 +468,14 @@ static size_t _ntoa_long_long(out_fct_type out, char* buffer, size_t idx, size_t
   char buf[PRINTF_NTOA_BUFFER_SIZE];
   size_t len = 0U;
 
-  // no hash for 0 values
-  if (!value) {
+  // no hash prefix for 0 values
+  if (!value && (base != 8U)) {
     flags &= ~FLAGS_HASH;
   }
 
   // write if precision != 0 and value is != 0
   if (!(flags & FLAGS_PRECISION) || value) {
-    do {
-      const char digit = (char)(value % base);
-      buf[len++] = digit < 10 ? '0' + digit : (flags & FLAGS_UPPERCASE ? 'A' : 'a') + digit - 10;
-      value /= base;
-    } while (value && (len < PRINTF_NTOA_BUFFER_SIZE));
+    len = _ntoa_digits_long_long(buf, value, base, flags);
   }
 
   return _ntoa_format(out, buffer, idx, maxlen, buf, len, negative, (unsigned int)base, prec, width, flags);
@@ -329,247 +485,518 @@ static size_t _ntoa_long_long(out_fct_type out, char* buffer, size_t idx, size_t
 
 #if defined(PRINTF_SUPPORT_FLOAT)
 
-#if defined(PRINTF_SUPPORT_EXPONENTIAL)
-// forward declaration so that _ftoa can switch to exp notation for values > PRINTF_MAX_FLOAT
+#if defined(PRINTF_EXACT_FLOAT)
+// 'dtoa' word count: a double is m * 2^e, its exact decimal value m * 5^-e with the decimal point
+// moved -e places has about 0.7 digits per bit of exponent range, kept in base 10^9 words
+#define PRINTF_DTOA_WORDS  (((DBL_MANT_DIG - DBL_MIN_EXP) * 7 / 10 + DBL_MANT_DIG * 3 / 10 + 1) / 9 + 2)
+
+// exact decimal digits of a non-negative double (dynamically created on stack)
+typedef struct {
+  uint32_t word[PRINTF_DTOA_WORDS];   // least significant word first
+  int      used;                      // words in use
+  int      digits;                    // decimal digits in the words
+  int      shift;                     // the digit for 10^0 is digit number 'shift' from the right
+  int      exp10;                     // power of ten of the most significant digit
+  int      cached;                    // the word split into digit[], -1 for none
+  char     digit[9];                  // the digits of word[cached], least significant first
+} dtoa_type;
+
+
+static const uint32_t _pow10_word[9] = { 1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U };
+#else
+// powers of 10
+static const double _pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16 };
+#endif  // PRINTF_EXACT_FLOAT
+
+
+#if defined(PRINTF_SUPPORT_EXPONENTIAL) && !defined(PRINTF_EXACT_FLOAT)
+// forward declaration so that _ftoa can hand %e and %g over
 static size_t _etoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width, unsigned int flags);
 #endif
 
 
-// internal ftoa for fixed decimal floating point
-static size_t _ftoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width, unsigned int flags)
+// internal split of a finite, non-negative double into mantissa * 2^exp2
+static uint64_t _ftoa_split(double value, int* exp2)
 {
-  char buf[PRINTF_FTOA_BUFFER_SIZE];
-  size_t len  = 0U;
-  double diff = 0.0;
-
-  // powers of 10
-  static const double pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
-
-  // test for special values
-  if (value != value)
-    return _out_rev(out, buffer, idx, maxlen, "nan", 3, width, flags);
-  if (value < -DBL_MAX)
-    return _out_rev(out, buffer, idx, maxlen, "fni-", 4, width, flags);
-  if (value > DBL_MAX)
-    return _out_rev(out, buffer, idx, maxlen, (flags & FLAGS_PLUS) ? "fni+" : "fni", (flags & FLAGS_PLUS) ? 4U : 3U, width, flags);
+#if (DBL_MANT_DIG == 53) && (DBL_MIN_EXP == -1021) && (DBL_MAX_EXP == 1024)
+  // IEEE 754 double, taken from the bits
+  union {
+    uint64_t U;
+    double   F;
+  } conv;
 
-  // test for very large values
-  // standard printf behavior is to print EVERY whole number digit -- which could be 100s of characters overflowing your buffers == bad
-  if ((value > PRINTF_MAX_FLOAT) || (value < -PRINTF_MAX_FLOAT)) {
-#if defined(PRINTF_SUPPORT_EXPONENTIAL)
-    return _etoa(out, buffer, idx, maxlen, value, prec, width, flags);
-#else
+  conv.F = value;
+  const int biased = (int)((conv.U >> 52U) & 0x07FFU);
+  if (!conv.U) {
+    *exp2 = 0;
     return 0U;
+  }
+  *exp2 = (biased ? biased : 1) - 1075;
+  return (conv.U & ((1ULL << 52U) - 1U)) | (biased ? (1ULL << 52U) : 0U);
+#else
+  const uint64_t mantissa = (uint64_t)ldexp(frexp(value, exp2), DBL_MANT_DIG);
+  *exp2 = mantissa ? *exp2 - DBL_MANT_DIG : 0;
+  return mantissa;
 #endif
+}
+
+
+#if defined(PRINTF_EXACT_FLOAT)
+// internal exact conversion of a non-negative mantissa * 2^exp2
+static void _dtoa_init(dtoa_type* d, uint64_t mantissa, int exp2)
+{
+  d->used   = 0;
+  d->shift  = 0;
+  d->cached = -1;
+  if (!mantissa) {
+    d->word[d->used++] = 0U;
+    d->digits = 1;
+    d->exp10  = 0;
+    return;
+  }
+  while (!(mantissa & 1U)) {
+    mantissa >>= 1U;
+    exp2++;
+  }
+  do {
+    d->word[d->used++] = (uint32_t)(mantissa % 1000000000U);
+    mantissa /= 1000000000U;
+  } while (mantissa);
+
+  // multiply by 2^e, or by 5^-e and move the decimal point; up to 2^30 or 5^13 at a time keeps
+  // the products in 64 bits
+  if (exp2 < 0) {
+    d->shift = -exp2;
+  }
+  int left = (exp2 < 0) ? -exp2 : exp2;
+  while (left > 0) {
+    const int steps = (exp2 < 0) ? ((left < 13) ? left : 13) : ((left < 30) ? left : 30);
+    uint32_t factor = 1U;
+    for (int i = 0; i < steps; i++) {
+      factor *= (exp2 < 0) ? 5U : 2U;
+    }
+    uint64_t carry = 0U;
+    for (int i = 0; i < d->used; i++) {
+      carry += (uint64_t)d->word[i] * factor;
+      d->word[i] = (uint32_t)(carry % 1000000000U);
+      carry /= 1000000000U;
+    }
+    while (carry) {
+      d->word[d->used++] = (uint32_t)(carry % 1000000000U);
+      carry /= 1000000000U;
+    }
+    left -= steps;
   }
 
-  // test for negative
-  bool negative = false;
-  if (value < 0) {
-    negative = true;
-    value = 0 - value;
+  int top = 1;
+  while ((top < 9) && (d->word[d->used - 1] >= _pow10_word[top])) {
+    top++;
   }
+  d->digits = top + 9 * (d->used - 1);
+  d->exp10  = d->digits - 1 - d->shift;
+}
 
-  // set default precision, if not set explicitly
-  if (!(flags & FLAGS_PRECISION)) {
-    prec = PRINTF_DEFAULT_FLOAT_PRECISION;
+
+// internal digit for 10^power, 0 outside the digits; the word of the digit is split up once for
+// the neighbouring digits
+static unsigned int _dtoa_digit(dtoa_type* d, int power)
+{
+  const int pos = d->shift + power;
+  if ((pos < 0) || (pos >= d->digits)) {
+    return 0U;
   }
-  // limit precision to 9, cause a prec >= 10 can lead to overflow errors
-  while ((len < PRINTF_FTOA_BUFFER_SIZE) && (prec > 9U)) {
-    buf[len++] = '0';
-    prec--;
+  if (d->cached != pos / 9) {
+    uint32_t word = d->word[pos / 9];
+    for (int i = 0; i < 9; i++) {
+      d->digit[i] = (char)(word % 10U);
+      word /= 10U;
+    }
+    d->cached = pos / 9;
   }
+  return (unsigned int)d->digit[pos % 9];
+}
 
-  int whole = (int)value;
-  double tmp = (value - whole) * pow10[prec];
-  unsigned long frac = (unsigned long)tmp;
-  diff = tmp - frac;
 
-  if (diff > 0.5) {
-    ++frac;
-    // handle rollover, e.g. case 0.99 with prec 1 is 1.0
-    if (frac >= pow10[prec]) {
-      frac = 0;
-      ++whole;
+// internal test for non-zero digits below 10^power
+static bool _dtoa_below(const dtoa_type* d, int power)
+{
+  int pos = d->shift + power;
+  if (pos > d->digits) {
+    pos = d->digits;
+  }
+  for (int i = 0; i < pos / 9; i++) {
+    if (d->word[i]) {
+      return true;
     }
   }
-  else if (diff < 0.5) {
+  return (pos > 0) && (pos % 9) && (d->word[pos / 9] % _pow10_word[pos % 9]);
+}
+
+
+// internal rounding to a multiple of 10^at, half to even
+// \return The power of the digit that goes up by one, the 9s below it become 0s; at - 1 to round down
+static int _dtoa_round(dtoa_type* d, int at)
+{
+  const unsigned int next = _dtoa_digit(d, at - 1);
+  if ((next < 5U) || ((next == 5U) && !_dtoa_below(d, at - 1) && !(_dtoa_digit(d, at) & 1U))) {
+    return at - 1;
   }
-  else if ((frac == 0U) || (frac & 1U)) {
-    // if halfway, round up if odd OR if last digit is 0
-    ++frac;
+  // ends at the latest on the 0 above the most significant digit
+  while (_dtoa_digit(d, at) == 9U) {
+    at++;
   }
+  return at;
+}
 
-  if (prec == 0U) {
-    diff = value - (double)whole;
-    if ((!(diff < 0.5) || (diff > 0.5)) && (whole & 1)) {
-      // exactly 0.5 and ODD, then round up
-      // 1.5 -> 2, but 2.5 -> 2
-      ++whole;
-    }
+
+// internal digit for 10^power after the rounding at 10^at that increments the digit for 10^up
+static char _dtoa_rounded(dtoa_type* d, int power, int at, int up)
+{
+  if ((up < at) || (power > up)) {
+    return (char)('0' + _dtoa_digit(d, power));
+  }
+  return (power == up) ? (char)('1' + _dtoa_digit(d, power)) : '0';
+}
+#endif  // PRINTF_EXACT_FLOAT
+
+
+// output a fixed point number: the whole part, the decimal point and the fraction digits in
+// frac_buf followed by 'zeros' more zeros
+static size_t _out_fixed(out_fct_type out, char* buffer, size_t idx, size_t maxlen, const char* prefix, size_t prefix_len, uint64_t whole, const char* frac_buf, size_t frac_len, size_t zeros, unsigned int width, unsigned int flags)
+{
+  char whole_buf[20];
+
+  // do whole part, number is reversed, two digits at a time
+  size_t len = 0U;
+  while (whole >= 100U) {
+    const unsigned int pair = (unsigned int)(whole % 100U) * 2U;
+    whole /= 100U;
+    whole_buf[len++] = _digit_pairs[pair + 1U];
+    whole_buf[len++] = _digit_pairs[pair];
+  }
+  if (whole >= 10U) {
+    whole_buf[len++] = _digit_pairs[whole * 2U + 1U];
+    whole_buf[len++] = _digit_pairs[whole * 2U];
   }
   else {
-    unsigned int count = prec;
-    // now do fractional part, as an unsigned number
-    while (len < PRINTF_FTOA_BUFFER_SIZE) {
-      --count;
-      buf[len++] = (char)(48U + (frac % 10U));
-      if (!(frac /= 10U)) {
-        break;
+    whole_buf[len++] = (char)('0' + whole);
+  }
+
+  const bool   decimal = frac_len || zeros || (flags & FLAGS_HASH);
+  const size_t size    = prefix_len + len + (decimal ? 1U : 0U) + frac_len + zeros;
+  idx = _out_front(out, buffer, idx, maxlen, prefix, prefix_len, 0U, size, width, flags);
+  while (len) {
+    out(whole_buf[--len], buffer, idx++, maxlen);
+  }
+  if (decimal) {
+    out('.', buffer, idx++, maxlen);
+  }
+  idx = _out_str(out, buffer, idx, maxlen, frac_buf, frac_len);
+  while (zeros--) {
+    out('0', buffer, idx++, maxlen);
+  }
+  return _out_back(out, buffer, idx, maxlen, size, width, flags);
+}
+
+
+// internal ftoa for floating point: %f, with FLAGS_EXPONENT %e and with FLAGS_ADAPT_EXP %g; with
+// PRINTF_EXACT_FLOAT the digits are exact and rounded half to even, as glibc prints them
+static size_t _ftoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width, unsigned int flags)
+{
+  char prefix[2];
+  size_t prefix_len = 0U;
+
+  if (signbit(value)) {
+    prefix[prefix_len++] = '-';
+    value = -value;
+  }
+  else if (flags & FLAGS_PLUS) {
+    prefix[prefix_len++] = '+';  // ignore the space if the '+' exists
+  }
+  else if (flags & FLAGS_SPACE) {
+    prefix[prefix_len++] = ' ';
+  }
+
+  // test for special values, they are padded with spaces only
+  if ((value != value) || (value > DBL_MAX)) {
+    const char* text = (value != value) ? ((flags & FLAGS_UPPERCASE) ? "NAN" : "nan") : ((flags & FLAGS_UPPERCASE) ? "INF" : "inf");
+    flags &= ~FLAGS_ZEROPAD;
+    idx = _out_front(out, buffer, idx, maxlen, prefix, prefix_len, 0U, prefix_len + 3U, width, flags);
+    idx = _out_str(out, buffer, idx, maxlen, text, 3U);
+    return _out_back(out, buffer, idx, maxlen, prefix_len + 3U, width, flags);
+  }
+
+  // set default precision, if not set explicitly
+  if (!(flags & FLAGS_PRECISION)) {
+    prec = PRINTF_DEFAULT_FLOAT_PRECISION;
+  }
+
+  int exp2;
+  const uint64_t mantissa = _ftoa_split(value, &exp2);
+
+#if !defined(PRINTF_EXACT_FLOAT)
+  // %e, %g and %f beyond 2^64 from the estimated exponent
+  if ((flags & (FLAGS_EXPONENT | FLAGS_ADAPT_EXP)) || (exp2 > 64 - DBL_MANT_DIG)) {
+#if defined(PRINTF_SUPPORT_EXPONENTIAL)
+    return _etoa(out, buffer, idx, maxlen, prefix_len && (prefix[0] == '-') ? -value : value, prec, width, flags);
+#else
+    return idx;
+#endif
+  }
+#endif
+
+  // the usual %f case: the whole part fits in 64 bits and the fraction in 60, the digits and the
+  // rounding come exactly out of integer arithmetic
+  if (!(flags & (FLAGS_EXPONENT | FLAGS_ADAPT_EXP)) && (exp2 >= -60) && (exp2 <= 64 - DBL_MANT_DIG) && (prec <= PRINTF_FTOA_BUFFER_SIZE)) {
+    char frac_buf[PRINTF_FTOA_BUFFER_SIZE];
+    const unsigned int bits = (exp2 < 0) ? (unsigned int)-exp2 : 0U;
+    uint64_t whole = (exp2 < 0) ? mantissa >> bits : mantissa << exp2;
+    uint64_t frac  = (exp2 < 0) ? mantissa & ((1ULL << bits) - 1U) : 0U;
+    size_t i;
+
+    for (i = 0U; i < prec; i++) {
+      frac *= 10U;
+      frac_buf[i] = (char)('0' + (frac >> bits));
+      frac &= (1ULL << bits) - 1U;
+    }
+    if (bits && ((frac > (1ULL << (bits - 1U))) || ((frac == (1ULL << (bits - 1U))) && (prec ? (frac_buf[prec - 1U] & 1) : (int)(whole & 1U))))) {
+      // round up, e.g. case 0.99 with prec 1 is 1.0
+      for (i = prec; i && (frac_buf[i - 1U] == '9'); i--) {
+        frac_buf[i - 1U] = '0';
+      }
+      if (i) {
+        frac_buf[i - 1U]++;
       }
+      else {
+        whole++;
+      }
+    }
+
+    while ((flags & FLAGS_TRIM) && prec && (frac_buf[prec - 1U] == '0')) {
+      prec--;
     }
-    // add extra 0s
-    while ((len < PRINTF_FTOA_BUFFER_SIZE) && (count-- > 0U)) {
-      buf[len++] = '0';
+    return _out_fixed(out, buffer, idx, maxlen, prefix, prefix_len, whole, frac_buf, prec, 0U, width, flags);
+  }
+
+#if defined(PRINTF_EXACT_FLOAT)
+  dtoa_type d;
+  _dtoa_init(&d, mantissa, exp2);
+
+#if defined(PRINTF_SUPPORT_EXPONENTIAL)
+  // in "%g" mode, "prec" is the number of significant digits; the exponent after rounding to
+  // them picks the "%e" or the "%f" form
+  if (flags & FLAGS_ADAPT_EXP) {
+    const int digits = prec ? (int)prec : 1;
+    const int exp10  = (_dtoa_round(&d, d.exp10 - digits + 1) > d.exp10) ? d.exp10 + 1 : d.exp10;
+    if ((exp10 < -4) || (exp10 >= digits)) {
+      flags |= FLAGS_EXPONENT;
+      prec = (unsigned int)(digits - 1);
     }
-    if (len < PRINTF_FTOA_BUFFER_SIZE) {
-      // add decimal
-      buf[len++] = '.';
+    else {
+      prec = (unsigned int)(digits - 1 - exp10);
     }
   }
+#endif
 
-  // do whole part, number is reversed
-  while (len < PRINTF_FTOA_BUFFER_SIZE) {
-    buf[len++] = (char)(48 + (whole % 10));
-    if (!(whole /= 10)) {
-      break;
+  // the digits from 10^top down to 10^low after rounding at 10^at
+  int top, low, up;
+  if (flags & FLAGS_EXPONENT) {
+    low = d.exp10 - (int)prec;
+    up  = _dtoa_round(&d, low);
+    top = (up > d.exp10) ? d.exp10 + 1 : d.exp10;
+  }
+  else {
+    low = -(int)prec;
+    up  = _dtoa_round(&d, low);
+    top = (d.exp10 > 0) ? d.exp10 : 0;
+    if (up > top) {
+      top = up;
     }
   }
+  const int at = low;
+  if ((flags & FLAGS_EXPONENT) && (top > d.exp10)) {
+    // rounded up to the next power of ten, the mantissa keeps its number of digits
+    low++;
+  }
 
-  // pad leading zeros
-  if (!(flags & FLAGS_LEFT) && (flags & FLAGS_ZEROPAD)) {
-    if (width && (negative || (flags & (FLAGS_PLUS | FLAGS_SPACE)))) {
-      width--;
+  // "%g" drops the trailing zeros of the fraction
+  const int point = (flags & FLAGS_EXPONENT) ? top : 0;
+  if ((flags & FLAGS_ADAPT_EXP) && !(flags & FLAGS_HASH)) {
+    while ((low < point) && (_dtoa_rounded(&d, low, at, up) == '0')) {
+      low++;
     }
-    while ((len < width) && (len < PRINTF_FTOA_BUFFER_SIZE)) {
-      buf[len++] = '0';
+  }
+
+  // the exponent, "%+03d"
+  char exp_buf[6];
+  size_t exp_len = 0U;
+  if (flags & FLAGS_EXPONENT) {
+    unsigned int exp_value = (unsigned int)((top < 0) ? -top : top);
+    exp_buf[exp_len++] = (flags & FLAGS_UPPERCASE) ? 'E' : 'e';
+    exp_buf[exp_len++] = (top < 0) ? '-' : '+';
+    if (exp_value >= 100U) {
+      exp_buf[exp_len++] = (char)('0' + exp_value / 100U);
+      exp_value %= 100U;
     }
+    exp_buf[exp_len++] = _digit_pairs[exp_value * 2U];
+    exp_buf[exp_len++] = _digit_pairs[exp_value * 2U + 1U];
   }
 
-  if (len < PRINTF_FTOA_BUFFER_SIZE) {
-    if (negative) {
-      buf[len++] = '-';
+  const bool   decimal = (low < point) || (flags & FLAGS_HASH);
+  const size_t size    = prefix_len + (size_t)(top - low + 1) + (decimal ? 1U : 0U) + exp_len;
+  idx = _out_front(out, buffer, idx, maxlen, prefix, prefix_len, 0U, size, width, flags);
+  for (int power = top; power >= low; power--) {
+    out(_dtoa_rounded(&d, power, at, up), buffer, idx++, maxlen);
+    if ((power == point) && decimal) {
+      out('.', buffer, idx++, maxlen);
+    }
+  }
+  idx = _out_str(out, buffer, idx, maxlen, exp_buf, exp_len);
+  return _out_back(out, buffer, idx, maxlen, size, width, flags);
+#else
+  // the rest of %f with double arithmetic: small values and long precisions get 16 computed
+  // fraction digits, further ones are zeros
+  char frac_buf[16];
+  unsigned int digits = (prec > 16U) ? 16U : prec;
+  uint64_t whole = (uint64_t)value;
+  const double tmp = (value - (double)whole) * _pow10[digits];
+  uint64_t frac = (uint64_t)tmp;
+  const double diff = tmp - (double)frac;
+
+  // round half to even, e.g. case 0.99 with prec 1 is 1.0
+  if ((diff > 0.5) || ((diff == 0.5) && (digits ? (frac & 1U) : (whole & 1U)))) {
+    if (digits) {
+      frac++;
+      if (frac >= (uint64_t)_pow10[digits]) {
+        frac = 0U;
+        whole++;
+      }
     }
-    else if (flags & FLAGS_PLUS) {
-      buf[len++] = '+';  // ignore the space if the '+' exists
+    else {
+      whole++;
     }
-    else if (flags & FLAGS_SPACE) {
-      buf[len++] = ' ';
+  }
+  for (unsigned int i = digits; i > 0U; i--) {
+    frac_buf[i - 1U] = (char)('0' + frac % 10U);
+    frac /= 10U;
+  }
+  unsigned int zeros = prec - digits;
+  if (flags & FLAGS_TRIM) {
+    zeros = 0U;
+    while (digits && (frac_buf[digits - 1U] == '0')) {
+      digits--;
     }
   }
+  return _out_fixed(out, buffer, idx, maxlen, prefix, prefix_len, whole, frac_buf, digits, zeros, width, flags);
+#endif  // PRINTF_EXACT_FLOAT
+}
 
-  return _out_rev(out, buffer, idx, maxlen, buf, len, width, flags);
+
+#if defined(PRINTF_SUPPORT_EXPONENTIAL) && !defined(PRINTF_EXACT_FLOAT)
+// internal value / 10^exp10, the power is built from the exact powers 10^(2^i), so it is exact up
+// to 10^22 and off by a few units in the last place beyond
+static double _etoa_scale(double value, int exp10)
+{
+  static const double pow10_binary[] = { 1e1, 1e2, 1e4, 1e8, 1e16, 1e32, 1e64, 1e128, 1e256 };
+  double power = 1.0;
+
+  for (unsigned int n = (unsigned int)((exp10 < 0) ? -exp10 : exp10), i = 0U; n; n >>= 1U, i++) {
+    if (n & 1U) {
+      power *= pow10_binary[i];
+    }
+  }
+  return (exp10 < 0) ? value * power : value / power;
 }
 
 
-#if defined(PRINTF_SUPPORT_EXPONENTIAL)
 // internal ftoa variant for exponential floating-point type, contributed by Martijn Jasperse <m.jasperse@gmail.com>
 static size_t _etoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width, unsigned int flags)
 {
-  // check for NaN and special values
-  if ((value != value) || (value > DBL_MAX) || (value < -DBL_MAX)) {
-    return _ftoa(out, buffer, idx, maxlen, value, prec, width, flags);
-  }
-
   // determine the sign
-  const bool negative = value < 0;
+  const bool negative = signbit(value);
   if (negative) {
     value = -value;
   }
 
-  // default precision
-  if (!(flags & FLAGS_PRECISION)) {
-    prec = PRINTF_DEFAULT_FLOAT_PRECISION;
+  // a denormal is moved up into the normal range first
+  const int expshift = ((value < DBL_MIN) && (value != 0.0)) ? -18 : 0;
+  if (expshift) {
+    value *= 1e18;
   }
 
-  // determine the decimal exponent
-  // based on the algorithm by David Gay (https://www.ampl.com/netlib/fp/dtoa.c)
-  union {
-    uint64_t U;
-    double   F;
-  } conv;
-
-  conv.F = value;
-  int exp2 = (int)((conv.U >> 52U) & 0x07FFU) - 1023;           // effectively log2
-  conv.U = (conv.U & ((1ULL << 52U) - 1U)) | (1023ULL << 52U);  // drop the exponent so conv.F is now in [1,2)
-  // now approximate log10 from the log2 integer part and an expansion of ln around 1.5
-  int expval = (int)(0.1760912590558 + exp2 * 0.301029995663981 + (conv.F - 1.5) * 0.289529654602168);
-  // now we want to compute 10^expval but we want to be sure it won't overflow
-  exp2 = (int)(expval * 3.321928094887362 + 0.5);
-  const double z  = expval * 2.302585092994046 - exp2 * 0.6931471805599453;
-  const double z2 = z * z;
-  conv.U = (uint64_t)(exp2 + 1023) << 52U;
-  // compute exp(z) using continued fractions, see https://en.wikipedia.org/wiki/Exponential_function#Continued_fractions_for_ex
-  conv.F *= 1 + 2 * z / (2 - z + (z2 / (6 + (z2 / (10 + z2 / 14)))));
-  // correct for rounding errors
-  if (value < conv.F) {
-    expval--;
-    conv.F /= 10;
+  // determine the decimal exponent: approximate log10 from the log2 integer part and an
+  // expansion of ln around 1.5, then correct it on the scaled value
+  double scaled = value;
+  int expval = 0;
+  if (value != 0.0) {
+    union {
+      uint64_t U;
+      double   F;
+    } conv;
+
+    conv.F = value;
+    const int exp2 = (int)((conv.U >> 52U) & 0x07FFU) - 1023;     // effectively log2
+    conv.U = (conv.U & ((1ULL << 52U) - 1U)) | (1023ULL << 52U);  // drop the exponent so conv.F is now in [1,2)
+    expval = (int)(0.1760912590558 + exp2 * 0.301029995663981 + (conv.F - 1.5) * 0.289529654602168);
+    scaled = _etoa_scale(value, expval);
+    while (scaled < 1.0) {
+      scaled = _etoa_scale(value, --expval);
+    }
+    while (scaled >= 10.0) {
+      scaled = _etoa_scale(value, ++expval);
+    }
+    // a mantissa that rounds up to 10 moves to the next power of ten
+    const unsigned int digits = (flags & FLAGS_ADAPT_EXP) ? (prec ? prec - 1U : 0U) : prec;
+    if ((digits <= 16U) && (scaled + 0.5 / _pow10[digits] >= 10.0)) {
+      scaled = _etoa_scale(value, ++expval);
+    }
+    expval += expshift;
   }
 
-  // the exponent format is "%+03d" and largest value is "307", so set aside 4-5 characters
-  unsigned int minwidth = ((expval < 100) && (expval > -100)) ? 4U : 5U;
-
-  // in "%g" mode, "prec" is the number of *significant figures* not decimals
+  // in "%g" mode, "prec" is the number of *significant figures* not decimals, the exponent
+  // picks the "%e" or the "%f" form and the trailing zeros of the fraction are dropped
+  bool exponent = true;
   if (flags & FLAGS_ADAPT_EXP) {
-    // do we want to fall-back to "%f" mode?
-    if ((value >= 1e-4) && (value < 1e6)) {
-      if ((int)prec > expval) {
-        prec = (unsigned)((int)prec - expval - 1);
-      }
-      else {
-        prec = 0;
-      }
-      flags |= FLAGS_PRECISION;   // make sure _ftoa respects precision
-      // no characters in exponent
-      minwidth = 0U;
-      expval   = 0;
+    const int digits = prec ? (int)prec : 1;
+    if ((expval >= -4) && (expval < digits)) {
+      prec = (unsigned int)(digits - 1 - expval);
+      exponent = false;
     }
     else {
-      // we use one sigfig for the whole part
-      if ((prec > 0) && (flags & FLAGS_PRECISION)) {
-        --prec;
-      }
+      prec = (unsigned int)(digits - 1);
     }
   }
 
-  // will everything fit?
-  unsigned int fwidth = width;
-  if (width > minwidth) {
-    // we didn't fall-back so subtract the characters required for the exponent
-    fwidth -= minwidth;
-  } else {
-    // not enough characters, so go back to default sizing
-    fwidth = 0U;
-  }
-  if ((flags & FLAGS_LEFT) && minwidth) {
-    // if we're padding on the right, DON'T pad the floating part
-    fwidth = 0U;
+  // the "%e" form prints the scaled value, the "%f" form the value itself
+  if (exponent) {
+    value = scaled;
   }
 
-  // rescale the float value
-  if (expval) {
-    value /= conv.F;
-  }
+  // the exponent format is "%+03d" and largest value is "307", so set aside 4-5 characters
+  const unsigned int minwidth = !exponent ? 0U : ((expval < 100) && (expval > -100)) ? 4U : 5U;
+
+  // will everything fit? if we're padding on the right, DON'T pad the floating part
+  const unsigned int fwidth = ((width > minwidth) && !((flags & FLAGS_LEFT) && minwidth)) ? width - minwidth : 0U;
 
   // output the floating part
   const size_t start_idx = idx;
-  idx = _ftoa(out, buffer, idx, maxlen, negative ? -value : value, prec, fwidth, flags & ~FLAGS_ADAPT_EXP);
+  const unsigned int trim = ((flags & FLAGS_ADAPT_EXP) && !(flags & FLAGS_HASH)) ? FLAGS_TRIM : 0U;
+  idx = _ftoa(out, buffer, idx, maxlen, negative ? -value : value, prec, fwidth, (flags & ~(FLAGS_ADAPT_EXP | FLAGS_EXPONENT)) | FLAGS_PRECISION | trim);
 
   // output the exponent part
   if (minwidth) {
     // output the exponential symbol
     out((flags & FLAGS_UPPERCASE) ? 'E' : 'e', buffer, idx++, maxlen);
     // output the exponent value
-    idx = _ntoa_long(out, buffer, idx, maxlen, (expval < 0) ? -expval : expval, expval < 0, 10, 0, minwidth-1, FLAGS_ZEROPAD | FLAGS_PLUS);
+    idx = _ntoa_long(out, buffer, idx, maxlen, (unsigned long)((expval < 0) ? -expval : expval), expval < 0, 10U, 0U, minwidth - 1U, FLAGS_ZEROPAD | FLAGS_PLUS);
     // might need to right-pad spaces
-    if (flags & FLAGS_LEFT) {
-      while (idx - start_idx < width) out(' ', buffer, idx++, maxlen);
+    if ((flags & FLAGS_LEFT) && (idx - start_idx < width)) {
+      idx = _out_pad(out, buffer, idx, maxlen, width - (idx - start_idx));
     }
   }
   return idx;
 }
-#endif  // PRINTF_SUPPORT_EXPONENTIAL
+#endif  // PRINTF_SUPPORT_EXPONENTIAL && !PRINTF_EXACT_FLOAT
 #endif  // PRINTF_SUPPORT_FLOAT
 
 
@@ -588,9 +1015,12 @@ static int _vsnprintf(out_fct_type out, char* buffer, const size_t maxlen, const
   {
     // format specifier?  %[flags][width][.precision][length]
     if (*format != '%') {
-      // no
-      out(*format, buffer, idx++, maxlen);
-      format++;
+      // no, output the literal text up to the next specifier in one piece
+      const char* start = format;
+      while (*format && (*format != '%')) {
+        format++;
+      }
+      idx = _out_str(out, buffer, idx, maxlen, start, (size_t)(format - start));
       continue;
     }
     else {
@@ -638,6 +1068,9 @@ static int _vsnprintf(out_fct_type out, char* buffer, const size_t maxlen, const
       }
       else if (*format == '*') {
         const int prec = (int)va_arg(va, int);
+        if (prec < 0) {
+          flags &= ~FLAGS_PRECISION;    // a negative precision is taken as if it were omitted
+        }
         precision = prec > 0 ? (unsigned int)prec : 0U;
         format++;
       }
@@ -724,16 +1157,16 @@ static int _vsnprintf(out_fct_type out, char* buffer, const size_t maxlen, const
           if (flags & FLAGS_LONG_LONG) {
 #if defined(PRINTF_SUPPORT_LONG_LONG)
             const long long value = va_arg(va, long long);
-            idx = _ntoa_long_long(out, buffer, idx, maxlen, (unsigned long long)(value > 0 ? value : 0 - value), value < 0, base, precision, width, flags);
+            idx = _ntoa_long_long(out, buffer, idx, maxlen, (value > 0) ? (unsigned long long)value : 0ULL - (unsigned long long)value, value < 0, base, precision, width, flags);
 #endif
           }
           else if (flags & FLAGS_LONG) {
             const long value = va_arg(va, long);
-            idx = _ntoa_long(out, buffer, idx, maxlen, (unsigned long)(value > 0 ? value : 0 - value), value < 0, base, precision, width, flags);
+            idx = _ntoa_long(out, buffer, idx, maxlen, (value > 0) ? (unsigned long)value : 0UL - (unsigned long)value, value < 0, base, precision, width, flags);
           }
           else {
             const int value = (flags & FLAGS_CHAR) ? (char)va_arg(va, int) : (flags & FLAGS_SHORT) ? (short int)va_arg(va, int) : va_arg(va, int);
-            idx = _ntoa_long(out, buffer, idx, maxlen, (unsigned int)(value > 0 ? value : 0 - value), value < 0, base, precision, width, flags);
+            idx = _ntoa_long(out, buffer, idx, maxlen, (value > 0) ? (unsigned int)value : 0U - (unsigned int)value, value < 0, base, precision, width, flags);
           }
         }
         else {
@@ -766,28 +1199,24 @@ static int _vsnprintf(out_fct_type out, char* buffer, const size_t maxlen, const
       case 'E':
       case 'g':
       case 'G':
+        if ((*format == 'e')||(*format == 'E')) flags |= FLAGS_EXPONENT;
         if ((*format == 'g')||(*format == 'G')) flags |= FLAGS_ADAPT_EXP;
         if ((*format == 'E')||(*format == 'G')) flags |= FLAGS_UPPERCASE;
-        idx = _etoa(out, buffer, idx, maxlen, va_arg(va, double), precision, width, flags);
+        idx = _ftoa(out, buffer, idx, maxlen, va_arg(va, double), precision, width, flags);
         format++;
         break;
 #endif  // PRINTF_SUPPORT_EXPONENTIAL
 #endif  // PRINTF_SUPPORT_FLOAT
       case 'c' : {
-        unsigned int l = 1U;
         // pre padding
-        if (!(flags & FLAGS_LEFT)) {
-          while (l++ < width) {
-            out(' ', buffer, idx++, maxlen);
-          }
+        if (!(flags & FLAGS_LEFT) && (width > 1U)) {
+          idx = _out_pad(out, buffer, idx, maxlen, width - 1U);
         }
         // char output
         out((char)va_arg(va, int), buffer, idx++, maxlen);
         // post padding
-        if (flags & FLAGS_LEFT) {
-          while (l++ < width) {
-            out(' ', buffer, idx++, maxlen);
-          }
+        if ((flags & FLAGS_LEFT) && (width > 1U)) {
+          idx = _out_pad(out, buffer, idx, maxlen, width - 1U);
         }
         format++;
         break;
@@ -800,20 +1229,14 @@ static int _vsnprintf(out_fct_type out, char* buffer, const size_t maxlen, const
         if (flags & FLAGS_PRECISION) {
           l = (l < precision ? l : precision);
         }
-        if (!(flags & FLAGS_LEFT)) {
-          while (l++ < width) {
-            out(' ', buffer, idx++, maxlen);
-          }
+        if (!(flags & FLAGS_LEFT) && (l < width)) {
+          idx = _out_pad(out, buffer, idx, maxlen, width - l);
         }
         // string output
-        while ((*p != 0) && (!(flags & FLAGS_PRECISION) || precision--)) {
-          out(*(p++), buffer, idx++, maxlen);
-        }
+        idx = _out_str(out, buffer, idx, maxlen, p, l);
         // post padding
-        if (flags & FLAGS_LEFT) {
-          while (l++ < width) {
-            out(' ', buffer, idx++, maxlen);
-          }
+        if ((flags & FLAGS_LEFT) && (l < width)) {
+          idx = _out_pad(out, buffer, idx, maxlen, width - l);
         }
         format++;
         break;
@@ -912,3 +1335,23 @@ int fctprintf(void (*out)(char character, void* arg), void* arg, const char* for
   va_end(va);
   return ret;
 }
+
+
+int spanprintf(void (*out)(const char* span, size_t len, void* arg), void* arg, const char* format, ...)
+{
+  va_list va;
+  va_start(va, format);
+  const int ret = vspanprintf(out, arg, format, va);
+  va_end(va);
+  return ret;
+}
+
+
+int vspanprintf(void (*out)(const char* span, size_t len, void* arg), void* arg, const char* format, va_list va)
+{
+  out_span_wrap_type out_span_wrap;
+  out_span_wrap.fct = out;
+  out_span_wrap.arg = arg;
+  out_span_wrap.len = 0U;
+  return _vsnprintf(_out_span, (char*)(uintptr_t)&out_span_wrap, (size_t)-1, format, va);
+}
@@ -109,6 +109,20 @@ int vprintf_(const char* format, va_list va);
 int fctprintf(void (*out)(char character, void* arg), void* arg, const char* format, ...);
 
 
+/**
+ * printf with span output function
+ * Like fctprintf(), but the output function gets whole runs of characters (literal text, %s arguments,
+ * padding and collected short pieces) instead of one character per call
+ * \param out An output function which takes a pointer to characters, their number and an argument pointer
+ * \param arg An argument pointer for user data passed to output function
+ * \param format A string that specifies the format of the output
+ * \param va A value identifying a variable arguments list
+ * \return The number of characters that are sent to the output function, not counting the terminating null character
+ */
+int spanprintf(void (*out)(const char* span, size_t len, void* arg), void* arg, const char* format, ...);
+int vspanprintf(void (*out)(const char* span, size_t len, void* arg), void* arg, const char* format, va_list va);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "microBox.h"
+#include "port_handlers/microBox_buffer_port_handler.h"
+
+// Four threads queue messages with asyncPrintf() while the main thread runs commandParser(), as
+// the tasks of a device would next to its console. Every message has to come out once, whole,
+// and in the order its thread queued it. The queue is kept small so that it runs full all the
+// time; the build adds ThreadSanitizer where the compiler has it.
+
+static const int producerCount = 4;
+static const int messagesPerProducer = 5000;
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+// checks one line of output, the redraws of the prompt are skipped
+static bool checkLine(std::string line, int* next)
+{
+    int producer;
+    int message;
+    int length = 0;
+    size_t clear = line.rfind("\x1B[K");
+
+    if (clear != std::string::npos)
+        line.erase(0, clear + 3);
+    if (!line.empty() && line[line.size() - 1] == '\r')
+        line.erase(line.size() - 1);
+    if (line.empty())
+        return true;
+    if (sscanf(line.c_str(), "producer %d message %d%n", &producer, &message, &length) != 2 || length != (int)line.size()
+        || producer < 0 || producer >= producerCount || message != next[producer]) {
+        printf("unexpected line \"%s\"\n", line.c_str());
+        return false;
+    }
+    next[producer]++;
+    return true;
+}
+
+int main()
+{
+    static uint8_t output[1 << 16];
+    BufferPortHandler port(output, sizeof(output));
+    MicroBox microbox;
+    std::atomic<int> running(producerCount);
+    std::atomic<unsigned long> queueFull(0);
+    std::vector<std::thread> producers;
+    std::string received;
+    int next[producerCount] = {};
+    bool ok = true;
+
+    microbox.begin("stress", &port, false, false);
+    for (int p = 0; p < producerCount; p++) {
+        producers.emplace_back([&microbox, &running, &queueFull, p] {
+            for (int i = 0; i < messagesPerProducer; i++) {
+                while (!microbox.asyncPrintf("producer %d message %d\n", p, i)) {
+                    queueFull++;
+                    std::this_thread::yield();
+                }
+            }
+            running--;
+        });
+    }
+
+    // the console thread; once all producers are done one more pass writes what is left
+    bool last = false;
+    while (!last) {
+        last = running == 0;
+        microbox.commandParser();
+        received.append((const char*)port.output(), port.outputSize());
+        port.clearOutput();
+    }
+    for (std::thread& producer : producers)
+        producer.join();
+
+    size_t start = 0;
+    size_t end;
+    while (ok && (end = received.find('\n', start)) != std::string::npos) {
+        ok = checkLine(received.substr(start, end - start), next);
+        start = end + 1;
+    }
+    for (int p = 0; ok && p < producerCount; p++) {
+        if (next[p] != messagesPerProducer) {
+            printf("producer %d: %d of %d messages arrived\n", p, next[p], messagesPerProducer);
+            ok = false;
+        }
+    }
+    printf("async_stress: %d messages from %d threads, the queue was full %lu times, %s\n",
+           producerCount * messagesPerProducer, producerCount, queueFull.load(), ok ? "all arrived in order" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "microBox.h"
+#include "port_handlers/microBox_buffer_port_handler.h"
+
+// The opt-in features of a library built with all of them and a TX buffer: statistics, the
+// log, the trace, the result cache, the structured writer, block transfers and watch, plus
+// generators and XON/XOFF going through the TX buffer.
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static MicroBox* console;
+static uint32_t ticks;
+static bool ok = true;
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        ok = false;
+    }
+}
+
+static std::string run(BufferPortHandler& port, const std::string& input)
+{
+    port.setInput(input.data(), input.size());
+    while (console->commandParser() || console->pendingInput() > 0) {
+    }
+    std::string output((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    return output;
+}
+
+static bool contains(const std::string& text, const std::string& part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+static void testStats(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.setTickSource([]() { return ticks += 5; });
+    microbox.addCommand("ping", [](char**, uint8_t) {
+        console->print("pong\n\r");
+    }, "answers\n\r");
+
+    std::string input = "ping\rping\rping\rnope\r";
+    run(port, input);
+    expect(microbox.getStats().bytesIn == input.size(), "stats: every received byte counted");
+    expect(microbox.getStats().linesExecuted == 4, "stats: every line counted");
+    const COMMAND_STATS* ping = microbox.getCommandStats("ping");
+    expect(ping != nullptr && ping->calls == 3, "stats: calls of the command counted");
+    expect(ping != nullptr && ping->minTicks > 0 && ping->maxTicks >= ping->minTicks, "stats: handler time measured");
+
+    std::string output = run(port, "stats\r");
+    expect(contains(output, "lines executed:") && contains(output, "ping"), "stats: the stats command prints the table");
+    run(port, "stats reset\r");
+    expect(microbox.getCommandStats("ping")->calls == 0, "stats: reset clears the command counters");
+}
+
+static void testLog(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.log("adc %d of %u", -5, 7u);
+    microbox.log("%s=%c", "mode", 'x');
+    microbox.log("%hu|%lld|%x", (unsigned short)65535, -3000000000LL, 0xbeefu);
+    microbox.flushLog();
+    std::string output((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    expect(contains(output, "] adc -5 of 7"), "log: arguments formatted when flushed");
+    expect(contains(output, "] mode=x"), "log: strings and characters");
+    expect(contains(output, "] 65535|-3000000000|beef"), "log: length modifiers");
+
+    for (int i = 0; i < MICROBOX_LOG_ENTRIES + 3; i++)
+        microbox.log("entry %d", i);
+    expect(microbox.getLostLogEntries() == 3, "log: entries beyond the ring are lost");
+    output = run(port, "log\r");
+    expect(contains(output, "3 log entries lost"), "log: lost entries reported");
+    expect(!contains(output, "] entry 2\r") && contains(output, "] entry 3\r") && contains(output, "] entry 18\r"),
+        "log: the newest entries kept");
+}
+
+static void testTrace(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.setTickSource([]() { return ticks += 5; });
+    microbox.addCommand("ping", [](char**, uint8_t) {
+        console->print("pong\n\r");
+    }, "answers\n\r");
+
+    run(port, "ping\r");
+    std::string output = run(port, "trace dump\r");
+    expect(contains(output, "[\r\n{\"name\":") && contains(output, "}\r\n]"), "trace: dumped as a JSON array");
+    expect(contains(output, "{\"name\":\"ping\",\"ph\":\"B\""), "trace: the handler is named after the command");
+    expect(contains(output, "{\"name\":\"ping\",\"ph\":\"E\""), "trace: the handler end is recorded");
+    run(port, "trace clear\r");
+    output = run(port, "trace dump\r");
+    expect(!contains(output, "\"ping\""), "trace: cleared");
+}
+
+static uint32_t cacheCalls;
+static uint32_t countersGeneration;
+
+static void testCache(BufferPortHandler& port)
+{
+    static uint8_t arena[512];
+    MicroBoxCache cache(arena, sizeof(arena));
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.setTickSource([]() { return ticks; });
+    microbox.setCache(&cache);
+    microbox.addCommand("version", [](char**, uint8_t) {
+        cacheCalls++;
+        console->print("version 1.0\n\r");
+    }, "prints the version\n\r");
+    microbox.addCommand("counters", [](char**, uint8_t) {
+        cacheCalls++;
+        console->printf("counters %u\n\r", (unsigned)countersGeneration);
+    }, "prints the counters\n\r");
+    microbox.addCommand("status", [](char**, uint8_t) {
+        cacheCalls++;
+        console->print("status ok\n\r");
+    }, "prints the status\n\r");
+    expect(microbox.setCacheable("version", 0), "cache: version cacheable");
+    expect(microbox.setCacheable("counters", 0, &countersGeneration), "cache: counters cacheable");
+    expect(microbox.setCacheable("status", 100), "cache: status cacheable");
+
+    cacheCalls = 0;
+    std::string first = run(port, "version\r");
+    std::string second = run(port, "version\r");
+    expect(cacheCalls == 1, "cache: the second run is served from the cache");
+    expect(first == second && contains(first, "version 1.0"), "cache: the cached output is the same");
+    expect(cache.getHits() == 1 && cache.getMisses() == 1, "cache: hits and misses counted");
+
+    cacheCalls = 0;
+    run(port, "counters\r");
+    run(port, "counters\r");
+    countersGeneration++;
+    std::string output = run(port, "counters\r");
+    expect(cacheCalls == 2 && contains(output, "counters 1"), "cache: a new generation runs the command again");
+
+    cacheCalls = 0;
+    ticks = 1000;
+    run(port, "status\r");
+    ticks = 1050;
+    run(port, "status\r");
+    ticks = 1200;
+    run(port, "status\r");
+    expect(cacheCalls == 2, "cache: the entry expires after its ttl");
+
+    cacheCalls = 0;
+    cache.invalidate();
+    run(port, "version\r");
+    expect(cacheCalls == 1, "cache: invalidate() empties the cache");
+}
+
+// output that was dropped must not be kept as the result of the command
+static void testCacheDroppedOutput()
+{
+    static uint8_t small[64];
+    static uint8_t arena[2048];
+    BufferPortHandler port(small, sizeof(small));
+    MicroBoxCache cache(arena, sizeof(arena));
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.setCache(&cache);
+    microbox.addCommand("dump", [](char**, uint8_t) {
+        cacheCalls++;
+        for (int i = 0; i < 20; i++)
+            console->printf("line %02d of the dump\n\r", i);
+    }, "prints a lot\n\r");
+    microbox.setCacheable("dump", 0);
+
+    cacheCalls = 0;
+    run(port, "dump\r");
+    expect(microbox.getDroppedBytes() > 0, "cache: the small port drops output");
+    run(port, "dump\r");
+    expect(cacheCalls == 2, "cache: a result with dropped output is not cached");
+}
+
+static void info(char**, uint8_t)
+{
+    MicroBoxWriter writer(*console);
+
+    writer.beginObject();
+    writer.field("uptime", 42);
+    writer.field("name", "box");
+    writer.field("ok", true);
+    writer.key("list");
+    writer.beginArray();
+    writer.value(1);
+    writer.value(-2);
+    writer.endArray();
+    writer.key("none");
+    writer.valueNull();
+    writer.endObject();
+}
+
+static void testWriter(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.addCommand("info", info, "prints the info\n\r");
+
+    std::string output = run(port, "info\r");
+    expect(contains(output, "uptime") && contains(output, "42") && contains(output, "box"), "writer: text output");
+
+    run(port, "format json\r");
+    expect(microbox.getOutputMode() == OUTPUT_MODE_JSON, "writer: format json switches the mode");
+    output = run(port, "info\r");
+    expect(contains(output, "{\"uptime\":42,\"name\":\"box\",\"ok\":true,\"list\":[1,-2],\"none\":null}"),
+        "writer: JSON output");
+
+    microbox.setOutputMode(OUTPUT_MODE_CBOR);
+    output = run(port, "info\r");
+    static const uint8_t cbor[] = {
+        0xBF, 0x66, 'u', 'p', 't', 'i', 'm', 'e', 0x18, 0x2A, 0x64, 'n', 'a', 'm', 'e', 0x63, 'b', 'o', 'x',
+        0x62, 'o', 'k', 0xF5, 0x64, 'l', 'i', 's', 't', 0x9F, 0x01, 0x21, 0xFF, 0x64, 'n', 'o', 'n', 'e', 0xF6, 0xFF
+    };
+    expect(contains(output, std::string((const char*)cbor, sizeof(cbor))), "writer: CBOR output");
+}
+
+static uint16_t crc16(const uint8_t* data, size_t len)
+{
+    uint16_t crc = 0;
+
+    while (len--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static std::string frame(uint8_t sequence, const std::string& payload)
+{
+    std::string frame;
+
+    frame += (char)TRANSFER_SOH;
+    frame += (char)sequence;
+    frame += (char)payload.size();
+    frame += payload;
+    uint16_t crc = crc16((const uint8_t*)frame.data() + 1, frame.size() - 1);
+    frame += (char)(crc >> 8);
+    frame += (char)crc;
+    return frame;
+}
+
+static std::string uploaded;
+static std::string downloadData;
+
+static void testTransfer(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.addCommand("up", [](char**, uint8_t) {
+        uploaded.clear();
+        console->beginUpload([](const uint8_t* data, size_t len) {
+            if (data != nullptr)
+                uploaded.append((const char*)data, len);
+            return true;
+        });
+    }, "receives a file\n\r");
+    microbox.addCommand("down", [](char**, uint8_t) {
+        console->beginDownload([](uint32_t offset, uint8_t* buffer, size_t size) {
+            size_t len = offset < downloadData.size() ? downloadData.size() - offset : 0;
+            if (len > size)
+                len = size;
+            memcpy(buffer, downloadData.data() + offset, len);
+            return len;
+        });
+    }, "sends a file\n\r");
+
+    // three frames, the second one first with a broken CRC
+    std::string first(MICROBOX_TRANSFER_BLOCK, 'a');
+    std::string second = "the second block";
+    std::string broken = frame(1, second);
+    broken[broken.size() - 1] ^= 0x55;
+    run(port, "up\r");
+    std::string output = run(port, frame(0, first) + broken + frame(1, second) + frame(2, ""));
+    std::string acks = { TRANSFER_ACK, 0, TRANSFER_NAK, 1, TRANSFER_ACK, 1, TRANSFER_ACK, 2 };
+    expect(output == acks, "transfer: frames acknowledged, the broken one asked for again");
+    output = run(port, std::string(1, TRANSFER_EOT));
+    expect(output.compare(0, 2, std::string({ TRANSFER_ACK, TRANSFER_EOT })) == 0, "transfer: EOT answered");
+    expect(uploaded == first + second, "transfer: uploaded data complete");
+
+    // the window is sent at once, the cumulative ACK of the last frame ends it
+    downloadData.clear();
+    for (int i = 0; i < 300; i++)
+        downloadData += (char)(i * 7);
+    output = run(port, "down\r");
+    std::string received;
+    size_t position = output.find((char)TRANSFER_SOH);
+    uint8_t frames = 0;
+    while (position != std::string::npos && position + 3 < output.size()) {
+        const uint8_t* data = (const uint8_t*)output.data() + position + 1;
+        uint8_t len = data[1];
+        uint16_t crc = crc16(data, 2 + len);
+        expect(data[0] == frames && data[2 + len] == (uint8_t)(crc >> 8) && data[3 + len] == (uint8_t)crc,
+            "transfer: download frame in order with its CRC");
+        received.append((const char*)data + 2, len);
+        frames++;
+        position = len == 0 ? std::string::npos : position + 5 + len;
+    }
+    expect(frames == 4 && received == downloadData, "transfer: downloaded data complete");
+    output = run(port, std::string({ TRANSFER_ACK, 3 }));
+    expect(contains(output, "box> ") && !contains(output, "aborted"), "transfer: the last ACK ends the download");
+
+    // CAN CAN aborts
+    run(port, "down\r");
+    output = run(port, std::string({ TRANSFER_CAN, TRANSFER_CAN }));
+    expect(contains(output, "transfer aborted"), "transfer: CAN CAN aborts");
+}
+
+static uint32_t watchValue;
+
+static void testWatch(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.addCommand("value", [](char**, uint8_t) {
+        console->printf("value %lu\n\r", (unsigned long)watchValue);
+    }, "prints the value\n\r");
+    microbox.addCommand("rows", [](char**, uint8_t) {
+        for (int i = 0; i < 300; i++)
+            console->printf("row %d\n\r", i);
+    }, "prints 300 rows\n\r");
+
+    watchValue = 1234;
+    run(port, "watch -n 100 value\r");
+    microbox.tick(0);
+    std::string output((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    expect(contains(output, "Every 100 ms: value") && contains(output, "value 1234"), "watch: the first frame drawn");
+
+    microbox.tick(50);
+    expect(port.outputSize() == 0, "watch: nothing before the interval");
+    watchValue = 1284;
+    microbox.tick(100);
+    output.assign((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    expect(contains(output, "\x1B[3;9H8") && !contains(output, "value"), "watch: only the changed digit is sent");
+    output = run(port, "x");
+    microbox.tick(200);
+    expect(port.outputSize() == 0, "watch: any key stops it");
+
+    // rows beyond the screen are dropped, they must not wrap around onto the first ones
+    run(port, "watch -n 100 rows\r");
+    microbox.tick(1000);
+    output.assign((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    expect(contains(output, "Every 100 ms: rows") && contains(output, "row 0"), "watch: the first rows drawn");
+    expect(!contains(output, "row 256") && !contains(output, "row 299"), "watch: rows beyond the screen dropped");
+    run(port, "x");
+}
+
+// a port that takes only as many bytes as it is given room for
+class ThrottledPortHandler : public BufferPortHandler {
+public:
+    ThrottledPortHandler(uint8_t* buffer, size_t size) : BufferPortHandler(buffer, size)
+    {
+
+    }
+
+    virtual size_t write(uint8_t c) override
+    {
+        return writeBytes(&c, 1);
+    }
+
+    virtual size_t writeBytes(const uint8_t* buffer, size_t size) override
+    {
+        if (size > room)
+            size = room;
+        room -= size;
+        return BufferPortHandler::writeBytes(buffer, size);
+    }
+
+    virtual int availableForWrite() override
+    {
+        return (int)room;
+    }
+
+    size_t room = 0;
+};
+
+static uint32_t generatedRows;
+
+// a generator waits for room in the TX buffer before each row, the first one too
+static void testGeneratorRoom()
+{
+    static uint8_t output[1 << 14];
+    ThrottledPortHandler port(output, sizeof(output));
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.addCommand("fill", [](char**, uint8_t) {
+        console->print(std::string(MICROBOX_TX_BUFFER_SIZE - 24, '.').c_str());
+    }, "leaves less than a row of room\n\r");
+    microbox.addGenerator("rows", [](char**, uint8_t, uint32_t row) {
+        generatedRows++;
+        console->printf("row %lu\n\r", (unsigned long)row);
+        return row < 9;
+    }, "prints 10 rows\n\r");
+
+    port.setInput("fill\r", 5);
+    microbox.commandParser();
+    uint32_t dropped = microbox.getDroppedBytes();
+    generatedRows = 0;
+    // the generator asks to be called again while it waits, so the passes are counted here
+    port.setInput("rows\r", 5);
+    for (int pass = 0; pass < 100; pass++)
+        microbox.commandParser();
+    expect(generatedRows == 0, "generator: no row without room");
+    expect(microbox.getDroppedBytes() == dropped, "generator: nothing dropped while waiting");
+
+    port.room = sizeof(output);
+    port.clearOutput();
+    while (microbox.commandParser()) {
+    }
+    std::string text((const char*)port.output(), port.outputSize());
+    expect(generatedRows == 10 && contains(text, "row 0\r") && contains(text, "row 9\r"),
+        "generator: all rows once there is room");
+    expect(microbox.getDroppedBytes() == dropped, "generator: nothing dropped");
+}
+
+// output held by XOFF waits in the TX buffer and goes out with XON
+static void testFlowControl(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.setFlowControl(true);
+    microbox.addCommand("ping", [](char**, uint8_t) {
+        console->print("pong\n\r");
+    }, "answers\n\r");
+
+    std::string output = run(port, "\x13ping\r");
+    expect(!contains(output, "pong"), "flow control: output held after XOFF");
+    output = run(port, "\x11");
+    expect(contains(output, "pong"), "flow control: output sent after XON");
+    expect(microbox.getDroppedBytes() == 0, "flow control: nothing dropped");
+}
+
+int main()
+{
+    static uint8_t output[1 << 16];
+    BufferPortHandler port(output, sizeof(output));
+
+    testStats(port);
+    testLog(port);
+    testTrace(port);
+    testCache(port);
+    testCacheDroppedOutput();
+    testWriter(port);
+    testTransfer(port);
+    testWatch(port);
+    testGeneratorRoom();
+    testFlowControl(port);
+
+    printf("features: %s\n", ok ? "passed" : "failed");
+    return ok ? 0 : 1;
+}
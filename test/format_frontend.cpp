@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string>
+#include "microBox.h"
+#include "port_handlers/microBox_buffer_port_handler.h"
+
+// MICROBOX_PRINTF() has to print exactly what microbox.printf() prints for the same format and
+// arguments. Every format below goes through both, over a set of values picked for the corner
+// cases of signs, prefixes, zero, precision and padding.
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static uint8_t output[1 << 12];
+static BufferPortHandler port(output, sizeof(output));
+static MicroBox microbox;
+static unsigned long checks = 0;
+static unsigned long failures = 0;
+
+static std::string takeOutput()
+{
+    std::string text((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    return text;
+}
+
+static void compare(const char* format, const std::string& expected, const std::string& actual)
+{
+    checks++;
+    if (expected != actual) {
+        if (++failures <= 20)
+            printf("\"%s\": printf gives \"%s\", MICROBOX_PRINTF \"%s\"\n", format, expected.c_str(), actual.c_str());
+    }
+}
+
+#define CHECK(format, ...)                                  \
+    do {                                                    \
+        microbox.printf(format, ##__VA_ARGS__);             \
+        std::string expected = takeOutput();                \
+        MICROBOX_PRINTF(microbox, format, ##__VA_ARGS__);   \
+        compare(format, expected, takeOutput());            \
+    } while (0)
+
+#define SWEEP(values, format)                                               \
+    do {                                                                    \
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)    \
+            CHECK(format, values[i]);                                       \
+    } while (0)
+
+static const int ints[] = {0, 1, -1, 7, -42, 255, 4096, 65535, -100000, 123456789, INT_MAX, INT_MIN};
+static const unsigned int unsigneds[] = {0U, 1U, 8U, 255U, 4096U, 65535U, 3000000000U, UINT_MAX};
+static const long longs[] = {0L, 5L, -5L, 1234567L, LONG_MAX, LONG_MIN};
+static const long long longLongs[] = {0LL, -1LL, 1099511627776LL, LLONG_MAX, LLONG_MIN};
+static const unsigned long long unsignedLongLongs[] = {0ULL, 1ULL, 1099511627776ULL, ULLONG_MAX};
+static const size_t sizes[] = {0, 17, SIZE_MAX};
+static const double doubles[] = {0.0, -0.0, 1.5, -2.25, 3.14159265358979, 1e-5, 123456.789, 1e300};
+static const char* const strings[] = {"", "a", "abc", "microBox", "a longer string than the width"};
+
+int main()
+{
+    microbox.begin("format", &port, false, false);
+
+    CHECK("plain text\n");
+    CHECK("100%% done, %d%%\n", 100);
+    CHECK("%d items, %s, %c%c\n", 3, "left", 'o', 'k');
+    CHECK("%s=%u %s=%ld\n", "rx", 17U, "tx", -4L);
+    CHECK("%hhd %hhu %hd %hu", 300, 300, 70000, 70000);
+    CHECK("%-5c|%5c|", 'x', 'y');
+    CHECK("%p", (void*)nullptr);
+    CHECK("%p %p", (void*)&checks, (const char*)"x");
+
+    SWEEP(ints, "%d");
+    SWEEP(ints, "%i");
+    SWEEP(ints, "%5d");
+    SWEEP(ints, "%-5d|");
+    SWEEP(ints, "%05d");
+    SWEEP(ints, "%+d");
+    SWEEP(ints, "% d");
+    SWEEP(ints, "%+08d");
+    SWEEP(ints, "%.3d");
+    SWEEP(ints, "%.0d");
+    SWEEP(ints, "%8.3d");
+    SWEEP(ints, "%-+12.6d|");
+    SWEEP(ints, "%x");
+    SWEEP(ints, "%hhx");
+    SWEEP(ints, "%hd");
+    SWEEP(unsigneds, "%u");
+    SWEEP(unsigneds, "%10u");
+    SWEEP(unsigneds, "%x");
+    SWEEP(unsigneds, "%X");
+    SWEEP(unsigneds, "%#x");
+    SWEEP(unsigneds, "%#X");
+    SWEEP(unsigneds, "%#010x");
+    SWEEP(unsigneds, "%#.6x");
+    SWEEP(unsigneds, "%-#12x|");
+    SWEEP(unsigneds, "%o");
+    SWEEP(unsigneds, "%#o");
+    SWEEP(unsigneds, "%#.0o");
+    SWEEP(unsigneds, "%#.8o");
+    SWEEP(unsigneds, "%b");
+    SWEEP(unsigneds, "%#b");
+    SWEEP(unsigneds, "%.0u");
+    SWEEP(unsigneds, "%.0x");
+    SWEEP(unsigneds, "%d");
+    SWEEP(longs, "%ld");
+    SWEEP(longs, "%20ld");
+    SWEEP(longs, "%lx");
+    SWEEP(longs, "%-+22ld|");
+    SWEEP(longLongs, "%lld");
+    SWEEP(longLongs, "%024lld");
+    SWEEP(longLongs, "%llx");
+    SWEEP(unsignedLongLongs, "%llu");
+    SWEEP(unsignedLongLongs, "%#llo");
+    SWEEP(unsignedLongLongs, "%#llX");
+    SWEEP(sizes, "%zu");
+    SWEEP(sizes, "%zx");
+    SWEEP(doubles, "%f");
+    SWEEP(doubles, "%.3f");
+    SWEEP(doubles, "%+012.4f");
+    SWEEP(doubles, "%e");
+    SWEEP(doubles, "%-12.2E|");
+    SWEEP(doubles, "%g");
+    SWEEP(doubles, "%#.8G");
+    SWEEP(strings, "%s");
+    SWEEP(strings, "%8s|");
+    SWEEP(strings, "%-8s|");
+    SWEEP(strings, "%.2s|");
+    SWEEP(strings, "%5.1s|");
+    SWEEP(strings, "%-40s|");
+
+    printf("format_frontend: %lu formats compared, %lu differ\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "microBox.h"
+#include "port_handlers/microBox_buffer_port_handler.h"
+
+// The history ring wraps many times over with lines of every length; nothing may be written
+// behind its buffer and cursor up has to bring back the latest line each time.
+
+#define HISTORY_SIZE                32
+#define GUARD_SIZE                  16
+#define GUARD_BYTE                  0xA5
+
+static_assert(HISTORY_SIZE + 6 <= MAX_COMMAND_BUFFER_SIZE, "a line longer than the history has to fit in the command line");
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static std::string lastParameter;
+static bool ok = true;
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        ok = false;
+    }
+}
+
+static char commandLine[MAX_COMMAND_BUFFER_SIZE];
+static char history[HISTORY_SIZE + GUARD_SIZE];
+static COMMAND_ENTRY commands[4];
+static char* parameters[4];
+#ifdef MICROBOX_ENABLE_WATCH
+static char watchLine[MAX_COMMAND_BUFFER_SIZE];
+#endif
+
+static MICROBOX_STORAGE storage()
+{
+    MICROBOX_STORAGE buffers;
+    buffers.commandBuffer = commandLine;
+    buffers.commandBufferSize = sizeof(commandLine);
+    buffers.historyBuffer = history;
+    buffers.historyBufferSize = HISTORY_SIZE;
+    buffers.commands = commands;
+    buffers.commandNumber = 4;
+    buffers.parameterPointer = parameters;
+    buffers.parameterNumber = 4;
+#ifdef MICROBOX_ENABLE_WATCH
+    buffers.watchLine = watchLine;
+#endif
+    return buffers;
+}
+
+static std::string run(MicroBoxCore& console, BufferPortHandler& port, const std::string& input)
+{
+    port.setInput(input.data(), input.size());
+    while (console.commandParser() || console.pendingInput() > 0) {
+    }
+    std::string output((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    return output;
+}
+
+int main()
+{
+    static uint8_t output[1 << 12];
+    BufferPortHandler port(output, sizeof(output));
+    MicroBoxCore console(storage());
+    unsigned long lines = 0;
+    unsigned long failures = 0;
+
+    memset(history + HISTORY_SIZE, GUARD_BYTE, GUARD_SIZE);
+    console.begin("wrap", &port, false, false);
+    console.addCommand("h", [](char** param, uint8_t parCnt) {
+        lastParameter = parCnt > 0 ? param[0] : "";
+    }, "remembers its parameter\n\r");
+
+    for (int round = 0; round < 40; round++) {
+        for (size_t length = 1; length < HISTORY_SIZE - 4; length += 3) {
+            std::string parameter = std::string(length, (char)('a' + (round + length) % 26));
+            run(console, port, "h " + parameter + "\r");
+            lines++;
+            // cursor up and enter run the line again
+            lastParameter.clear();
+            run(console, port, "\x1B[A\r");
+            if (lastParameter != parameter && failures++ < 5)
+                printf("line of %u characters not recalled\n", (unsigned)length + 2);
+            for (size_t i = HISTORY_SIZE; i < sizeof(history); i++) {
+                if ((uint8_t)history[i] != GUARD_BYTE) {
+                    printf("FAILED: history written behind its buffer after a line of %u characters\n", (unsigned)length);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    // a line longer than the whole history is run but not kept
+    std::string longer(HISTORY_SIZE + 2, 'x');
+    run(console, port, "h short\r");
+    run(console, port, "h " + longer + "\r");
+    expect(lastParameter == longer, "the long line runs");
+    for (size_t i = HISTORY_SIZE; i < sizeof(history); i++)
+        expect((uint8_t)history[i] == GUARD_BYTE, "no long line behind the history");
+    run(console, port, "\x1B[A\r");
+    expect(lastParameter == "short", "cursor up skips the long line");
+
+    printf("history_wrap: %lu lines through a %u byte history, %lu not recalled\n", lines, HISTORY_SIZE, failures);
+    return ok && failures == 0 ? 0 : 1;
+}
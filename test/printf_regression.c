@@ -0,0 +1,392 @@
+// The bundled printf against the host C library: for every case vsnprintf_() has to return the
+// same length and write the same characters as glibc's vsnprintf(), and snprintf_() has to cut
+// the output short the same way. The cases are a list of fixed ones plus a seeded random sweep
+// over flags, width, precision, length modifiers and values, so every run checks the same set.
+// Doubles are compared in full when printf is built with PRINTF_EXACT_FLOAT, otherwise a
+// double has to come out within one unit of the last digit.
+//
+// One glibc quirk is not followed: with '#', a "%g" that rounds up into the exponent form
+// (99.96 with "%#.2g") comes out as "1.e+02" where C asks for "1.0e+02". Such a case is
+// compared with glibc's "%#.1e" instead, which is what C defines it to be.
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "printf/printf.h"
+#undef printf
+#undef sprintf
+#undef snprintf
+#undef vsnprintf
+
+#define OUTPUT_SIZE     2048
+#define MAX_REPORTED    20
+#define SWEEP_CASES     300000
+
+static unsigned long checks;
+static unsigned long failures;
+
+void _putchar(char character)
+{
+    (void)character;
+}
+
+static uint64_t randomState = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t nextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+static int randomBelow(int limit)
+{
+    return (int)(nextRandom() % (uint64_t)limit);
+}
+
+static void report(const char* format, const char* actual, int actualLength, const char* expected, int expectedLength)
+{
+    if (failures++ < MAX_REPORTED)
+        printf("\"%s\": \"%.200s\" (%d), glibc \"%.200s\" (%d)\n", format, actual, actualLength, expected, expectedLength);
+}
+
+// the "%e" form C defines for a "%#g" with a single conversion and a literal precision, or 0
+static int hashExponentFormat(const char* format, char* exponentFormat)
+{
+    const char* conversion = format + strlen(format) - 1;
+    const char* dot = strchr(format, '.');
+    int digits = 6;
+
+    if ((*conversion != 'g' && *conversion != 'G') || strchr(format, '#') == NULL || strchr(format + 1, '%') != NULL)
+        return 0;
+    if (dot != NULL) {
+        if (dot[1] == '*')
+            return 0;
+        digits = atoi(dot + 1);
+        if (digits == 0)
+            digits = 1;
+    }
+    snprintf(exponentFormat, 64, "%.*s.%d%c", (int)((dot != NULL ? dot : conversion) - format), format, digits - 1,
+             *conversion == 'g' ? 'e' : 'E');
+    return 1;
+}
+
+// one case in full, then cut short at a few lengths up to the end of the output
+static void check(const char* format, ...)
+{
+    char actual[OUTPUT_SIZE];
+    char expected[OUTPUT_SIZE];
+    char exponentFormat[64];
+    va_list args;
+    va_list copy;
+    int actualLength;
+    int expectedLength;
+
+    checks++;
+    va_start(args, format);
+    va_copy(copy, args);
+    actualLength = vsnprintf_(actual, sizeof(actual), format, args);
+    va_end(args);
+    expectedLength = vsnprintf(expected, sizeof(expected), format, copy);
+    va_end(copy);
+
+    if (actualLength != expectedLength || memcmp(actual, expected, (size_t)expectedLength + 1) != 0) {
+        if ((strstr(expected, ".e") != NULL || strstr(expected, ".E") != NULL) && hashExponentFormat(format, exponentFormat)) {
+            va_start(args, format);
+            expectedLength = vsnprintf(expected, sizeof(expected), exponentFormat, args);
+            va_end(args);
+        }
+        if (actualLength != expectedLength || memcmp(actual, expected, (size_t)expectedLength + 1) != 0) {
+            report(format, actual, actualLength, expected, expectedLength);
+            return;
+        }
+    }
+    if (expectedLength >= (int)sizeof(actual))
+        return;
+
+    // the cut output is the same prefix with the terminator at the end of the buffer, nothing
+    // behind it is touched; glibc's full output from above is the reference
+    const int counts[] = { 0, 1, 2, expectedLength / 2, expectedLength - 1, expectedLength, expectedLength + 1 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        const int count = counts[i];
+        char cut[OUTPUT_SIZE];
+
+        if (count < 0 || count > expectedLength + 1)
+            continue;
+
+        memset(cut, '#', sizeof(cut));
+        va_start(args, format);
+        actualLength = vsnprintf_(count == 0 ? NULL : cut, (size_t)count, format, args);
+        va_end(args);
+        memcpy(actual, expected, sizeof(actual));
+        if (count > 0) {
+            actual[count - 1] = 0;
+            memset(actual + count, '#', sizeof(actual) - (size_t)count);
+            if (count > expectedLength)
+                actual[expectedLength] = 0;
+        } else {
+            memset(actual, '#', sizeof(actual));
+        }
+        if (actualLength != expectedLength || memcmp(cut, actual, (size_t)expectedLength + 2) != 0) {
+            char name[96];
+            snprintf(name, sizeof(name), "%s cut at %d", format, count);
+            report(name, count > 0 ? cut : "", actualLength, expected, expectedLength);
+            return;
+        }
+    }
+}
+
+static void checkFixedCases(void)
+{
+    check("");
+    check("plain text");
+    check("%%");
+    check("100%% sure, %d%%", 42);
+    check("%d %i %u %x %X %o", 0, 0, 0U, 0U, 0U, 0U);
+    check("%d %d %d", INT_MIN, INT_MAX, -1);
+    check("%ld %ld %lu", LONG_MIN, LONG_MAX, ULONG_MAX);
+    check("%lld %lld %llu %llx %llo", LLONG_MIN, LLONG_MAX, ULLONG_MAX, ULLONG_MAX, ULLONG_MAX);
+    check("%hhd %hhu %hd %hu", 300, 300, 70000, 70000);
+    check("%zu %zd %td %jd %ju", (size_t)123456789, (ptrdiff_t)-5, (ptrdiff_t)-77, (intmax_t)INTMAX_MIN, (uintmax_t)UINTMAX_MAX);
+    check("%#x %#X %#o %#o %#.0o %#.0x %.0d|", 255U, 255U, 8U, 0U, 0U, 0U, 0);
+    check("%#2hhx %#5x %#05x %#-8x| %#.5o %#8.5o", 0xD5, 0x1F, 0x1F, 0x1F, 8U, 8U);
+    check("%-8.3d| %08.3d| %+.0d| % 05d| %+-6d|", 5, 5, 0, 42, 42);
+    check("%.40d|%-45.40x|%050lld|", 7, 7U, -7LL);
+    check("%*d|%-*d|%*d|%.*d|%.*d|%0*.*d|", 6, 1, 6, 1, -6, 1, 3, 1, -3, 1, -8, -1, 42);
+    check("%c%c%c|%3c|%-3c|", 'a', 'b', 'c', 'x', 'y');
+    check("%s|%10s|%-10s|%.2s|%.0s|%.*s|%.*s|%*s|", "hello", "hi", "hi", "hello", "hello", 3, "hello", -1, "hello", -4, "ab");
+
+    check("%f %e %g", 0.0, 0.0, 0.0);
+    check("%f %e %g", -0.0, -0.0, -0.0);
+    check("%f %F %e %E %g %G", INFINITY, INFINITY, -INFINITY, -INFINITY, INFINITY, -INFINITY);
+    check("%f %F %e %E %g %G", NAN, NAN, -NAN, -NAN, NAN, -NAN);
+    check("%+f|% e|%08f|%-8g|%+08e|", INFINITY, NAN, -INFINITY, NAN, INFINITY);
+    check("%.0f %.0f %.0f %.0f %.0f", 0.5, 1.5, 2.5, -0.5, -1.5);
+    check("%.1f %.1f %.1f %.2f %.2f %.3f", 0.05, 0.15, 0.25, 1.005, 2.675, 1.0005);
+    check("x=%d, y=%5.2f, name=%-6s|, hex=%#06x", -12, 3.14159, "io", 0xBEEFU);
+    check("%e %.2e %E %g %g %g %-10g|", 1.5, 9.999, 1e100, 0.5, 100000.0, 1e-5, 1e10);
+#if defined(PRINTF_EXACT_FLOAT)
+    check("%.0f", 1e23);
+    check("%f %f %.17g %.17g %g %g", DBL_MAX, -DBL_MAX, DBL_MIN, DBL_TRUE_MIN, DBL_MAX, DBL_TRUE_MIN);
+    check("%.1000f|%.800e|%.700g", 1e-300, DBL_TRUE_MIN, 0.1);
+    check("%e %e %e %e", 1e-100, 1e100, 9.9999999e99, 123456789.0);
+    check("%g %g %g %g %g %g", 100000.0, 1000000.0, 0.0001, 0.00001, 123456789.0, 0.000123456789);
+    check("%.3g %.3g %.1g %.0g %#.0g %#.3g %#g", 99.96, 999.6, 9.5, 95.0, 95.0, 1.0, 100000.0);
+    check("%#.0f %#.0e %#.3g %#.2g", 3.0, 3.0, 99.96, 0.000099996);
+    check("%#.2g", 99.96);
+    check("%.*f|%.*e|%*.*g|%0*.*f|", -1, 1.5, -3, 2.5, -12, -1, 0.1, 12, 3, -2.5);
+    check("x=%08.3f y=%-+9.2e z=% G|", -3.14159, 12345.678, 1e-10);
+#endif
+}
+
+// flags in random order, each present or not, sometimes twice
+static void randomFlags(char* flags, const char* allowed)
+{
+    size_t count = strlen(allowed);
+
+    for (size_t i = 0; i < count; i++) {
+        if (randomBelow(3) == 0)
+            *flags++ = allowed[randomBelow((int)count)];
+    }
+    *flags = 0;
+}
+
+// a width and a precision field, literal or '*'; the '*' ones are returned for the arguments
+static void randomFields(char* fields, int maxWidth, int maxPrecision, int allowStar, int* width, int* precision)
+{
+    int kind = randomBelow(8);
+
+    *width = INT_MIN;
+    *precision = INT_MIN;
+    if (kind == 0 && allowStar) {
+        *width = randomBelow(2 * maxWidth + 1) - maxWidth;
+        fields += sprintf(fields, "*");
+    } else if (kind < 5) {
+        fields += sprintf(fields, "%d", randomBelow(maxWidth + 1));
+    }
+    kind = randomBelow(8);
+    if (kind == 0 && allowStar) {
+        *precision = randomBelow(maxPrecision + 6) - 5;
+        sprintf(fields, ".*");
+    } else if (kind == 1) {
+        sprintf(fields, ".");
+    } else if (kind < 5) {
+        sprintf(fields, ".%d", randomBelow(maxPrecision + 1));
+    } else {
+        *fields = 0;
+    }
+}
+
+// the '*' arguments in front of the value
+#define CHECK_FIELDS(format, width, precision, value)               \
+    do {                                                            \
+        if ((width) != INT_MIN && (precision) != INT_MIN)           \
+            check(format, width, precision, value);                 \
+        else if ((width) != INT_MIN)                                \
+            check(format, width, value);                            \
+        else if ((precision) != INT_MIN)                            \
+            check(format, precision, value);                        \
+        else                                                        \
+            check(format, value);                                   \
+    } while (0)
+
+static void sweepIntegers(void)
+{
+    static const char* const lengths[] = { "", "hh", "h", "l", "ll", "z", "j", "t" };
+    static const char conversions[] = "diuxXo";
+    char format[64];
+    char flags[16];
+    char fields[32];
+    int width;
+    int precision;
+
+    for (int i = 0; i < SWEEP_CASES; i++) {
+        const char* length = lengths[randomBelow(8)];
+        char conversion = conversions[randomBelow(6)];
+        uint64_t bits = nextRandom() >> randomBelow(64);
+
+        if (randomBelow(10) == 0)
+            bits = randomBelow(2) ? 0 : ~0ULL;
+        randomFlags(flags, "-+ #0");
+        randomFields(fields, 30, 40, 1, &width, &precision);
+        snprintf(format, sizeof(format), "%%%s%s%s%c", flags, fields, length, conversion);
+        if (length[0] == 0 || length[0] == 'h')
+            CHECK_FIELDS(format, width, precision, (int)bits);
+        else if (length[0] == 'l' && length[1] == 0)
+            CHECK_FIELDS(format, width, precision, (long)bits);
+        else if (length[0] == 'z')
+            CHECK_FIELDS(format, width, precision, (size_t)bits);
+        else if (length[0] == 't')
+            CHECK_FIELDS(format, width, precision, (ptrdiff_t)bits);
+        else if (length[0] == 'j')
+            CHECK_FIELDS(format, width, precision, (intmax_t)bits);
+        else
+            CHECK_FIELDS(format, width, precision, (long long)bits);
+    }
+}
+
+static void sweepStrings(void)
+{
+    static const char* const strings[] = { "", "a", "hello", "a longer string with spaces" };
+    char format[64];
+    char flags[16];
+    char fields[32];
+    int width;
+    int precision;
+
+    for (int i = 0; i < SWEEP_CASES / 10; i++) {
+        randomFlags(flags, "-");
+        randomFields(fields, 30, 30, 1, &width, &precision);
+        snprintf(format, sizeof(format), "%%%s%ss", flags, fields);
+        CHECK_FIELDS(format, width, precision, strings[randomBelow(4)]);
+        width = randomBelow(61) - 30;
+        if (randomBelow(4) == 0) {
+            snprintf(format, sizeof(format), "%%%s*c", flags);
+            check(format, width, 'a' + randomBelow(26));
+        } else {
+            snprintf(format, sizeof(format), "%%%s%dc", flags, width < 0 ? -width : width);
+            check(format, 'a' + randomBelow(26));
+        }
+    }
+}
+
+// the kinds of numbers a console prints and the ones that are hard to get exact
+static double randomDouble(void)
+{
+    static const double special[] = {
+        0.0, -0.0, 0.5, 1.5, 2.5, 0.125, 0.05, 0.15, 0.25, 9.5, 99.5, 99.96, 999.6, 0.000099996,
+        9.9999999e99, 1e23, 1e22, 5e-324, DBL_MIN, DBL_MAX, INFINITY, -INFINITY, NAN, -NAN
+    };
+    uint64_t bits = nextRandom();
+    double value;
+
+    switch (randomBelow(7)) {
+    case 0:
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    case 1:
+        return ldexp((double)(bits >> 11), randomBelow(200) - 150);
+    case 2:
+        return (double)(int64_t)(bits % 2000001) - 1000000.0 + randomBelow(8) / 8.0;
+    case 3:
+        return (double)(bits % 100000) / 1000.0;
+    case 4:
+        return special[randomBelow((int)(sizeof(special) / sizeof(special[0])))];
+    case 5:
+        return (randomBelow(2) ? 1 : -1) * pow(10.0, randomBelow(60) - 30) * (1.0 - randomBelow(3) * 1e-7);
+    default:
+        return (double)(bits >> randomBelow(64)) * (randomBelow(2) ? 1 : -1);
+    }
+}
+
+#if defined(PRINTF_EXACT_FLOAT)
+static void sweepDoubles(void)
+{
+    static const char conversions[] = "fFeEgG";
+    char format[64];
+    char flags[16];
+    char fields[32];
+    int width;
+    int precision;
+
+    for (int i = 0; i < SWEEP_CASES; i++) {
+        char conversion = conversions[randomBelow(6)];
+
+        randomFlags(flags, "-+ #0");
+        randomFields(fields, 40, randomBelow(50) == 0 ? 400 : 40, strchr(flags, '#') == NULL, &width, &precision);
+        snprintf(format, sizeof(format), "%%%s%s%c", flags, fields, conversion);
+        CHECK_FIELDS(format, width, precision, randomDouble());
+    }
+}
+#else
+// without PRINTF_EXACT_FLOAT %e and %g scale the value with double arithmetic and %f computes
+// up to 16 fraction digits; the value printed has to be within one unit of the last digit
+static void sweepDoublesNear(void)
+{
+    static const char conversions[] = "feg";
+    char format[16];
+    char actual[OUTPUT_SIZE];
+    char expected[OUTPUT_SIZE];
+
+    for (int i = 0; i < SWEEP_CASES; i++) {
+        const char conversion = conversions[randomBelow(3)];
+        const int precision = randomBelow(13);
+        const double value = randomDouble();
+
+        if (!isfinite(value) || (conversion == 'f' && fabs(value) >= 1e15))
+            continue;
+        snprintf(format, sizeof(format), "%%.%d%c", precision, conversion);
+        checks++;
+        snprintf_(actual, sizeof(actual), format, value);
+        snprintf(expected, sizeof(expected), format, value);
+
+        const double printed = strtod(actual, NULL);
+        const double reference = strtod(expected, NULL);
+        const double unit = conversion == 'f' ? pow(10.0, -precision)
+            : fabs(reference) * pow(10.0, -(conversion == 'g' && precision > 0 ? precision - 1 : precision));
+        if (strcmp(actual, expected) != 0 && !(fabs(printed - reference) <= unit * 1.01 + fabs(reference) * 1e-15))
+            report(format, actual, (int)strlen(actual), expected, (int)strlen(expected));
+    }
+}
+#endif
+
+int main(void)
+{
+    checkFixedCases();
+    sweepIntegers();
+    sweepStrings();
+#if defined(PRINTF_EXACT_FLOAT)
+    sweepDoubles();
+#else
+    sweepDoublesNear();
+#endif
+    printf("printf_regression: %lu cases, %lu failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
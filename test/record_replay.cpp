@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include "microBox.h"
+#include "port_handlers/microBox_buffer_port_handler.h"
+#include "port_handlers/microBox_recording_port_handler.h"
+
+// A session recorded through RecordingPortHandler has to replay to the same output, also when
+// output held by XOFF is released by an XON that only comes in a later record.
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static MicroBox* console;
+static bool ok = true;
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        ok = false;
+    }
+}
+
+static void addCommands(MicroBox& microbox)
+{
+    console = &microbox;
+    microbox.addCommand("say", [](char** param, uint8_t parCnt) {
+        for (uint8_t i = 0; i < parCnt; i++)
+            console->printf("%s\n\r", param[i]);
+    }, "prints its parameters\n\r");
+    microbox.addCommand("count", [](char** param, uint8_t parCnt) {
+        int n = parCnt > 0 ? atoi(param[0]) : 10;
+        for (int i = 0; i < n; i++)
+            console->printf("%d\n\r", i);
+    }, "prints the numbers up to a limit\n\r");
+}
+
+static void putVarint(FILE* file, uint64_t value)
+{
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+static void putRecord(FILE* file, uint8_t kind, const std::string& data)
+{
+    fputc(kind, file);
+    putVarint(file, 0);
+    putVarint(file, data.size());
+    fwrite(data.data(), 1, data.size(), file);
+}
+
+static MICROBOX_REPLAY_RESULT replay(const char* path, bool flowControl)
+{
+    ReplayPortHandler replayPort;
+    MicroBox microbox;
+    MICROBOX_REPLAY_RESULT result = {0};
+
+    result.firstMismatch = -2;
+    if (!replayPort.load(path))
+        return result;
+    microbox.begin("rec", &replayPort);
+    microbox.setFlowControl(flowControl);
+    addCommands(microbox);
+    return replayPort.run(microbox);
+}
+
+int main()
+{
+    static uint8_t output[1 << 14];
+    char path[64];
+
+    // a session typed in pieces, recorded from a buffer port
+    snprintf(path, sizeof(path), "/tmp/microbox_record_%d.mbrc", (int)getpid());
+    {
+        static const char* typed[] = { "say he", "llo world\r", "count 50\r", "cou", "nt 3\r", "help\r" };
+        BufferPortHandler port(output, sizeof(output));
+        RecordingPortHandler recorder(&port);
+        MicroBox microbox;
+
+        expect(recorder.begin(path), "recording file opened");
+        microbox.begin("rec", &recorder);
+        addCommands(microbox);
+        for (const char* input : typed) {
+            port.setInput(input, strlen(input));
+            while (microbox.commandParser() || microbox.pendingInput() > 0) {
+            }
+        }
+        recorder.end();
+    }
+    MICROBOX_REPLAY_RESULT result = replay(path, false);
+    expect(result.firstMismatch == -1, "replayed session matches the recording");
+    expect(result.inputRecords == 6, "every typed piece is one record");
+    expect(result.outputBytes > 200, "the commands printed");
+    if (result.firstMismatch != -1)
+        printf("first mismatch at %ld\n", result.firstMismatch);
+
+    // XOFF, the command and XON in three records; the output of the command is held until the
+    // last one. The expected output is that of the same input in one piece.
+    std::string held = "\x13" "say held back\r" "\x11";
+    std::string expected;
+    {
+        BufferPortHandler port(output, sizeof(output));
+        MicroBox microbox;
+
+        microbox.begin("rec", &port);
+        microbox.setFlowControl(true);
+        addCommands(microbox);
+        port.setInput(held.data(), held.size());
+        while (microbox.commandParser() || microbox.pendingInput() > 0) {
+        }
+        expected.assign((const char*)port.output(), port.outputSize());
+    }
+    FILE* file = fopen(path, "wb");
+    expect(file != nullptr, "recording file written");
+    if (file != nullptr) {
+        fwrite("MBRC\x01", 1, 5, file);
+        putRecord(file, MICROBOX_RECORD_OUTPUT, expected);
+        putRecord(file, MICROBOX_RECORD_INPUT, "\x13");
+        putRecord(file, MICROBOX_RECORD_INPUT, "say held back\r");
+        putRecord(file, MICROBOX_RECORD_INPUT, "\x11");
+        fclose(file);
+        result = replay(path, true);
+        expect(result.inputRecords == 3, "XON taken from the later record");
+        expect(result.firstMismatch == -1, "held output replayed after XON");
+        if (result.firstMismatch != -1)
+            printf("first mismatch at %ld\n", result.firstMismatch);
+    }
+    remove(path);
+
+    printf("record_replay: %s\n", ok ? "passed" : "failed");
+    return ok ? 0 : 1;
+}
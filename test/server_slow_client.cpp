@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <arpa/inet.h>
+#include "port_handlers/microBox_epoll_server.h"
+
+// A client sends a command with 8 MB of output and a second one behind it, and doesn't read for
+// a while. The server has to keep all of the output queued, sleep in poll() instead of spinning
+// while the client is behind, and deliver every byte and the second answer once it reads again.
+
+#define DUMP_SIZE                   (8 << 20)
+#define DUMP_CHUNK                  1024
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main()
+{
+    MicroBoxServer server;
+    uint16_t port = 47300;
+
+    auto setup = [](MicroBox& microbox) {
+        microbox.addCommand("dump", [&microbox](char**, uint8_t) {
+            static const std::string chunk(DUMP_CHUNK, 'x');
+            for (int i = 0; i < DUMP_SIZE / DUMP_CHUNK; i++)
+                microbox.print(chunk.c_str(), chunk.size());
+        }, "8 MB of text\n\r");
+        microbox.addCommand("ping", [&microbox](char**, uint8_t) {
+            microbox.print("pong\n");
+        }, "answers pong\n\r");
+    };
+    while (!server.beginTcp(port, "slow", setup)) {
+        if (++port == 47400) {
+            printf("FAILED: no free port\n");
+            return 1;
+        }
+    }
+
+    // one command per poll, so the ping waits behind the dump
+    server.setSessionBudget(0, 1);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    int small = 4096;
+    setsockopt(client, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(client, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        printf("FAILED: connect\n");
+        return 1;
+    }
+    for (int i = 0; i < 10 && server.sessionCount() == 0; i++)
+        server.poll(10);
+    const char* commands = "dump\rping\r";
+    send(client, commands, strlen(commands), 0);
+
+    // the client doesn't read: after the dump is queued, poll() has nothing to do but wait
+    for (int i = 0; i < 5; i++)
+        server.poll(10);
+    double start = now();
+    for (int i = 0; i < 10; i++)
+        server.poll(20);
+    double waited = now() - start;
+
+    // now the client reads everything while the server goes on
+    int flags = fcntl(client, F_GETFL);
+    fcntl(client, F_SETFL, flags | O_NONBLOCK);
+    std::string received;
+    size_t dumped = 0;
+    char buffer[65536];
+    double deadline = now() + 20;
+    while (received.find("pong") == std::string::npos && now() < deadline) {
+        server.poll(1);
+        ssize_t count;
+        while ((count = recv(client, buffer, sizeof(buffer), 0)) > 0) {
+            for (ssize_t i = 0; i < count; i++)
+                dumped += buffer[i] == 'x';
+            received.append(buffer, count);
+            // only the end is needed to find the answer to ping
+            if (received.size() > 64)
+                received.erase(0, received.size() - 64);
+        }
+    }
+    close(client);
+
+    bool ok = true;
+    if (waited < 0.15) {
+        printf("FAILED: 10 polls of 20 ms took %.0f ms while the client was behind\n", waited * 1000);
+        ok = false;
+    }
+    if (dumped != DUMP_SIZE) {
+        printf("FAILED: %zu of %d bytes of the dump arrived\n", dumped, DUMP_SIZE);
+        ok = false;
+    }
+    if (received.find("pong") == std::string::npos) {
+        printf("FAILED: the command after the dump wasn't answered\n");
+        ok = false;
+    }
+    printf("server_slow_client: %zu bytes delivered, 10 polls of 20 ms took %.0f ms while blocked%s\n",
+           dumped, waited * 1000, ok ? "" : ", FAILED");
+    return ok ? 0 : 1;
+}
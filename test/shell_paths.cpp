@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "microBox.h"
+#include "port_handlers/microBox_buffer_port_handler.h"
+
+// The ways into a command besides a plain line, on the default build: streaming commands with
+// lines longer than the buffer, commands in groups, generators with the pager and XON/XOFF
+// without a TX buffer.
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static MicroBox* console;
+static bool ok = true;
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        ok = false;
+    }
+}
+
+static std::string run(BufferPortHandler& port, const std::string& input)
+{
+    port.setInput(input.data(), input.size());
+    while (console->commandParser() || console->pendingInput() > 0) {
+    }
+    std::string output((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    return output;
+}
+
+static bool contains(const std::string& text, const std::string& part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+static std::vector<std::string> chunks;
+static int lastChunks;
+
+static void testStream(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.addStreamCommand("regs", [](const char* chunk, size_t len, bool last) {
+        chunks.push_back(std::string(chunk, len));
+        lastChunks += last;
+    }, "sets registers\n\r");
+
+    std::string words;
+    for (int i = 0; i < 30; i++)
+        words += " r" + std::to_string(i) + "=" + std::to_string(i * 1000);
+    run(port, "regs" + words + "\r");
+    expect(chunks.size() > 2, "stream: a long line comes in several chunks");
+    expect(lastChunks == 1 && !chunks.empty(), "stream: only the final chunk is the last");
+    std::string joined;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        expect(strlen(chunks[i].c_str()) == chunks[i].size(), "stream: chunks are zero terminated at their length");
+        expect(i + 1 == chunks.size() || chunks[i].back() == ' ', "stream: chunks end between words");
+        joined += chunks[i];
+    }
+    expect(joined == words.substr(1), "stream: the chunks make up the parameters");
+}
+
+static std::string setAddress;
+
+static void testGroups(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    int8_t net = microbox.addGroup("net", "Network settings.\n\r");
+    int8_t ip = microbox.addGroup("ip", "IP configuration.\n\r", net);
+    expect(net >= 0 && ip >= 0, "groups: created");
+    microbox.addCommand("set", [](char** param, uint8_t parCnt) {
+        setAddress = parCnt > 0 ? param[0] : "";
+    }, "sets the address\n\r", ip);
+
+    run(port, "net ip set 10.0.0.1\r");
+    expect(setAddress == "10.0.0.1", "groups: the words select the group and the command");
+    setAddress.clear();
+    std::string output = run(port, "set 10.0.0.2\r");
+    expect(setAddress.empty(), "groups: a command in a group isn't found at the top");
+    output = run(port, "help\r");
+    expect(contains(output, "net") && !contains(output, "sets the address"), "groups: help shows the top level");
+    output = run(port, "help net ip\r");
+    expect(contains(output, "IP configuration.") && contains(output, "set\r"), "groups: help of a group lists its commands");
+    output = run(port, "help net ip set\r");
+    expect(contains(output, "sets the address"), "groups: help of a command in a group");
+}
+
+static uint32_t generatedRows;
+
+static void testPager(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.setPageLength(3);
+    microbox.addGenerator("rows", [](char**, uint8_t, uint32_t row) {
+        generatedRows++;
+        console->printf("row %lu\n\r", (unsigned long)row);
+        return row < 9;
+    }, "prints 10 rows\n\r");
+
+    generatedRows = 0;
+    std::string output = run(port, "rows\r");
+    expect(contains(output, "row 2\r") && !contains(output, "row 3\r") && contains(output, "--More--"),
+        "pager: stops after a page");
+    output = run(port, " ");
+    expect(contains(output, "row 3\r") && contains(output, "row 5\r") && !contains(output, "row 6\r"),
+        "pager: any key shows the next page");
+    output = run(port, "q");
+    expect(generatedRows == 6 && contains(output, "box> "), "pager: q stops the generator");
+
+    microbox.setPageLength(0);
+    generatedRows = 0;
+    output = run(port, "rows\r");
+    expect(generatedRows == 10 && contains(output, "row 9\r") && !contains(output, "--More--"),
+        "pager: without a page length all rows come at once");
+}
+
+static std::string said;
+
+// without a TX buffer the console waits for XON before it prints; XON/XOFF never reach the line
+static void testFlowControl(BufferPortHandler& port)
+{
+    MicroBox microbox;
+
+    console = &microbox;
+    microbox.begin("box", &port, false, false);
+    microbox.addCommand("say", [](char** param, uint8_t parCnt) {
+        said = parCnt > 0 ? param[0] : "";
+        console->printf("%s\n\r", said.c_str());
+    }, "prints its parameter\n\r");
+
+    std::string plain = run(port, "say hello\r");
+    microbox.setFlowControl(true);
+    std::string output = run(port, "\x13say hel\x11lo\r");
+    expect(said == "hello", "flow control: XON and XOFF are taken out of the line");
+    expect(output == plain, "flow control: the output goes out after XON");
+
+    // XON only comes behind a full chunk of other input
+    std::string input = "\x13say held\r" + std::string(MICROBOX_RX_CHUNK_SIZE, ' ') + "\x11";
+    output = run(port, input);
+    expect(said == "held" && contains(output, "held\r"), "flow control: XON found behind the chunk");
+    expect(microbox.getDroppedBytes() == 0, "flow control: nothing dropped");
+}
+
+int main()
+{
+    static uint8_t output[1 << 16];
+    BufferPortHandler port(output, sizeof(output));
+
+    testStream(port);
+    testGroups(port);
+    testPager(port);
+    testFlowControl(port);
+
+    printf("shell_paths: %s\n", ok ? "passed" : "failed");
+    return ok ? 0 : 1;
+}
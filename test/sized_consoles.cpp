@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "microBox.h"
+#include "port_handlers/microBox_buffer_port_handler.h"
+
+// Two consoles of very different sizes in one program: a small debug console without history
+// and a host console with 4 KB lines, next to a MicroBox with the default sizes. Each one has to
+// keep to its own limits.
+
+struct DebugConsole : MicroBoxDefaultConfig {
+    static constexpr uint16_t commandBufferSize =   24;
+    static constexpr int historyBufferSize =        0;
+    static constexpr uint8_t commandNumber =        4;
+    static constexpr uint8_t parameterNumber =      2;
+};
+
+struct HostConsole : MicroBoxDefaultConfig {
+    static constexpr uint16_t commandBufferSize =   4096;
+    static constexpr int historyBufferSize =        16384;
+    static constexpr uint8_t commandNumber =        32;
+    static constexpr uint8_t parameterNumber =      64;
+};
+
+static_assert(MicroBoxSized<DebugConsole>::footprint().commandLine >= 24, "the line buffer is counted");
+static_assert(MicroBoxSized<DebugConsole>::footprint().history == 0, "no history, no history buffer");
+static_assert(MicroBoxSized<HostConsole>::footprint().history == 16384, "the history buffer is counted");
+static_assert(MicroBoxSized<DebugConsole>::footprint().total < MicroBox::footprint().total,
+    "the debug console is smaller than the default one");
+static_assert(MicroBoxSized<HostConsole>::footprint().total > 4096 + 16384, "the host console holds its buffers");
+
+extern "C" void _putchar(char character)
+{
+    (void)character;
+}
+
+static bool ok = true;
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        ok = false;
+    }
+}
+
+template<typename Console>
+static std::string run(Console& console, BufferPortHandler& port, const std::string& input)
+{
+    port.setInput(input.data(), input.size());
+    while (console.commandParser() || console.pendingInput() > 0) {
+    }
+    std::string output((const char*)port.output(), port.outputSize());
+    port.clearOutput();
+    return output;
+}
+
+int main()
+{
+    static uint8_t debugOutput[1 << 14];
+    static uint8_t hostOutput[1 << 16];
+    BufferPortHandler debugPort(debugOutput, sizeof(debugOutput));
+    BufferPortHandler hostPort(hostOutput, sizeof(hostOutput));
+    MicroBoxSized<DebugConsole> debug;
+    MicroBoxSized<HostConsole> host;
+    size_t debugLength = 0;
+    uint8_t debugParameters = 0;
+    size_t hostLength = 0;
+    uint8_t hostParameters = 0;
+
+    debug.begin("debug", &debugPort, false, false);
+    host.begin("host", &hostPort, false, false);
+    debug.addCommand("len", [&](char** param, uint8_t parCnt) {
+        debugParameters = parCnt;
+        debugLength = parCnt > 0 ? strlen(param[0]) : 0;
+    }, "length of the first parameter\n\r");
+    host.addCommand("len", [&](char** param, uint8_t parCnt) {
+        hostParameters = parCnt;
+        hostLength = parCnt > 0 ? strlen(param[0]) : 0;
+    }, "length of the first parameter\n\r");
+
+    // the debug console cuts its lines at 23 characters, the host console takes 3000
+    run(debug, debugPort, "len " + std::string(100, 'a') + "\r");
+    expect(debugLength == 19, "debug line cut at 23 characters");
+    run(host, hostPort, "len " + std::string(3000, 'b') + "\r");
+    expect(hostLength == 3000, "host line of 3000 characters");
+
+    // parameters beyond the configured number are not split off
+    run(debug, debugPort, "len a b c d\r");
+    expect(debugParameters == 2, "debug console splits 2 parameters");
+    std::string many = "len";
+    for (int i = 0; i < 50; i++)
+        many += " p";
+    run(host, hostPort, many + "\r");
+    expect(hostParameters == 50, "host console splits 50 parameters");
+
+    // the debug console has room for "help" and 3 more commands
+    bool added = true;
+    for (int i = 0; i < 3; i++)
+        added = debug.addCommand(i == 0 ? "a" : i == 1 ? "b" : "c", [](char**, uint8_t) {}, "") && added;
+    expect(!added, "debug command table is full after 4 entries");
+    for (int i = 0; i < 20; i++)
+        expect(host.addCommand(("cmd" + std::to_string(i)).c_str(), [](char**, uint8_t) {}, ""), "host command table");
+
+    // cursor up brings the last line back on the host console, the debug console keeps none
+    run(host, hostPort, "len xyz\r");
+    std::string recalled = run(host, hostPort, "\x1B[A");
+    expect(recalled.find("len xyz") != std::string::npos, "host history recalls the last line");
+    std::string nothing = run(debug, debugPort, "\x1B[A");
+    expect(nothing.find("len") == std::string::npos, "debug console has no history");
+
+    // printf() on consoles that aren't the default MicroBox
+    debug.printf("%d/%s", -17, "dbg");
+    std::string debugPrinted((const char*)debugPort.output(), debugPort.outputSize());
+    debugPort.clearOutput();
+    expect(debugPrinted == "-17/dbg", "printf on the debug console");
+    host.printf("%05u %x\n", 42U, 0xBEEFU);
+    std::string hostPrinted((const char*)hostPort.output(), hostPort.outputSize());
+    hostPort.clearOutput();
+    expect(hostPrinted == "00042 beef\r\n", "printf on the host console");
+
+    printf("sized_consoles: debug %u bytes, default %u bytes, host %u bytes, %s\n",
+           (unsigned)MicroBoxSized<DebugConsole>::footprint().total, (unsigned)MicroBox::footprint().total,
+           (unsigned)MicroBoxSized<HostConsole>::footprint().total, ok ? "all limits kept" : "FAILED");
+    return ok ? 0 : 1;
+}
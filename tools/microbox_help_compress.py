@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Compresses microBox help descriptions with a shared dictionary.
+
+The input file holds one description per command, each one starts with a line
+containing the command name in brackets:
+
+    [sum]
+    DESCRIPTION:
+        Use this command to print the sum of two integers.
+    USAGE:
+        sum a b
+
+The output is a C header with the dictionary and one array per description,
+pass the dictionary to MicroBox::setHelpDictionary() and the arrays to
+addCommand() in place of the plain descriptions:
+
+    microbox.setHelpDictionary(helpDictionary);
+    microbox.addCommand("sum", sum, help_sum);
+
+Compressed text starts with a marker byte (0x01). Bytes 0x80..0xFE stand for
+dictionary entries, 0xFF escapes the byte after it, anything else is literal.
+The dictionary is a list of entries, each one prefixed with its length.
+"""
+
+import argparse
+import re
+import sys
+
+MARKER = 0x01
+FIRST_ENTRY = 0x80
+MAX_ENTRIES = 0xFF - FIRST_ENTRY
+ESCAPE = 0xFF
+MIN_LENGTH = 3
+MAX_LENGTH = 32
+
+
+def parse(text):
+    descriptions = []
+    for line in text.splitlines():
+        match = re.fullmatch(r"\[([A-Za-z0-9_\-]+)\]\s*", line)
+        if match:
+            descriptions.append([match.group(1), []])
+        elif descriptions:
+            descriptions[-1][1].append(line)
+        elif line.strip() and not line.startswith("#"):
+            sys.exit("text before the first [command] line")
+    return [(name, ("\n".join(lines).rstrip("\n") + "\n").encode("utf-8")) for name, lines in descriptions]
+
+
+def savings(length, count):
+    # every occurrence shrinks to one byte, the entry costs its length and the length byte
+    return count * (length - 1) - (length + 1)
+
+
+def best_candidate(texts):
+    counts = {}
+    for segments in texts:
+        for segment in segments:
+            if not isinstance(segment, bytes):
+                continue
+            for length in range(MIN_LENGTH, min(MAX_LENGTH, len(segment)) + 1):
+                for start in range(len(segment) - length + 1):
+                    piece = segment[start:start + length]
+                    counts[piece] = counts.get(piece, 0) + 1
+
+    best, best_saving = None, 0
+    for piece, count in counts.items():
+        if count < 2:
+            continue
+        saving = savings(len(piece), count)
+        if saving > best_saving:
+            best, best_saving = piece, saving
+    return best
+
+
+def replace(texts, piece, index):
+    # overlapping matches were counted above, split() takes the non-overlapping ones
+    result = []
+    for segments in texts:
+        replaced = []
+        for segment in segments:
+            if not isinstance(segment, bytes):
+                replaced.append(segment)
+                continue
+            parts = segment.split(piece)
+            for i, part in enumerate(parts):
+                if i > 0:
+                    replaced.append(index)
+                if part:
+                    replaced.append(part)
+        result.append(replaced)
+    return result
+
+
+def compress(descriptions):
+    texts = [[text] for _, text in descriptions]
+    dictionary = []
+    while len(dictionary) < MAX_ENTRIES:
+        piece = best_candidate(texts)
+        if piece is None:
+            break
+        texts = replace(texts, piece, len(dictionary))
+        dictionary.append(piece)
+
+    encoded = []
+    for segments in texts:
+        out = bytearray([MARKER])
+        for segment in segments:
+            if isinstance(segment, bytes):
+                for byte in segment:
+                    if byte >= FIRST_ENTRY or byte == 0:
+                        out.append(ESCAPE)
+                    out.append(byte)
+            else:
+                out.append(FIRST_ENTRY + segment)
+        encoded.append(bytes(out))
+    return dictionary, encoded
+
+
+def c_string(data):
+    out = '"'
+    for byte in data:
+        if byte == ord('"') or byte == ord('\\'):
+            out += "\\" + chr(byte)
+        elif 0x20 <= byte < 0x7F:
+            out += chr(byte)
+        elif byte == ord('\n'):
+            out += "\\n"
+        else:
+            # three digit octal escapes can't swallow the following characters
+            out += "\\%03o" % byte
+    return out + '"'
+
+
+def c_lines(data, width=96):
+    lines, line = [], bytearray()
+    for byte in data:
+        line.append(byte)
+        if len(line) >= width or byte == ord('\n'):
+            lines.append(c_string(line))
+            line = bytearray()
+    if line or not lines:
+        lines.append(c_string(line))
+    return "\n    ".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compress microBox help descriptions into a C header.")
+    parser.add_argument("input", help="text file with [command] sections")
+    parser.add_argument("output", help="header file to write")
+    args = parser.parse_args()
+
+    with open(args.input, encoding="utf-8") as f:
+        descriptions = parse(f.read())
+    if not descriptions:
+        sys.exit("no descriptions found")
+    dictionary, encoded = compress(descriptions)
+
+    plain = sum(len(text) + 1 for _, text in descriptions)
+    packed = sum(len(entry) + 1 for entry in dictionary) + 1 + sum(len(text) + 1 for text in encoded)
+    guard = re.sub(r"[^A-Za-z0-9]", "_", args.output.split("/")[-1]).upper()
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write("// generated by microbox_help_compress.py from %s, do not edit\n" % args.input.split("/")[-1])
+        f.write("// %d bytes of descriptions compressed to %d bytes\n\n" % (plain, packed))
+        f.write("#ifndef %s\n#define %s\n\n" % (guard, guard))
+        # the data stays in flash on AVR, the names without _data are what microBox takes
+        f.write('#include "microBox.h"\n\n')
+        f.write("static const char helpDictionary_data[] MICROBOX_PROGMEM =\n    %s;\n"
+                % c_lines(b"".join(bytes([len(entry)]) + entry for entry in dictionary)))
+        f.write("#define helpDictionary MICROBOX_FLASH(helpDictionary_data)\n\n")
+        for (name, _), text in zip(descriptions, encoded):
+            symbol = "help_" + re.sub(r"\W", "_", name)
+            f.write("static const char %s_data[] MICROBOX_PROGMEM =\n    %s;\n" % (symbol, c_lines(text)))
+            f.write("#define %s MICROBOX_FLASH(%s_data)\n\n" % (symbol, symbol))
+        f.write("#endif // %s\n" % guard)
+    print("%d bytes of descriptions compressed to %d bytes" % (plain, packed))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+"""Sends files to and receives files from a microBox transfer command.
+
+The console is a serial device (set up raw at the given baud rate) or a TCP
+console server given as host:port. The tool types the command line, then
+runs the transfer:
+
+    microbox_transfer.py /dev/ttyUSB0 send "calib load" calib.bin
+    microbox_transfer.py localhost:2323 receive "fw dump" fw.bin
+
+A frame is SOH, sequence number, payload length, up to 255 bytes of payload
+and a CRC-16/XMODEM over sequence, length and payload, high byte first. An
+empty frame ends the transfer. The receiver answers ACK n (all frames up to n
+arrived) or NAK n (send again from frame n), CAN CAN aborts. After the empty
+frame of an upload was acknowledged the tool sends EOT until the device answers
+ACK EOT or its prompt shows up, so a lost last ACK never sends frames to the
+shell.
+"""
+
+import argparse
+import os
+import select
+import socket
+import sys
+import termios
+import time
+
+SOH = 0x01
+EOT = 0x04
+ACK = 0x06
+NAK = 0x15
+CAN = 0x18
+PROMPT = b"> "
+
+
+def crc16(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+        crc &= 0xFFFF
+    return crc
+
+
+def frame(sequence, payload):
+    body = bytes([sequence & 0xFF, len(payload)]) + payload
+    crc = crc16(body)
+    return bytes([SOH]) + body + bytes([crc >> 8, crc & 0xFF])
+
+
+class Console:
+    def __init__(self, target, baud):
+        self.sock = None
+        if ":" in target and not target.startswith("/"):
+            host, port = target.rsplit(":", 1)
+            self.sock = socket.create_connection((host, int(port)))
+            self.fd = self.sock.fileno()
+        else:
+            self.fd = os.open(target, os.O_RDWR | os.O_NOCTTY)
+            attrs = termios.tcgetattr(self.fd)
+            attrs[0] = attrs[1] = attrs[3] = 0
+            attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+            speed = getattr(termios, "B%d" % baud)
+            attrs[4] = attrs[5] = speed
+            termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+        self.pending = bytearray()
+
+    def write(self, data):
+        while data:
+            written = os.write(self.fd, data)
+            data = data[written:]
+
+    def read(self, timeout):
+        """returns what arrived within timeout seconds, b"" if nothing did"""
+        if self.pending:
+            data, self.pending = bytes(self.pending), bytearray()
+            return data
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if not ready:
+            return b""
+        data = os.read(self.fd, 4096)
+        if not data:
+            raise EOFError("console closed")
+        return data
+
+    def unread(self, data):
+        self.pending[:0] = data
+
+    def read_until(self, marker, timeout):
+        """reads up to and including marker, returns the text before it"""
+        collected = bytearray()
+        deadline = time.monotonic() + timeout
+        while marker not in collected:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                raise TimeoutError("no %r from the device" % marker)
+            collected += self.read(left)
+        end = collected.index(marker) + len(marker)
+        self.unread(collected[end:])
+        return bytes(collected[:end - len(marker)])
+
+    def wait_for(self, markers, timeout):
+        """reads until one of markers arrived, returns it or None after timeout seconds"""
+        collected = bytearray()
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            collected += self.read(0.05)
+            for marker in markers:
+                if marker in collected:
+                    self.unread(collected[collected.index(marker) + len(marker):])
+                    return marker
+        self.unread(collected)
+        return None
+
+
+def send(console, data, block, window, timeout):
+    # the device asks for frame 0 with NAK 0 when it is ready
+    console.read_until(bytes([NAK, 0]), timeout)
+    blocks = [data[i:i + block] for i in range(0, len(data), block)] + [b""]
+    base = 0
+    next_block = 0
+    last_progress = time.monotonic()
+    control = bytearray()
+
+    while base < len(blocks):
+        while next_block < len(blocks) and next_block < base + window:
+            console.write(frame(next_block, blocks[next_block]))
+            next_block += 1
+
+        control += console.read(0.05)
+        while len(control) >= 2:
+            kind, sequence = control[0], control[1]
+            if kind == CAN and sequence == CAN:
+                raise RuntimeError("the device aborted the transfer")
+            if kind not in (ACK, NAK):
+                del control[0]
+                continue
+            del control[:2]
+            acked = base + ((sequence - base) & 0xFF)
+            if kind == ACK and acked < next_block:
+                base = acked + 1
+                last_progress = time.monotonic()
+            elif kind == NAK and acked <= next_block:
+                base = next_block = acked
+                last_progress = time.monotonic()
+
+        if time.monotonic() - last_progress > timeout:
+            # go back N: nothing was acknowledged for too long, send the window again
+            next_block = base
+            last_progress = time.monotonic()
+    console.unread(control)
+
+    # the device takes the last frame again until EOT ends the transfer
+    for _ in range(10):
+        console.write(bytes([EOT]))
+        if console.wait_for([bytes([ACK, EOT]), PROMPT], timeout):
+            return
+    raise TimeoutError("no ACK for EOT from the device")
+
+
+def receive(console, timeout):
+    data = bytearray()
+    expected = 0
+    buffer = bytearray()
+    nak_sent = False
+    last_progress = time.monotonic()
+
+    while True:
+        incoming = console.read(0.05)
+        buffer += incoming
+        while True:
+            start = buffer.find(bytes([SOH]))
+            if start < 0:
+                buffer.clear()
+                break
+            del buffer[:start]
+            if len(buffer) < 3 or len(buffer) < 5 + buffer[2]:
+                break
+            length = buffer[2]
+            body = bytes(buffer[1:3 + length])
+            crc = buffer[3 + length] << 8 | buffer[4 + length]
+            if crc16(body) != crc:
+                del buffer[0]
+                continue
+            del buffer[:5 + length]
+            if body[0] == expected & 0xFF:
+                console.write(bytes([ACK, body[0]]))
+                expected += 1
+                nak_sent = False
+                last_progress = time.monotonic()
+                if length == 0:
+                    console.unread(buffer)
+                    # the device sends the prompt once it got the last ACK
+                    for _ in range(10):
+                        if console.wait_for([PROMPT], timeout):
+                            break
+                        console.write(bytes([ACK, body[0]]))
+                    return bytes(data)
+                data += body[2:]
+            elif not nak_sent or body[0] == (expected + 1) & 0xFF:
+                # the device goes back to the expected frame, one NAK per round is enough
+                console.write(bytes([NAK, expected & 0xFF]))
+                nak_sent = True
+
+        if time.monotonic() - last_progress > timeout:
+            console.write(bytes([NAK, expected & 0xFF]))
+            last_progress = time.monotonic()
+
+
+def abort(console):
+    # a frame cut short takes the first CANs as its rest, CAN CAN goes out until the device
+    # says it aborted
+    for _ in range(140):
+        console.write(bytes([CAN, CAN]))
+        if console.wait_for([b"transfer aborted"], 0.05):
+            return
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("console", help="serial device or host:port")
+    parser.add_argument("direction", choices=["send", "receive"])
+    parser.add_argument("command", help="command line that starts the transfer on the device")
+    parser.add_argument("file")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--block", type=int, default=128, help="payload bytes per frame, MICROBOX_TRANSFER_BLOCK")
+    parser.add_argument("--window", type=int, default=4, help="frames in flight, MICROBOX_TRANSFER_WINDOW")
+    parser.add_argument("--timeout", type=float, default=1.0, help="seconds without progress before a retry")
+    args = parser.parse_args()
+
+    console = Console(args.console, args.baud)
+    console.write(args.command.encode() + b"\r")
+    start = time.monotonic()
+    try:
+        if args.direction == "send":
+            with open(args.file, "rb") as f:
+                data = f.read()
+            send(console, data, args.block, args.window, args.timeout)
+        else:
+            data = receive(console, args.timeout)
+            with open(args.file, "wb") as f:
+                f.write(data)
+    except KeyboardInterrupt:
+        abort(console)
+        sys.exit(1)
+    seconds = time.monotonic() - start
+    print("%d bytes in %.2f s, %.0f bytes/s" % (len(data), seconds, len(data) / seconds), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()